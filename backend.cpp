@@ -0,0 +1,110 @@
+#include "backend.h"
+#include "mog2simd.h"
+
+#include <iostream>
+
+/* Default variance of each gaussian component 15 / 75 / 75 */
+void SetupBackgroundModel(Ptr<BackgroundSubtractorMOG2> bsModel)
+{
+	bsModel->setVarInit(15);
+	bsModel->setVarMax(20);
+	bsModel->setVarMin(4);
+}
+
+void CpuBackend::CvtColor(const Mat & src, Mat & dst, int code)
+{
+	cvtColor(src, dst, code);
+}
+
+void CpuBackend::CreateBackgroundModel(int history, uint8_t mog2Threshold)
+{
+	m_bsModel = createBackgroundSubtractorMOG2Simd(history, mog2Threshold, false);
+	SetupBackgroundModel(m_bsModel);
+}
+
+void CpuBackend::BackgroundSubtract(const Mat & frame, Mat & foreground, double learningRate)
+{
+	m_bsModel->apply(frame, foreground, learningRate);
+}
+
+void CpuBackend::BackgroundImage(Mat & background)
+{
+	m_bsModel->getBackgroundImage(background);
+}
+
+void CpuBackend::Open(const Mat & foreground, BitMask & opened)
+{
+	m_foregroundMask.Pack(foreground);
+	m_foregroundMask.Open(opened);
+}
+
+#ifdef HAVE_CUDA_BACKEND
+void CudaBackend::CreateBackgroundModel(int history, uint8_t mog2Threshold)
+{
+	m_bsModel = cuda::createBackgroundSubtractorMOG2(history, mog2Threshold, false);
+	SetupBackgroundModel(m_bsModel);
+}
+
+void CudaBackend::BackgroundSubtract(const Mat & frame, Mat & foreground, double learningRate)
+{
+	m_gpuFrame.upload(frame);
+	m_bsModel->apply(m_gpuFrame, m_gpuForegroundFrame, learningRate);
+	//cuda::threshold(gpuForegroundFrame, gpuForegroundFrame, 10.0, 255.0, THRESH_BINARY);
+	m_gpuForegroundFrame.download(foreground);
+}
+
+void CudaBackend::BackgroundImage(Mat & background)
+{
+	m_bsModel->getBackgroundImage(m_gpuBackground); /* CUDA model writes GpuMat only */
+	m_gpuBackground.download(background);
+}
+#endif
+
+/*
+*
+*/
+
+bool IsCudaBackendAvailable()
+{
+#ifdef HAVE_CUDA_BACKEND
+	return cuda::getCudaEnabledDeviceCount() > 0;
+#else
+	return false;
+#endif
+}
+
+Ptr<ComputeBackend> createComputeBackend(BackendType_t type)
+{
+#ifdef HAVE_CUDA_BACKEND
+	if(type != BACKEND_CPU && IsCudaBackendAvailable())
+		return makePtr<CudaBackend>();
+#endif
+	if(type == BACKEND_CUDA)
+		cout << "!!! No CUDA device, compute backend on CPU" << endl;
+	return makePtr<CpuBackend>();
+}
+
+const char *BackendTypeName(BackendType_t type)
+{
+	switch(type) {
+		case BACKEND_CPU:
+			return "cpu";
+		case BACKEND_CUDA:
+			return "cuda";
+		default:
+			return "auto";
+	}
+}
+
+bool ParseBackendType(const string & s, BackendType_t & type)
+{
+	if(s == "auto")
+		type = BACKEND_AUTO;
+	else if(s == "cpu")
+		type = BACKEND_CPU;
+	else if(s == "cuda")
+		type = BACKEND_CUDA;
+	else
+		return false;
+	return true;
+}
@@ -0,0 +1,91 @@
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#include "dragon-eye.h"
+#include "bitmask.h"
+
+#ifdef HAVE_CUDA_BACKEND
+#include <opencv2/cudabgsegm.hpp>
+#endif
+
+/*
+* Compute backend of detection kernels : color conversion, background subtraction (MOG2) and opening (erode / dilate).
+* CPU backend is always built. CUDA backend is built with HAVE_CUDA_BACKEND (OpenCV with CUDA modules) and chosen at runtime if there is a device.
+* CvtColor() is called by capture thread while the others run on detection thread, they share no state.
+*/
+
+typedef enum { BACKEND_AUTO, BACKEND_CPU, BACKEND_CUDA } BackendType_t;
+
+class ComputeBackend
+{
+public:
+	virtual ~ComputeBackend() {}
+
+	virtual BackendType_t Type() const = 0;
+	virtual const char *Name() const = 0;
+
+	virtual void CvtColor(const Mat & src, Mat & dst, int code) = 0;
+	/* background history count, varThreshold, no shadow detection */
+	virtual void CreateBackgroundModel(int history, uint8_t mog2Threshold) = 0;
+	virtual void BackgroundSubtract(const Mat & frame, Mat & foreground, double learningRate) = 0; /* CV_8UC1 in, 0 / 255 out */
+	virtual void BackgroundImage(Mat & background) = 0; /* Mean of background modes, CV_8UC1 */
+	/* Erode 3x3 then dilate 5x5, opened is 1 bit per pixel for labeling */
+	virtual void Open(const Mat & foreground, BitMask & opened) = 0;
+};
+
+/*
+* SIMD MOG2 (BackgroundSubtractorMOG2Simd) and bit packed opening, for boards without CUDA or to keep GPU free for video encoders
+*/
+
+class CpuBackend : public ComputeBackend
+{
+protected:
+	Ptr<BackgroundSubtractorMOG2> m_bsModel;
+	BitMask m_foregroundMask;
+
+public:
+	virtual BackendType_t Type() const override { return BACKEND_CPU; }
+	virtual const char *Name() const override { return "CPU"; }
+
+	virtual void CvtColor(const Mat & src, Mat & dst, int code) override;
+	virtual void CreateBackgroundModel(int history, uint8_t mog2Threshold) override;
+	virtual void BackgroundSubtract(const Mat & frame, Mat & foreground, double learningRate) override;
+	virtual void BackgroundImage(Mat & background) override;
+	virtual void Open(const Mat & foreground, BitMask & opened) override;
+};
+
+#ifdef HAVE_CUDA_BACKEND
+/*
+* MOG2 on GPU. Foreground is downloaded for labeling anyway, opening stays on the bit packed CPU kernel.
+* A BGR frame round trip to GPU costs more than cvtColor() on CPU, color conversion stays on CPU as well.
+*/
+
+class CudaBackend : public CpuBackend
+{
+private:
+	cuda::GpuMat m_gpuFrame;
+	cuda::GpuMat m_gpuForegroundFrame;
+	cuda::GpuMat m_gpuBackground;
+
+public:
+	virtual BackendType_t Type() const override { return BACKEND_CUDA; }
+	virtual const char *Name() const override { return "CUDA"; }
+
+	virtual void CreateBackgroundModel(int history, uint8_t mog2Threshold) override;
+	virtual void BackgroundSubtract(const Mat & frame, Mat & foreground, double learningRate) override;
+	virtual void BackgroundImage(Mat & background) override;
+};
+#endif
+
+bool IsCudaBackendAvailable(); /* Built with CUDA backend and there is a CUDA device */
+
+/* AUTO is CUDA if available, CUDA falls back to CPU if not */
+Ptr<ComputeBackend> createComputeBackend(BackendType_t type = BACKEND_AUTO);
+
+const char *BackendTypeName(BackendType_t type);
+bool ParseBackendType(const string & s, BackendType_t & type); /* auto / cpu / cuda */
+
+/* Variance init / max / min of detection, every MOG2 (CPU, CUDA, OpenCV reference) gets the same */
+void SetupBackgroundModel(Ptr<BackgroundSubtractorMOG2> bsModel);
+
+#endif
@@ -0,0 +1,142 @@
+#include "bitmask.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+void BitMask::Create(int rows, int cols)
+{
+	m_rows = rows;
+	m_cols = cols;
+	m_wordsPerRow = (cols + 63) >> 6;
+	m_bits.assign((size_t)rows * m_wordsPerRow, 0);
+}
+
+void BitMask::Pack(const Mat & mask)
+{
+	CV_Assert(mask.type() == CV_8UC1);
+
+	if(mask.rows != m_rows || mask.cols != m_cols)
+		Create(mask.rows, mask.cols);
+
+	for(int y=0;y<m_rows;y++) {
+		const uchar *p = mask.ptr<uchar>(y);
+		uint64_t *w = Row(y);
+		int x = 0;
+#if defined(__SSE2__)
+		const __m128i zero = _mm_setzero_si128();
+		for(;x+64<=m_cols;x+=64) { /* 16 pixels per movemask */
+			uint64_t bits = 0;
+			for(int i=0;i<4;i++) {
+				__m128i v = _mm_loadu_si128((const __m128i *)(p + x + (i << 4)));
+				uint32_t m = (~_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero))) & 0xffff;
+				bits |= (uint64_t)m << (i << 4);
+			}
+			w[x >> 6] = bits;
+		}
+#endif
+		for(;x<m_cols;x+=64) {
+			uint64_t bits = 0;
+			int n = min(64, m_cols - x);
+			for(int i=0;i<n;i++)
+				bits |= (uint64_t)(p[x + i] != 0) << i;
+			w[x >> 6] = bits;
+		}
+	}
+}
+
+void BitMask::Unpack(Mat & mask) const
+{
+	mask.create(m_rows, m_cols, CV_8UC1);
+
+	for(int y=0;y<m_rows;y++) {
+		const uint64_t *w = Row(y);
+		uchar *p = mask.ptr<uchar>(y);
+		for(int i=0;i<m_wordsPerRow;i++) {
+			uint64_t bits = w[i];
+			int x0 = i << 6;
+			int n = min(64, m_cols - x0);
+			if(bits == 0) {
+				memset(p + x0, 0, n);
+				continue;
+			}
+			for(int b=0;b<n;b++)
+				p[x0 + b] = (bits >> b) & 1 ? 255 : 0;
+		}
+	}
+}
+
+/*
+* Horizontal min / max over a window of the packed row, neighbour pixels come from adjacent words.
+* Pixels outside the row are 'edge' (1 for erode, 0 for dilate) as BORDER_CONSTANT of morphologyEx().
+*/
+
+static inline void ErodeRow3(const uint64_t *src, uint64_t *dst, int n, uint64_t lastWordMask)
+{
+	for(int i=0;i<n;i++) {
+		uint64_t prev = (i > 0) ? src[i - 1] : ~(uint64_t)0;
+		uint64_t cur = (i == n - 1) ? (src[i] | ~lastWordMask) : src[i];
+		uint64_t next = (i < n - 1) ? src[i + 1] : ~(uint64_t)0;
+		if(i == n - 2)
+			next |= ~lastWordMask;
+		uint64_t left = (cur << 1) | (prev >> 63); /* Pixel x - 1 */
+		uint64_t right = (cur >> 1) | (next << 63); /* Pixel x + 1 */
+		dst[i] = cur & left & right;
+	}
+	dst[n - 1] &= lastWordMask;
+}
+
+static inline void DilateRow5(const uint64_t *src, uint64_t *dst, int n, uint64_t lastWordMask)
+{
+	for(int i=0;i<n;i++) {
+		uint64_t prev = (i > 0) ? src[i - 1] : 0;
+		uint64_t cur = src[i];
+		uint64_t next = (i < n - 1) ? src[i + 1] : 0;
+		dst[i] = cur | (cur << 1) | (prev >> 63) | (cur << 2) | (prev >> 62) |
+			(cur >> 1) | (next << 63) | (cur >> 2) | (next << 62);
+	}
+	dst[n - 1] &= lastWordMask;
+}
+
+void BitMask::Open(BitMask & dst) const
+{
+	if(dst.m_rows != m_rows || dst.m_cols != m_cols)
+		dst.Create(m_rows, m_cols);
+
+	if(m_rows == 0 || m_cols == 0)
+		return;
+
+	const int n = m_wordsPerRow;
+	const uint64_t lastWordMask = LastWordMask();
+
+	/* Eroded rows are kept in a ring of 5, row y is dilated once eroded row y + 2 is ready */
+	dst.m_scratch.resize(6 * n);
+	uint64_t *ring = dst.m_scratch.data();
+	uint64_t *v = ring + 5 * n;
+
+	for(int y=0;y<m_rows+2;y++) {
+		if(y < m_rows) { /* Erode 3x3 : vertical and of 3 rows, then horizontal */
+			const uint64_t *r0 = Row(y > 0 ? y - 1 : y);
+			const uint64_t *r1 = Row(y);
+			const uint64_t *r2 = Row(y < m_rows - 1 ? y + 1 : y); /* Rows outside are all 1, same as repeat */
+			for(int i=0;i<n;i++)
+				v[i] = r0[i] & r1[i] & r2[i];
+			ErodeRow3(v, &ring[(y % 5) * n], n, lastWordMask);
+		}
+
+		int yd = y - 2;
+		if(yd < 0)
+			continue;
+
+		/* Dilate 5x5 : vertical or of 5 eroded rows, then horizontal */
+		int y0 = max(0, yd - 2);
+		int y1 = min(m_rows - 1, yd + 2);
+		memcpy(v, &ring[(y0 % 5) * n], n * sizeof(uint64_t));
+		for(int yy=y0+1;yy<=y1;yy++) {
+			const uint64_t *e = &ring[(yy % 5) * n];
+			for(int i=0;i<n;i++)
+				v[i] |= e[i];
+		}
+		DilateRow5(v, dst.Row(yd), n, lastWordMask);
+	}
+}
@@ -0,0 +1,43 @@
+#ifndef BITMASK_H
+#define BITMASK_H
+
+#include "dragon-eye.h"
+
+/*
+* Binary mask packed 1 bit per pixel, bit (x & 63) of word (x >> 6) is pixel x of the row.
+* Bits beyond the width in the last word of each row are always 0.
+*/
+
+class BitMask
+{
+private:
+	int m_rows, m_cols;
+	int m_wordsPerRow;
+	vector< uint64_t > m_bits;
+	vector< uint64_t > m_scratch; /* Eroded rows of Open(), kept by destination mask */
+
+public:
+	BitMask() : m_rows(0), m_cols(0), m_wordsPerRow(0) {}
+
+	void Create(int rows, int cols);
+
+	inline int Rows() const { return m_rows; }
+	inline int Cols() const { return m_cols; }
+	inline int WordsPerRow() const { return m_wordsPerRow; }
+	inline uint64_t *Row(int y) { return &m_bits[(size_t)y * m_wordsPerRow]; }
+	inline const uint64_t *Row(int y) const { return &m_bits[(size_t)y * m_wordsPerRow]; }
+
+	inline uint64_t LastWordMask() const { /* Valid bits of the last word in a row */
+		return (m_cols & 63) ? ((uint64_t)1 << (m_cols & 63)) - 1 : ~(uint64_t)0;
+	}
+
+	void Pack(const Mat & mask); /* CV_8UC1, non zero is foreground */
+	void Unpack(Mat & mask) const; /* CV_8UC1, 0 / 255 */
+
+	/*
+	* Opening : erode 3x3 then dilate 5x5, same result as two morphologyEx() passes with rect elements and default border
+	*/
+	void Open(BitMask & dst) const;
+};
+
+#endif
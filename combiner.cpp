@@ -0,0 +1,123 @@
+#include "combiner.h"
+
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+
+void TriggerCombiner::Reset(int numCamera, TriggerMode_t mode, int preferred)
+{
+	std::unique_lock<std::mutex> mlock(m_mutex);
+
+	m_numCamera = max(1, min(numCamera, NUM_CAMERA));
+	m_mode = mode;
+	m_preferred = (preferred >= 0 && preferred < m_numCamera) ? preferred : 0;
+	m_startTime = steady_clock::now();
+	for(int i=0;i<NUM_CAMERA;i++) {
+		m_lastFrameTime[i] = m_startTime; /* Not stalled before first frame */
+		m_isTriggered[i] = false;
+		memset(&m_stats[i], 0, sizeof(CameraStats));
+	}
+}
+
+bool TriggerCombiner::IsStalled(int camera, steady_clock::time_point now) const
+{
+	return duration_cast<milliseconds>(now - m_lastFrameTime[camera]).count() > CAMERA_STALL_MS;
+}
+
+bool TriggerCombiner::Submit(int camera, bool isTrigger, steady_clock::time_point captureTime)
+{
+	if(camera < 0 || camera >= m_numCamera)
+		return false;
+
+	steady_clock::time_point now(steady_clock::now());
+
+	std::unique_lock<std::mutex> mlock(m_mutex);
+
+	CameraStats & s = m_stats[camera];
+	long long us = duration_cast<microseconds>(now - captureTime).count();
+	s.frames++;
+	s.sumUs += us;
+	s.maxUs = max(s.maxUs, us);
+	m_lastFrameTime[camera] = now;
+
+	if(isTrigger == false)
+		return false;
+
+	s.triggers++;
+	m_lastTriggerTime[camera] = now;
+	m_isTriggered[camera] = true;
+
+	bool isFire = false;
+	switch(m_mode) {
+		case TRIGGER_EITHER:
+			isFire = true;
+			break;
+		case TRIGGER_BOTH:
+			isFire = true;
+			for(int i=0;i<m_numCamera;i++) {
+				if(i == camera)
+					continue;
+				if(m_isTriggered[i] == false ||
+						duration_cast<milliseconds>(now - m_lastTriggerTime[i]).count() > TRIGGER_PAIR_WINDOW_MS)
+					isFire = false;
+			}
+			break;
+		case TRIGGER_PREFERRED:
+			isFire = (camera == m_preferred || IsStalled(m_preferred, now));
+			break;
+	}
+
+	if(isFire)
+		s.fires++;
+
+	return isFire;
+}
+
+CameraStats TriggerCombiner::Stats(int camera)
+{
+	std::unique_lock<std::mutex> mlock(m_mutex);
+
+	return m_stats[max(0, min(camera, NUM_CAMERA - 1))];
+}
+
+void TriggerCombiner::PrintStats()
+{
+	std::unique_lock<std::mutex> mlock(m_mutex);
+
+	printf("Trigger mode %s", ModeName(m_mode));
+	if(m_mode == TRIGGER_PREFERRED)
+		printf(", preferred camera %d", m_preferred);
+	printf("\n");
+	for(int i=0;i<m_numCamera;i++) {
+		const CameraStats & s = m_stats[i];
+		printf("Camera %d : %lu frames, %lu triggers, %lu fired, latency avg %.2lf ms / max %.2lf ms\n", i,
+			(unsigned long)s.frames, (unsigned long)s.triggers, (unsigned long)s.fires,
+			s.frames ? s.sumUs / 1000.0 / s.frames : 0.0, s.maxUs / 1000.0);
+	}
+}
+
+const char *TriggerCombiner::ModeName(TriggerMode_t mode)
+{
+	switch(mode) {
+		case TRIGGER_BOTH:
+			return "both";
+		case TRIGGER_PREFERRED:
+			return "preferred";
+		default:
+			return "either";
+	}
+}
+
+bool TriggerCombiner::ParseMode(const string & s, TriggerMode_t & mode)
+{
+	if(s == "either")
+		mode = TRIGGER_EITHER;
+	else if(s == "both")
+		mode = TRIGGER_BOTH;
+	else if(s == "preferred")
+		mode = TRIGGER_PREFERRED;
+	else
+		return false;
+	return true;
+}
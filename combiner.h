@@ -0,0 +1,58 @@
+#ifndef COMBINER_H
+#define COMBINER_H
+
+#include "dragon-eye.h"
+
+#include <mutex>
+#include <chrono>
+
+/*
+* Trigger decision of cameras processed at once, each camera submits every frame from its own tracking thread.
+* EITHER fires on a trigger of any camera.
+* BOTH fires when the other camera triggered within TRIGGER_PAIR_WINDOW_MS, one crossing seen by both.
+* PREFERRED fires on the preferred camera only, the others take over while it has no frames for CAMERA_STALL_MS.
+*/
+
+typedef enum { TRIGGER_EITHER, TRIGGER_BOTH, TRIGGER_PREFERRED } TriggerMode_t;
+
+typedef struct {
+	uint64_t frames;
+	uint64_t triggers; /* Raw triggers of camera */
+	uint64_t fires; /* Combined decisions fired by camera */
+	long long sumUs, maxUs; /* Capture to trigger decision */
+} CameraStats;
+
+class TriggerCombiner
+{
+private:
+	TriggerMode_t m_mode;
+	int m_numCamera;
+	int m_preferred;
+	std::chrono::steady_clock::time_point m_startTime;
+	std::chrono::steady_clock::time_point m_lastFrameTime[NUM_CAMERA];
+	std::chrono::steady_clock::time_point m_lastTriggerTime[NUM_CAMERA];
+	bool m_isTriggered[NUM_CAMERA]; /* Triggered since reset */
+	CameraStats m_stats[NUM_CAMERA];
+	std::mutex m_mutex;
+
+	bool IsStalled(int camera, std::chrono::steady_clock::time_point now) const; /* Locked */
+
+public:
+	TriggerCombiner() : m_mode(TRIGGER_EITHER), m_numCamera(1), m_preferred(0) { Reset(1, TRIGGER_EITHER, 0); }
+
+	void Reset(int numCamera, TriggerMode_t mode, int preferred);
+
+	/* Raw trigger of a frame, returns true if the combined decision fires */
+	bool Submit(int camera, bool isTrigger, std::chrono::steady_clock::time_point captureTime);
+
+	CameraStats Stats(int camera);
+	void PrintStats();
+
+	inline TriggerMode_t Mode() const { return m_mode; }
+	inline int NumCamera() const { return m_numCamera; }
+
+	static const char *ModeName(TriggerMode_t mode);
+	static bool ParseMode(const string & s, TriggerMode_t & mode); /* either / both / preferred */
+};
+
+#endif
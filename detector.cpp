@@ -0,0 +1,462 @@
+#include "detector.h"
+
+#include <chrono>
+
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+
+Detector::Detector() : m_minTargetSize(MIN_TARGET_WIDTH, MIN_TARGET_HEIGHT), m_maxTargetSize(MAX_TARGET_WIDTH, MAX_TARGET_HEIGHT),
+	m_horizonHeight(CAMERA_HEIGHT * HORIZON_RATIO), m_isAutoProcessRegion(false), m_isShrinkRegion(false),
+	m_isHalfResolutionBand(false), m_isSideBandsReady(false), m_pyramidScale(1), m_minCoarseArea(1), m_isCoarseReady(false),
+	m_mog2Threshold(16)
+{
+	memset(&m_timing, 0, sizeof(m_timing));
+}
+
+void Detector::Initialisize(int width, int height)
+{
+	if(min(width, height) >= 1080) { /* 1080p */
+		m_minTargetSize = Size(9, 12);
+		m_maxTargetSize = Size(480, 480);
+	} else { /* 720p */
+		m_minTargetSize = Size(6, 8);
+		m_maxTargetSize = Size(320, 320);
+	}
+	m_horizonHeight = height * HORIZON_RATIO;
+}
+
+void Detector::Pyramid(int scale, int minCoarseArea)
+{
+	m_pyramidScale = (scale == 2 || scale == 4) ? scale : 1;
+	if(minCoarseArea > 0)
+		m_minCoarseArea = minCoarseArea;
+	else /* Minimum target covers width * height / scale^2 coarse pixels, downscaling blurs it over some of them only */
+		m_minCoarseArea = max(1, m_minTargetSize.area() / (m_pyramidScale * m_pyramidScale) / 2);
+	m_isCoarseReady = false;
+}
+
+void Detector::CreateBackgroundModel(uint8_t mog2Threshold, BackendType_t backend)
+{
+	m_backend = createComputeBackend(backend);
+	m_mog2Threshold = mog2Threshold;
+
+	/* background history count, varThreshold */
+	m_backend->CreateBackgroundModel(30, mog2Threshold);
+
+	for(int i=0;i<2;i++)
+		m_sideBands[i].backend = createComputeBackend(m_backend->Type());
+	m_isSideBandsReady = false;
+	m_coarse.backend = createComputeBackend(m_backend->Type());
+	m_isCoarseReady = false;
+}
+
+static inline void MergeBlob(Blob & b, const Blob & a)
+{
+	b.centroid = (b.centroid * (float)b.area + a.centroid * (float)a.area) * (1.f / (b.area + a.area));
+	b.rect = MergeRect(b.rect, a.rect);
+	b.area += a.area;
+	b.minVal = min(b.minVal, a.minVal);
+	b.maxVal = max(b.maxVal, a.maxVal);
+}
+
+#define MERGE_GRID_SIZE MERGE_DISTANCE
+
+static inline int FindRoot(vector<int> & parent, int i)
+{
+	while(parent[i] != i) {
+		parent[i] = parent[parent[i]]; /* Path halving */
+		i = parent[i];
+	}
+	return i;
+}
+
+/*
+* Small blobs below horizon merge with small blobs they overlap or whose center is closer than MERGE_DISTANCE.
+* Pairs are found through a grid of MERGE_GRID_SIZE cells and joined by union-find, so the result is independent of blob order.
+*/
+
+void Detector::MergeSmallBlobs(Size frameSize, int horizonHeight, const vector<Blob> & blobs, vector<Blob> & merged)
+{
+	merged.clear();
+
+	int gridCols = (frameSize.width + MERGE_GRID_SIZE - 1) / MERGE_GRID_SIZE;
+	int gridRows = (frameSize.height + MERGE_GRID_SIZE - 1) / MERGE_GRID_SIZE;
+	if(m_gridHead.size() != (size_t)(gridCols * gridRows))
+		m_gridHead.assign(gridCols * gridRows, -1);
+
+	const int n = blobs.size();
+	m_mergeParent.resize(n);
+	m_gridNext.clear();
+	m_gridItem.clear();
+	m_gridTouched.clear();
+
+	Rect gridRect(0, 0, gridCols, gridRows);
+
+	for(int i=0;i<n;i++) {
+		m_mergeParent[i] = i;
+		const Rect & r = blobs[i].rect;
+		if(r.area() >= MERGE_AREA)
+			continue;
+		/* Register in every cell the rect covers */
+		Rect c = Rect(r.x / MERGE_GRID_SIZE, r.y / MERGE_GRID_SIZE,
+			(r.x + r.width - 1) / MERGE_GRID_SIZE - r.x / MERGE_GRID_SIZE + 1,
+			(r.y + r.height - 1) / MERGE_GRID_SIZE - r.y / MERGE_GRID_SIZE + 1) & gridRect;
+		for(int gy=c.y;gy<c.y+c.height;gy++) {
+			for(int gx=c.x;gx<c.x+c.width;gx++) {
+				int cell = gy * gridCols + gx;
+				if(m_gridHead[cell] < 0)
+					m_gridTouched.push_back(cell);
+				m_gridNext.push_back(m_gridHead[cell]);
+				m_gridItem.push_back(i);
+				m_gridHead[cell] = m_gridItem.size() - 1;
+			}
+		}
+	}
+
+	for(int i=0;i<n;i++) {
+		const Rect & r = blobs[i].rect;
+		if(r.area() >= MERGE_AREA)
+			continue;
+		Point ct = Center(r);
+		bool isBelow = r.br().y > horizonHeight;
+		/* A rect closer than MERGE_DISTANCE by center overlaps the rect expanded by MERGE_DISTANCE */
+		int x0 = max(0, r.x - MERGE_DISTANCE) / MERGE_GRID_SIZE;
+		int y0 = max(0, r.y - MERGE_DISTANCE) / MERGE_GRID_SIZE;
+		int x1 = min(gridCols - 1, (r.x + r.width + MERGE_DISTANCE) / MERGE_GRID_SIZE);
+		int y1 = min(gridRows - 1, (r.y + r.height + MERGE_DISTANCE) / MERGE_GRID_SIZE);
+		for(int gy=y0;gy<=y1;gy++) {
+			for(int gx=x0;gx<=x1;gx++) {
+				for(int e=m_gridHead[gy * gridCols + gx];e>=0;e=m_gridNext[e]) {
+					int j = m_gridItem[e];
+					if(j >= i)
+						continue; /* Each pair once */
+					const Rect & o = blobs[j].rect;
+					if(isBelow == false && o.br().y <= horizonHeight)
+						continue; /* Merging starts from rect below horizon */
+					if((r & o).area() > 0 || /* Merge overlaped rect */
+						cv::norm(ct - Center(o)) < MERGE_DISTANCE) { /* Merge closely enough rect */
+						int a = FindRoot(m_mergeParent, i);
+						int b = FindRoot(m_mergeParent, j);
+						if(a < b)
+							m_mergeParent[b] = a;
+						else if(b < a)
+							m_mergeParent[a] = b;
+					}
+				}
+			}
+		}
+	}
+
+	for(auto cell : m_gridTouched)
+		m_gridHead[cell] = -1;
+
+	/* Root is the first blob of each group */
+	m_mergeIndex.resize(n);
+	for(int i=0;i<n;i++) {
+		int root = FindRoot(m_mergeParent, i);
+		if(root == i) {
+			m_mergeIndex[i] = merged.size();
+			merged.push_back(blobs[i]);
+		} else
+			MergeBlob(merged[m_mergeIndex[root]], blobs[i]);
+	}
+}
+
+void Detector::ProcessBand(ComputeBackend & backend, const Mat & frame, Mat & foregroundFrame, BitMask & openedMask, const Point & offset, int scale)
+{
+	steady_clock::time_point t0(steady_clock::now());
+
+	backend.BackgroundSubtract(frame, foregroundFrame, 0.05);
+
+	steady_clock::time_point t1(steady_clock::now());
+
+	/* Erode 3x3 then dilate 5x5 on 1 bit per pixel mask */
+	backend.Open(foregroundFrame, openedMask);
+
+	steady_clock::time_point t2(steady_clock::now());
+
+	m_labeler.Label(openedMask, frame, m_bandBlobs);
+	for(auto & b : m_bandBlobs) {
+		if(scale > 1) {
+			b.rect = Rect(b.rect.x * scale, b.rect.y * scale, b.rect.width * scale, b.rect.height * scale);
+			b.area *= scale * scale;
+			b.centroid = b.centroid * (float)scale + Point2f((scale - 1) * 0.5f, (scale - 1) * 0.5f);
+		}
+		b.rect += offset;
+		b.centroid += Point2f(offset.x, offset.y);
+		m_blobs.push_back(b);
+	}
+
+	steady_clock::time_point t3(steady_clock::now());
+
+	m_timing.bgsub_us += duration_cast<microseconds>(t1 - t0).count();
+	m_timing.morph_us += duration_cast<microseconds>(t2 - t1).count();
+	m_timing.label_us += duration_cast<microseconds>(t3 - t2).count();
+}
+
+/* Blobs cut by seam of bands are merged back, both sides touch the seam and overlap vertically (8 connectivity) */
+void Detector::MergeAtSeam(int seam)
+{
+	m_seamLeft.clear();
+	m_seamRight.clear();
+	for(int i=0;i<(int)m_blobs.size();i++) {
+		const Rect & r = m_blobs[i].rect;
+		if(r.x < seam && r.br().x >= seam - 1) /* Half resolution band may leave its last column */
+			m_seamLeft.push_back(i);
+		else if(r.x >= seam && r.x <= seam + 1)
+			m_seamRight.push_back(i);
+	}
+
+	if(m_seamLeft.empty() || m_seamRight.empty())
+		return;
+
+	for(auto l : m_seamLeft) {
+		for(auto & r : m_seamRight) {
+			if(r < 0)
+				continue;
+			const Rect & lr = m_blobs[l].rect;
+			const Rect & rr = m_blobs[r].rect;
+			if(rr.y > lr.br().y || lr.y > rr.br().y)
+				continue;
+			MergeBlob(m_blobs[l], m_blobs[r]);
+			m_blobs[r].area = 0; /* Merged */
+			r = -1;
+		}
+	}
+
+	m_blobs.erase(remove_if(m_blobs.begin(), m_blobs.end(), [](const Blob & b) { return b.area == 0; }), m_blobs.end());
+}
+
+/*
+* Background subtraction and labeling on downscaled region. No opening, erode would wipe out targets of a few coarse pixels,
+* noise is averaged out by downscaling and speckles are cut by minimum coarse area.
+* Windows around coarse blobs are revisited at full resolution : difference against upscaled coarse background inside dilated coarse foreground,
+* then opening and labeling as usual give exact rects and intensity min / max of full resolution pixels.
+*/
+void Detector::ProcessPyramid(const Mat & regionFrame)
+{
+	const int s = m_pyramidScale;
+	DetectorBand & c = m_coarse;
+	Size coarseSize(regionFrame.cols / s, regionFrame.rows / s);
+	if(coarseSize.width < 3 || coarseSize.height < 3)
+		return;
+
+	steady_clock::time_point t0(steady_clock::now());
+
+	if(m_isCoarseReady == false) {
+		c.backend->CreateBackgroundModel(30, m_mog2Threshold);
+		m_isCoarseReady = true;
+	}
+	resize(regionFrame, c.frame, coarseSize, 0, 0, INTER_AREA);
+	c.backend->BackgroundSubtract(c.frame, c.foregroundFrame, 0.05);
+	c.backend->BackgroundImage(m_coarseBackground);
+
+	steady_clock::time_point t1(steady_clock::now());
+
+	c.openedMask.Pack(c.foregroundFrame);
+	m_labeler.Label(c.openedMask, c.frame, m_bandBlobs);
+
+	Rect coarseRect(Point(0, 0), coarseSize);
+	m_windows.clear();
+	for(auto & b : m_bandBlobs) {
+		if(b.area < m_minCoarseArea)
+			continue;
+		m_windows.push_back(Rect(b.rect.x - PYRAMID_WINDOW_MARGIN, b.rect.y - PYRAMID_WINDOW_MARGIN,
+			b.rect.width + PYRAMID_WINDOW_MARGIN * 2, b.rect.height + PYRAMID_WINDOW_MARGIN * 2) & coarseRect);
+	}
+
+	/* Overlapped windows are joined, full resolution pixels are processed once */
+	for(size_t i=0;i<m_windows.size();i++) {
+		for(size_t j=i+1;j<m_windows.size();) {
+			if((m_windows[i] & m_windows[j]).area() > 0) {
+				m_windows[i] = MergeRect(m_windows[i], m_windows[j]);
+				m_windows.erase(m_windows.begin() + j);
+				j = i + 1; /* Grown window may overlap those checked */
+			} else
+				j++;
+		}
+	}
+
+	steady_clock::time_point t2(steady_clock::now());
+
+	m_timing.bgsub_us += duration_cast<microseconds>(t1 - t0).count();
+	m_timing.label_us += duration_cast<microseconds>(t2 - t1).count();
+
+	const double fineThreshold = sqrt((double)m_mog2Threshold * PYRAMID_FINE_VARIANCE); /* Same squared Mahalanobis distance of MOG2 */
+
+	for(auto & wc : m_windows) {
+		steady_clock::time_point t3(steady_clock::now());
+
+		Rect w(wc.x * s, wc.y * s, wc.width * s, wc.height * s);
+		Mat gray = regionFrame(w);
+		resize(m_coarseBackground(wc), m_fineBackground, w.size(), 0, 0, INTER_LINEAR);
+		absdiff(gray, m_fineBackground, m_fineForeground);
+		threshold(m_fineForeground, m_fineForeground, fineThreshold, 255, THRESH_BINARY);
+		dilate(c.foregroundFrame(wc), m_coarseWindowMask, Mat()); /* 3x3, edges of coarse blob */
+		resize(m_coarseWindowMask, m_fineCoarseMask, w.size(), 0, 0, INTER_NEAREST);
+		bitwise_and(m_fineForeground, m_fineCoarseMask, m_fineForeground);
+
+		steady_clock::time_point t4(steady_clock::now());
+
+		m_backend->Open(m_fineForeground, m_fineOpenedMask);
+
+		steady_clock::time_point t5(steady_clock::now());
+
+		m_labeler.Label(m_fineOpenedMask, gray, m_bandBlobs);
+		for(auto & b : m_bandBlobs) {
+			b.rect += w.tl();
+			b.centroid += Point2f(w.x, w.y);
+			m_blobs.push_back(b);
+		}
+
+		steady_clock::time_point t6(steady_clock::now());
+
+		m_timing.bgsub_us += duration_cast<microseconds>(t4 - t3).count();
+		m_timing.morph_us += duration_cast<microseconds>(t5 - t4).count();
+		m_timing.label_us += duration_cast<microseconds>(t6 - t5).count();
+	}
+}
+
+bool Detector::FoldInnerBlobs(vector<Blob> & blobs, vector<Blob> & outerBlobs)
+{
+	sort(blobs.begin(), blobs.end(), [](const Blob & b1, const Blob & b2) {
+			return (b1.rect.area() > b2.rect.area());
+		});
+
+	/*
+	* Bounding box test only : besides blobs in a hole (dropped by external contours as well), a blob in the open
+	* side of a larger blob (e.g. inside a C shape) is folded too. Its rect adds nothing to the larger one.
+	*/
+	outerBlobs.clear();
+	for(auto & b : blobs) {
+		auto it = outerBlobs.begin();
+		for(;it!=outerBlobs.end();++it) {
+			if((b.rect & it->rect) == b.rect)
+				break;
+		}
+		if(it != outerBlobs.end()) {
+			MergeBlob(*it, b);
+			continue;
+		}
+#if 1 /* Anti exposure burst */
+		if(outerBlobs.size() >= MAX_NUM_OBJECT)
+			return false;
+#endif
+		outerBlobs.push_back(b);
+	}
+	return true;
+}
+
+void Detector::LabelMovingObject(Size regionSize, const Point & offset, list<Rect> & roiRect)
+{
+	uint32_t num_target = 0;
+
+	vector<Blob> & outerBlobs = m_outerBlobs;
+	if(FoldInnerBlobs(m_blobs, outerBlobs) == false)
+		return;
+
+	vector<Blob> & boundBlob = m_boundBlobs;
+	MergeSmallBlobs(regionSize, m_horizonHeight - offset.y, outerBlobs, boundBlob);
+
+	sort(boundBlob.begin(), boundBlob.end(), [](const Blob & b1, const Blob & b2) {
+			return (b1.rect.area() > b2.rect.area()); /* Area */
+		}); /* Rects sort by area, boundBlob[0] is largest */
+
+	for(size_t i=0; i<boundBlob.size(); i++) {
+		const Rect & r = boundBlob[i].rect;
+		if(r.width > m_maxTargetSize.width &&
+			r.height > m_maxTargetSize.height)
+			continue; /* Extremely large object */
+
+		if(r.width < m_minTargetSize.width &&
+			r.height < m_minTargetSize.height)
+			break; /* Rest are small objects, ignore them */
+#if 1 /* Anti cloud ... */
+			/* If difference of max and min value of blob pixels is too small then it could be noise such as cloud or sea */
+		if((boundBlob[i].maxVal - boundBlob[i].minVal) < 16)
+			continue; /* Too small, drop it. */
+#endif
+#if 1
+		if(r.width > r.height && (r.width >> 4) > r.height)
+			continue; /* Ignore thin object */
+#endif
+		roiRect.push_back(r + offset); /* Frame coordinate */
+		if(++num_target >= MAX_NUM_TARGET)
+			break;
+	}
+}
+
+Rect Detector::ProcessRect(Size frameSize) const
+{
+	Rect frameRect(Point(0, 0), frameSize);
+	Rect r = frameRect;
+	int bottom = m_horizonHeight + frameSize.height * PROCESS_REGION_MARGIN_RATIO;
+	if(m_isAutoProcessRegion)
+		r = Rect(0, 0, frameSize.width, min(bottom, frameSize.height)) & frameRect;
+	else if(m_processRegion.empty() == false)
+		r = m_processRegion & frameRect;
+
+	if(m_isShrinkRegion) { /* Rows above horizon and center of width, targets are tracked there before crossing center line */
+		int w = frameSize.width * LOAD_SHRINK_WIDTH_RATIO;
+		r &= Rect((frameSize.width - w) / 2, 0, w, bottom);
+	}
+	return r;
+}
+
+void Detector::ExtractMovingObject(Mat & frame, list<Rect> & roiRect)
+{
+	memset(&m_timing, 0, sizeof(m_timing));
+
+	Rect pr = ProcessRect(frame.size());
+	if(pr.empty())
+		return;
+	Mat regionFrame = frame(pr); /* No copy, same as frame if region is whole frame */
+	Rect regionRect(Point(0, 0), pr.size());
+
+	m_blobs.clear();
+
+	if(m_pyramidScale > 1) {
+		ProcessPyramid(regionFrame);
+		m_isSideBandsReady = false;
+	} else if(m_isHalfResolutionBand) {
+		/* Band around center line at full resolution, the rest of region at half */
+		int bw = frame.cols * LOAD_CENTER_BAND_RATIO;
+		Rect center = Rect(frame.cols / 2 - bw / 2 - pr.x, 0, bw, pr.height) & regionRect;
+		Rect sides[2];
+		if(center.empty())
+			sides[0] = regionRect;
+		else {
+			sides[0] = Rect(0, 0, center.x, pr.height);
+			sides[1] = Rect(center.br().x, 0, pr.width - center.br().x, pr.height);
+			ProcessBand(*m_backend, regionFrame(center), m_foregroundFrame, m_openedMask, center.tl(), 1);
+		}
+
+		for(int i=0;i<2;i++) {
+			DetectorBand & b = m_sideBands[i];
+			if(m_isSideBandsReady == false) /* Background of last half resolution run is out of date */
+				b.backend->CreateBackgroundModel(30, m_mog2Threshold);
+			if(sides[i].width < 2 || sides[i].height < 2)
+				continue;
+			resize(regionFrame(sides[i]), b.frame, Size(sides[i].width / 2, sides[i].height / 2), 0, 0, INTER_AREA);
+			ProcessBand(*b.backend, b.frame, b.foregroundFrame, b.openedMask, sides[i].tl(), 2);
+		}
+		m_isSideBandsReady = true;
+		m_isCoarseReady = false;
+
+		if(center.empty() == false) {
+			MergeAtSeam(center.x);
+			MergeAtSeam(center.br().x);
+		}
+	} else {
+		ProcessBand(*m_backend, regionFrame, m_foregroundFrame, m_openedMask, Point(0, 0), 1);
+		m_isSideBandsReady = false;
+		m_isCoarseReady = false;
+	}
+
+	steady_clock::time_point t0(steady_clock::now());
+
+	LabelMovingObject(pr.size(), pr.tl(), roiRect);
+
+	m_timing.label_us += duration_cast<microseconds>(steady_clock::now() - t0).count();
+}
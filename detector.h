@@ -0,0 +1,108 @@
+#ifndef DETECTOR_H
+#define DETECTOR_H
+
+#include "dragon-eye.h"
+#include "bitmask.h"
+#include "labeler.h"
+#include "backend.h"
+
+/*
+* Moving object detection : background subtraction (MOG2) -> bit packed opening (erode / dilate) -> blob labeling -> ROI rects
+* Kernels run on the compute backend, CUDA if there is one, otherwise CPU (BackgroundSubtractorMOG2Simd)
+* The whole chain works on the processing region only, pixels outside are never touched
+* Coarse to fine pyramid : the chain runs on a downscaled region, full resolution is revisited only in windows around coarse blobs
+*/
+
+#define MERGE_AREA 400 /* Less than 20x20 */
+#define MERGE_DISTANCE 36
+
+/* Side band of processing region at half resolution (load shedding) or coarse level of pyramid */
+typedef struct {
+	Ptr<ComputeBackend> backend; /* Own background model */
+	Mat frame; /* Downscaled band */
+	Mat foregroundFrame;
+	BitMask openedMask;
+} DetectorBand;
+
+typedef struct {
+	long bgsub_us;    /* Background subtraction including upload / download */
+	long morph_us;    /* Pack, erode / dilate */
+	long label_us;    /* Blob labeling, rects merging and filtering */
+} DetectorTiming;
+
+class Detector
+{
+private:
+	Ptr<ComputeBackend> m_backend;
+	Mat m_foregroundFrame; /* Reused, allocated on first frame */
+	BitMask m_openedMask;
+	DetectorBand m_sideBands[2]; /* Left / right of center band */
+	DetectorBand m_coarse; /* Coarse level of pyramid */
+	Mat m_coarseBackground, m_coarseWindowMask, m_fineCoarseMask, m_fineBackground, m_fineForeground;
+	BitMask m_fineOpenedMask;
+	vector<Rect> m_windows; /* Coarse coordinate */
+	BlobLabeler m_labeler;
+	vector<Blob> m_bandBlobs, m_blobs, m_outerBlobs, m_boundBlobs;
+	vector<int> m_gridHead, m_gridNext, m_gridItem, m_gridTouched; /* Grid buckets of small blobs */
+	vector<int> m_mergeParent, m_mergeIndex;
+	vector<int> m_seamLeft, m_seamRight; /* Blobs touching seam of bands */
+	Size m_minTargetSize, m_maxTargetSize;
+	int m_horizonHeight;
+	Rect m_processRegion;
+	bool m_isAutoProcessRegion;
+	bool m_isShrinkRegion;
+	bool m_isHalfResolutionBand, m_isSideBandsReady;
+	int m_pyramidScale; /* 1 is off */
+	int m_minCoarseArea; /* Coarse blobs smaller than this are not revisited */
+	bool m_isCoarseReady;
+	uint8_t m_mog2Threshold;
+	DetectorTiming m_timing;
+
+	/* Background subtraction, opening and labeling of a band, blobs are appended to m_blobs in processing region coordinate */
+	void ProcessBand(ComputeBackend & backend, const Mat & frame, Mat & foregroundFrame, BitMask & openedMask, const Point & offset, int scale);
+	void MergeAtSeam(int seam);
+	void ProcessPyramid(const Mat & regionFrame);
+	void LabelMovingObject(Size regionSize, const Point & offset, list<Rect> & roiRect);
+
+public:
+	Detector();
+
+	void Initialisize(int width, int height);
+	void CreateBackgroundModel(uint8_t mog2Threshold, BackendType_t backend = BACKEND_AUTO);
+	inline ComputeBackend & Backend() { return *m_backend; } /* Valid after CreateBackgroundModel() */
+
+	void HorizonHeight(int horizonHeight) { m_horizonHeight = horizonHeight; }
+
+	/* Empty rect is whole frame */
+	void ProcessRegion(const Rect & r) { m_processRegion = r; m_isAutoProcessRegion = false; }
+	/* Rows above horizon plus PROCESS_REGION_MARGIN_RATIO of frame height, full width */
+	void AutoProcessRegion() { m_processRegion = Rect(); m_isAutoProcessRegion = true; }
+	Rect ProcessRect(Size frameSize) const; /* Processing region clipped to frame */
+
+	/* Load shedding, set between frames */
+	void ShrinkRegion(bool isShrink) { m_isShrinkRegion = isShrink; }
+	void HalfResolutionBand(bool isHalf) { m_isHalfResolutionBand = isHalf; }
+
+	/*
+	* Coarse to fine detection at 1 / scale (2 or 4, 1 is off). Coarse blobs of minCoarseArea pixels or more are revisited at full resolution,
+	* 0 is half of the minimum target in coarse pixels. Half resolution band of load shedding does not apply.
+	*/
+	void Pyramid(int scale, int minCoarseArea = 0);
+	inline int PyramidScale() const { return m_pyramidScale; }
+	inline int MinCoarseArea() const { return m_minCoarseArea; }
+
+	void ExtractMovingObject(Mat & frame, list<Rect> & roiRect);
+
+	/*
+	* Blobs (sorted by area here) with bounding box inside bounding box of a larger blob are folded into it, stats merged.
+	* False on exposure burst, more than MAX_NUM_OBJECT blobs left.
+	*/
+	bool FoldInnerBlobs(vector<Blob> & blobs, vector<Blob> & outerBlobs);
+
+	/* Small blobs (< MERGE_AREA) overlapping or closer than MERGE_DISTANCE are merged, groups in order of their first blob */
+	void MergeSmallBlobs(Size frameSize, int horizonHeight, const vector<Blob> & blobs, vector<Blob> & merged);
+
+	inline const DetectorTiming & Timing() const { return m_timing; }
+};
+
+#endif
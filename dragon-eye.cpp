@@ -2,11 +2,13 @@
 #include <opencv2/opencv.hpp>
 #include <opencv2/videoio.hpp>
 
+#ifdef HAVE_CUDA_BACKEND
 #include <opencv2/cudacodec.hpp>
 #include <opencv2/cudabgsegm.hpp>
 #include <opencv2/cudaobjdetect.hpp>
 #include <opencv2/cudafilters.hpp>
 #include <opencv2/cudaimgproc.hpp>
+#endif
 
 #include <errno.h>
 #include <fcntl.h> 
@@ -31,6 +33,17 @@
 
 #include <curl/curl.h>
 
+#include "dragon-eye.h"
+#include "tracker.h"
+#include "detector.h"
+#include "spscring.h"
+#include "framepool.h"
+#include "framering.h"
+#include "governor.h"
+#include "combiner.h"
+#include "videoencoder.h"
+#include "eventrecorder.h"
+
 using namespace cv;
 using namespace std;
 
@@ -57,6 +70,7 @@ extern "C" {
 
 #include "glib-2.0/glib.h"
 #include <gstreamer-1.0/gst/app/app.h>
+#include <gstreamer-1.0/gst/video/video.h>
 }
 
 //using std::chrono::system_clock;
@@ -66,58 +80,29 @@ using std::chrono::microseconds;
 using std::chrono::milliseconds;
 using std::chrono::seconds;
 
-#ifndef DEBUG
-//#define DEBUG
-#endif
-
-#ifdef DEBUG
-#define dprintf(...) do{ fprintf( stderr, __VA_ARGS__ ); } while( false )
-#else
-#define dprintf(...) do{ } while ( false )
-#endif
-
 #define VERSION "v0.1.9"
 
-//#define CAMERA_1080P
-
-#ifdef CAMERA_1080P
-	#define CAMERA_WIDTH 1080
-	#define CAMERA_HEIGHT 1920
-	#define CAMERA_FPS 30
-	#define MIN_TARGET_WIDTH 9
-	#define MIN_TARGET_HEIGHT 12
-	#define MAX_TARGET_WIDTH 480
-	#define MAX_TARGET_HEIGHT 480
-#else
-	#define CAMERA_WIDTH 720
-	#define CAMERA_HEIGHT 1280
-	#define CAMERA_FPS 30
-	#define MIN_TARGET_WIDTH 6
-	#define MIN_TARGET_HEIGHT 8
-	#define MAX_TARGET_WIDTH 320
-	#define MAX_TARGET_HEIGHT 320
-#endif
-
-#define MAX_TARGET_TRACKING_DISTANCE    360
-
-#define MAX_NUM_TARGET               	9      /* Maximum targets to tracing */
-#define MAX_NUM_TRIGGER              	6      /* Maximum number of RF trigger after detection of cross line */
-#define MAX_NUM_FRAME_MISSING_TARGET 	3      /* Maximum number of frames to keep tracing lost target */
-
-#define MIN_COURSE_LENGTH            	16     /* Minimum course length of RF trigger after detection of cross line */
-#define MIN_TARGET_TRACKED_COUNT     	3      /* Minimum target tracked count of RF trigger after detection of cross line */
-
 #define VIDEO_OUTPUT_FPS             	30
 #define VIDEO_OUTPUT_DIR             	"/opt/Videos"
 #define VIDEO_OUTPUT_FILE_NAME       	"base"
-#define VIDEO_FILE_OUTPUT_DURATION   	90     /* Video file duration 90 secends */
+#define VIDEO_CLIP_FILE_NAME         	"clip"
+#define VIDEO_FILE_OUTPUT_DURATION   	90     /* Video file duration 90 secends, default of video.output.file.duration */
 #define VIDEO_OUTPUT_MAX_FILES       	400    /* Needs about 30G bytes disk space */
-//#define VIDEO_OMXH265ENC
+#ifdef VIDEO_OMXH265ENC
+#define VIDEO_OUTPUT_FILE_EXT        	"mkv"
+#else
+#define VIDEO_OUTPUT_FILE_EXT        	"mp4"
+#endif
 
 #define STR_SIZE                     	1024
 #define CONFIG_FILE_DIR              	"/etc/dragon-eye"
 
-#define HORIZON_RATIO                	8 / 10
+#define CAPTURE_BUFFERS              	2      /* Default samples queued in appsink */
+#define MAX_CAPTURE_BUFFERS          	16
+#define CAPTURE_TIMEOUT_MS           	200    /* Wait of a camera frame */
+/* Result frames in flight to video outputs : broadcast ring, raw frames in encoder, the one encoding,
+   lastOutFrame and the one tracking fills. A lagging encoder never grows the pool */
+#define OUTPUT_FRAME_POOL_SIZE       	(FRAME_RING_SIZE + VIDEO_ENCODER_QUEUE_FRAMES + 3)
 
 typedef enum { JETSON_NANO, JETSON_XAVIER_NX } JetsonDevice_t;
 
@@ -247,1294 +232,392 @@ static int add_route(const char *_target, const char *_netmask, const char *_dev
 *
 */
 
-// Get current date/time, format is YYYY-MM-DD.HH:mm:ss
-const std::string currentDateTime() {
-	time_t now = time(0);
-	struct tm tstruct;
-	char buf[80];
-	tstruct = *localtime(&now);
-	strftime(buf, sizeof(buf), "%H:%M:%S %m/%d", &tstruct);
-	return buf;
-}
+static Tracker tracker;
+static Detector detector;
+static Tracker tracker1; /* Second camera */
+static Detector detector1;
+static AllocationCounter allocationCounter;
+static LoadGovernor governor;
 
 /*
 *
 */
 
-static void writeText(Mat & mat, const string & text, Point textOrg)
-{
-   //int fontFace = FONT_HERSHEY_SIMPLEX; 
-   int fontFace = FONT_HERSHEY_DUPLEX;
-   double fontScale = 1;
-   int thickness = 2;  
-   putText(mat, text, textOrg, fontFace, fontScale, Scalar(0, 0, 0), thickness, cv::LINE_8);
-}
+static FrameRing videoFrameRing; /* Result frames to all video outputs and RTSP */
 
 /*
 *
 */
 
-static inline Point Center(Rect & r) {
-	return Point(r.tl().x + (r.width / 2), r.tl().y + (r.height / 2));
-}
-
-class Target
-{
-protected:
-	uint32_t m_id;
-	double m_arcLength;
-	double m_absLength;
-	unsigned long m_lastFrameTick;
-	uint8_t m_triggerCount;
-	uint16_t m_bugTriggerCount;
-
-	vector< unsigned long > m_frameTicks;
-	vector< Rect > m_rects;
-	vector< Point > m_vectors;
-	double m_maxVector, m_minVector;
-	Point m_velocity;
-	Point m_acceleration;
-	int m_averageArea;
-	double m_normVelocity;
-	double m_angleOfTurn;
-
-	static uint32_t s_id;
-
-	double CosineAngle(const Point & v1, const Point & v2) {
-		/* A.B = |A||B|cos() */
-		/* cos() = A.B / |A||B| */
-		return v1.dot(v2) / (norm(v1) * norm(v2));
-	}
-
-	double CosineAngle(const Point & p1, const Point & p2, const Point & p3) {
-		Point v1, v2;
-		v1.x = p1.x - p2.x;
-		v1.y = p1.y - p2.y;
-		v2.x = p2.x - p3.x;
-		v2.y = p2.y - p3.y;
-
-		/* A.B = |A||B|cos() */
-		/* cos() = A.B / |A||B| */
-		return v1.dot(v2) / (norm(v1) * norm(v2));
-	}
-
-public:
-	Target(Rect & roi, unsigned long frameTick) : m_arcLength(0), m_lastFrameTick(frameTick), m_triggerCount(0), m_bugTriggerCount(0), 
-			m_maxVector(0), m_minVector(0), m_averageArea(0), m_normVelocity(0), m_angleOfTurn(0) {
-		m_id = s_id++;
-		m_rects.push_back(roi);
-		m_lastFrameTick = frameTick;
-		m_frameTicks.push_back(frameTick);
-		m_averageArea = roi.area();
-	}
-
-	void Reset() {
-		Rect r = m_rects.back();
-		m_rects.clear();
-		m_rects.push_back(r);
-		m_frameTicks.clear();
-		m_frameTicks.push_back(m_lastFrameTick);
-		m_triggerCount = 0;
-		m_bugTriggerCount = 0;
-		m_maxVector = 0;
-		m_minVector = 0;
-		m_averageArea = 0;
-		m_normVelocity = 0;
-		m_angleOfTurn = 0;
-		//m_arcLength = 0; /* TODO : Do clear this ? */
-	}
-
-	void Update(Rect & roi, unsigned long frameTick) {
-		if(frameTick <= m_lastFrameTick) /* Reverse tick ??? Illegal !!! */
-			return;
-
-		int itick = frameTick - m_lastFrameTick;
-
-		if(m_rects.size() > 0) { /* We have 1 point now and will have 2 */
-			Point p = (roi.tl() - m_rects.back().tl()) / itick;
-			double v = norm(p) / itick;
+typedef struct {
+	int width;
+	int height;
+	int fps;
+} VideoProperties;
 
-			m_arcLength += v;
-			m_vectors.push_back(p);
+typedef struct {
+	int numberFrames;
+	GstClockTime timestamp;
+	VideoProperties videoProperties;
+	GstElement *appsrc;
+	bool isEnough; /* appsrc queue is full, client is behind */
+	bool isKeyFrame; /* Stream starts from a key frame */
+} RtspServerContext;
 
-			m_absLength = norm(roi.tl() - m_rects[0].tl());
+/*
+* RTSP media takes encoded access units of video encoder, nothing is encoded again for RTSP.
+* Media is shared by all clients, context lives from media-configure until media is gone.
+*/
 
-			if(m_rects.size() == 1) {
-				m_maxVector = v;
-				m_minVector = v;
-			} else if(v > m_maxVector)
-				m_maxVector = v;
-			else if(v < m_minVector)
-				m_minVector = v;
+static mutex rtspMutex;
+static RtspServerContext *s_rtspContext = 0;
 
-			m_averageArea = (m_averageArea + roi.area()) / 2;
-		} else {
-			m_averageArea = roi.area();
-		}
+/* Encoded callback of video encoder, called on streaming thread of encoder */
+static void PushRtspBuffer(GstBuffer *buffer, void *user)
+{
+	lock_guard<mutex> lock(rtspMutex);
 
-		if(m_rects.size() == 1) { /* We have 2 point now */
-			m_velocity.x = (roi.tl().x - m_rects.back().tl().x) / itick;
-			m_velocity.y = (roi.tl().y - m_rects.back().tl().y) / itick;
-		} else if(m_rects.size() > 1) { /* We have at latest 3 point now */
-			m_velocity.x = (m_velocity.x + (roi.tl().x - m_rects.back().tl().x) / itick) / 2;
-			m_velocity.y = (m_velocity.y + (roi.tl().y - m_rects.back().tl().y) / itick) / 2;
+	RtspServerContext *ctx = s_rtspContext;
+	if(ctx == 0 || ctx->isEnough)
+		return;
 
-			size_t n = m_vectors.size() - 1;
-			size_t n_1 = n - 1;
+	if(ctx->isKeyFrame == false) {
+		if(GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT))
+			return; /* Decoder of client needs key frame first */
+		ctx->isKeyFrame = true;
+	}
 
-			m_acceleration.x = (m_acceleration.x + (m_vectors[n].x - m_vectors[n_1].x)) / 2;
-			m_acceleration.y = (m_acceleration.y + (m_vectors[n].y - m_vectors[n_1].y)) / 2;
+	GstBuffer *out = gst_buffer_copy(buffer); /* Metadata is copied, memory is shared */
 
-			double v = CosineAngle(m_vectors[n], m_vectors[n_1]);
-			double radian;
-			if(v <= -1.0f)
-				radian = M_PI;
-			else if(v >= 1.0f)
-				radian = 0;
-			else
-				radian = acos(v);
+	/* increment the timestamp every 1/FPS second */
+	GST_BUFFER_PTS (out) = ctx->timestamp;
+	GST_BUFFER_DTS (out) = ctx->timestamp;
+	GST_BUFFER_DURATION (out) = gst_util_uint64_scale_int (1, GST_SECOND, ctx->videoProperties.fps);
+	ctx->timestamp += GST_BUFFER_DURATION (out);
+	ctx->numberFrames++;
 
-			/* 
-			* r = (v1.x * v2.y) - (v2.x * v1.y) 
-			* If r > 0 v2 is located on the left side of v1. 
-			* if r == 0 v2 and v1 on the same line.
-			* If r < 0 v2 is located on the right side of v2.
-			*/ 
-			v = (m_vectors[n].x * m_vectors[n_1].y) - (m_vectors[n_1].x * m_vectors[n].y);
-			if(v < 0)
-				radian *= -1.0;
+	gst_app_src_push_buffer(GST_APP_SRC(ctx->appsrc), out); /* Takes buffer */
+}
 
-			m_angleOfTurn += (radian * 180 / M_PI);
-		}
+/* called when we need to give data to appsrc */
+static void
+need_data (GstElement * appsrc, guint unused, RtspServerContext *ctx)
+{
+	lock_guard<mutex> lock(rtspMutex);
+	ctx->isEnough = false;
+}
 
-		m_normVelocity = norm(m_velocity);
+static void
+enough_data (GstElement * appsrc, RtspServerContext *ctx)
+{
+	lock_guard<mutex> lock(rtspMutex);
+	ctx->isEnough = true;
+	ctx->isKeyFrame = false; /* Frames are dropped from now on, restart from key frame */
+}
 
-		m_rects.push_back(roi);
-		m_lastFrameTick = frameTick;
-		m_frameTicks.push_back(frameTick);
-#if 1
-		if(m_triggerCount >= MAX_NUM_TRIGGER)
-			Reset();
-#endif
+static void free_ctx(gpointer mem) {
+//printf("%s:%d\n", __PRETTY_FUNCTION__, __LINE__);
+	RtspServerContext *ctx = (RtspServerContext *)mem;
+	{
+		lock_guard<mutex> lock(rtspMutex);
+		if(s_rtspContext == ctx)
+			s_rtspContext = 0;
 	}
+	if(ctx->appsrc)
+		gst_object_unref(ctx->appsrc);
+	g_free(ctx);
+}
 
-	void Update(Target & t) {
-		for(size_t i=0;i<t.m_rects.size();i++) {
-			Update(t.m_rects[i], t.m_frameTicks[i]);
-		}
-	}
+/* called when a new media pipeline is constructed. CAMERA_WIDTHe can query the
+ * pipeline and configure our appsrc */
+static void
+media_configure (GstRTSPMediaFactory * factory, GstRTSPMedia * media, gpointer user_data)
+{
+	// should be incremented once on each frame for timestamping
+	GstElement *element, *appsrc;
+	RtspServerContext *ctx;
+	VideoProperties *vp = (VideoProperties *)user_data;
 
-	int DotProduct(const Point & p) {
-		size_t i = m_rects.size();
-		if(i < 2)
-			return 0;
-		i--;
-		Point v[2];
-		v[0].x = p.x - m_rects[i].tl().x;
-		v[0].y = p.y - m_rects[i].tl().y;
-		v[1].x = m_rects[i].tl().x - m_rects[i-1].tl().x;
-		v[1].y = m_rects[i].tl().y - m_rects[i-1].tl().y;
-		int dp = v[0].x * v[1].x + v[0].y * v[1].y;
-		return dp;
-	}
-
-    double CosineAngleTl(const Point & p) {
-        size_t i = m_rects.size();
-        if(i < 2)
-            return 0;
-        --i;
-        Point v1, v2;
-        v1.x = p.x - m_rects[i].tl().x;
-        v1.y = p.y - m_rects[i].tl().y;
-        v2.x = m_rects[i].tl().x - m_rects[i-1].tl().x;
-        v2.y = m_rects[i].tl().y - m_rects[i-1].tl().y;
-
-        /* A.B = |A||B|cos() */
-        /* cos() = A.B / |A||B| */
-        return v1.dot(v2) / (norm(v1) * norm(v2));
-    }
-
-    double CosineAngleBr(const Point & p) {
-        size_t i = m_rects.size();
-        if(i < 2)
-            return 0;
-        --i;
-        Point v1, v2;
-        v1.x = p.x - m_rects[i].br().x;
-        v1.y = p.y - m_rects[i].br().y;
-        v2.x = m_rects[i].br().x - m_rects[i-1].br().x;
-        v2.y = m_rects[i].br().y - m_rects[i-1].br().y;
-
-        /* A.B = |A||B|cos() */
-        /* cos() = A.B / |A||B| */
-        return v1.dot(v2) / (norm(v1) * norm(v2));
-    }
-
-    double CosineAngleCt(const Point & p) {
-        size_t i = m_rects.size();
-        if(i < 2)
-            return 0;
-        --i;
-        Point v1, v2;
-        Point ct0 = Center(m_rects[i]);
-        Point ct1 = Center(m_rects[i-1]);
-        v1.x = p.x - ct0.x;
-        v1.y = p.y - ct0.y;
-        v2.x = ct0.x - ct1.x;
-        v2.y = ct0.y - ct1.y;
-
-        /* A.B = |A||B|cos() */
-        /* cos() = A.B / |A||B| */
-        return v1.dot(v2) / (norm(v1) * norm(v2));
-    }
-
-	void Draw(Mat & outFrame, bool drawAll = false) {
-		RNG rng(m_rects.front().area());
-		Scalar color = Scalar( rng.uniform(0, 255), rng.uniform(0,255), rng.uniform(0,255) );
-		Rect r = m_rects.back();
-		//rectangle( outFrame, r.tl(), r.br(), Scalar( 255, 0, 0 ), 2, 8, 0 );
-		rectangle( outFrame, r.tl(), r.br(), color, 1, 8, 0 );
-
-		if(m_rects.size() > 1) { /* Minimum 2 points ... */
-			for(int i=0;i<m_rects.size()-1;i++) {
-				//line(outFrame, p0, p1, Scalar(0, 0, 255), 1);
-				line(outFrame, Center(m_rects[i]), Center(m_rects[i+1]), color, 1);
-				if(drawAll)
-					//rectangle( outFrame, m_rects[i].tl(), m_rects[i].br(), Scalar( 196, 0, 0 ), 2, 8, 0 );
-					//rectangle( outFrame, m_rects[i].tl(), m_rects[i].br(), Scalar( (m_rects[0].x + m_rects[0].y) % 255, 0, 0 ), 1, 8, 0 );
-					rectangle( outFrame, m_rects[i].tl(), m_rects[i].br(), color, 1, 8, 0 );
-			}
-		}        
-	}
-
-	void Info() {
-#ifdef DEBUG
-		printf("\033[0;31m"); /* Red */
-		printf("\n= = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = =\n");
-		printf("[%u] Target :\n\tsamples = %lu, area = %d, arc length = %.1f, abs length = %.1f, velocity = %.1f\n", 
-			m_id, m_rects.size(), m_averageArea, m_arcLength, m_absLength, m_normVelocity);
-		printf("\nVectors : length\n");      
-		for(auto v : m_vectors) {
-			printf("%.1f\t", norm(v));
-		}
-		printf("\n");
-		printf("maximum = %.1f, minimum = %.1f\n", m_maxVector, m_minVector);      
-		printf("\nTrajectory : [ Tick ] (x, y) area\n");
-		/*
-		for(auto p : m_rects) {
-			printf("(%4d,%4d)<%5d>\t", p.tl().x, p.tl().y, p.area());
-		}
-		*/
-		for(size_t i=0;i<m_rects.size();i++) {
-			printf("[%lu](%4d,%4d) %d\t", m_frameTicks[i] - m_frameTicks[0], m_rects[i].tl().x, m_rects[i].tl().y, m_rects[i].area());
-		}
-
-		printf("\nAngle of turn :\n"); 
-		if(m_vectors.size() > 1)
-		for(size_t i=0;i<m_vectors.size()-1;i++) {
-			double v = CosineAngle(m_vectors[i], m_vectors[i+1]);
-			double radian;
-			if(v <= -1.0f)
-				radian = M_PI;
-			else if(v >= 1.0f)
-				radian = 0;
-			else
-				radian = acos(v);
-
-			/* 
-			* r = (v1.x * v2.y) - (v2.x * v1.y) 
-			* If r > 0 v2 is located on the left side of v1. 
-			* if r == 0 v2 and v1 on the same line.
-			* If r < 0 v2 is located on the right side of v2.
-			*/ 
-			v = (m_vectors[i+1].x * m_vectors[1].y) - (m_vectors[1].x * m_vectors[i+1].y);
-			if(v < 0)
-				radian *= -1.0;
-
-			printf("<%f ", (radian * 180 / M_PI));
-		}
-		printf("\n= = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = =\n");
-		printf("\033[0m"); /* Default color */
-#endif
-	}
+	/* get the element used for providing the streams of the media */
+	element = gst_rtsp_media_get_element (media);
 
-	inline double VectorDistortion() {
-		return m_minVector > 0 ? (m_maxVector / m_minVector) : 0;
-	}
+	/* get our appsrc, we named it 'mysrc' with the name property */
+	appsrc = gst_bin_get_by_name_recurse_up (GST_BIN (element), "mysrc");
 
-	inline double ArcLength() { return m_arcLength; }
-	inline double AbsLength() { return m_absLength; }
+	/* this instructs appsrc that we will be dealing with timed buffer */
+	gst_util_set_object_arg (G_OBJECT (appsrc), "format", "time");
+	/* configure the caps of the video */
+	g_object_set (G_OBJECT (appsrc), "caps",
+	gst_caps_new_simple ("video/x-h265",
+				"stream-format", G_TYPE_STRING, "byte-stream",
+				"alignment", G_TYPE_STRING, "au",
+				"width", G_TYPE_INT, vp->width,
+				"height", G_TYPE_INT, vp->height,
+				"framerate", GST_TYPE_FRACTION, vp->fps, 1, NULL), NULL);
 
-	inline unsigned long FrameTick() { return m_lastFrameTick; }
-	inline const Rect & LastRect() { return m_rects.back(); }
+	ctx = g_new0 (RtspServerContext, 1);
+	ctx->timestamp = 0;
+	ctx->numberFrames = 0;
+	ctx->videoProperties.width = vp->width;
+	ctx->videoProperties.height = vp->height;
+	ctx->videoProperties.fps = vp->fps;
+	ctx->appsrc = appsrc; /* Keeps reference */
+	ctx->isEnough = false;
+	ctx->isKeyFrame = false;
 
-	inline const Point BeginCenterPoint() { return Center(m_rects[0]); }
-	inline const Point EndCenterPoint() { return Center(m_rects.back()); }
+	/* make sure ther datais freed when the media is gone */
+	g_object_set_data_full (G_OBJECT (media), "my-extra-data", ctx, (GDestroyNotify) free_ctx);
 
-	inline const Point CurrentCenterPoint() { return Center(m_rects.back()); }
-	const Point PreviousCenterPoint() {
-		if(m_rects.size() < 2)
-			return std::move(Point(0, 0));
+	/* flow control of encoded frames pushed by video encoder */
+	g_signal_connect (appsrc, "need-data", (GCallback) need_data, ctx);
+	g_signal_connect (appsrc, "enough-data", (GCallback) enough_data, ctx);
+	gst_object_unref (element);
 
-		auto it = m_rects.rbegin();
-		return Center(*(++it)); 
-	}
-	
-	bool Trigger(bool enableBugTrigger = false) {
-		bool r = false;
-		if(m_vectors.size() <= 8 &&
-			VectorDistortion() >= 40) { /* 最大位移向量值與最小位移向量值的比例 */
-			dprintf("\033[0;31m"); /* Red */
-			dprintf("Velocity distortion %f !!!\n", VectorDistortion());
-			dprintf("\033[0m"); /* Default color */
-		} else if(enableBugTrigger) { 
-			if((m_averageArea < 144 && m_normVelocity > 30) || /* 12 x 12 */
-					(m_averageArea < 256 && m_normVelocity > 40) || /* 16 x 16 */
-					(m_averageArea < 324 && m_normVelocity > 50) || /* 18 x 18 */
-					(m_averageArea < 400 && m_normVelocity > 75) || /* 20 x 20 */
-					(m_averageArea < 576 && m_normVelocity > 100) || /* 24 x 24 */
-					(m_averageArea < 900 && m_normVelocity > 125) /* 30 x 30 */
-				) {
-				dprintf("\033[0;31m"); /* Red */
-				dprintf("Bug detected !!! average area = %d, velocity = %f\n", m_averageArea, m_normVelocity);
-				dprintf("\033[0m"); /* Default color */
-				m_bugTriggerCount++;
-			} else {
-				if(m_bugTriggerCount > 0) {
-					dprintf("\033[0;31m"); /* Red */
-					dprintf("False trigger due to bug trigger count is %u\n", m_bugTriggerCount);
-					dprintf("\033[0m"); /* Default color */
-					if(m_bugTriggerCount <= 3) /* To avoid false bug detection */
-						m_bugTriggerCount--;
-				} else {
-					m_triggerCount++;
-					r = true;
-				}
-			}
-		} else {
-			m_triggerCount++;
-			r = true;
-		}
-		if(r) {
-			dprintf("\033[0;31m"); /* Red */
-			dprintf("[%u] T R I G G E R (%d)\n", m_id, m_triggerCount);
-			dprintf("\033[0m"); /* Default color */
-		}
+	lock_guard<mutex> lock(rtspMutex);
+	s_rtspContext = ctx;
+}
 
-		Info();
+#include <glib-object.h>
+#include <glib-unix.h>
 
-		return r;
-	}
+// This callback will be inovked when this process receives SIGUSR1.
+gboolean HangupSignalCallback(gpointer data) {
+  //out << "Received a signal to terminate the daemon";
+  GMainLoop* loop = reinterpret_cast<GMainLoop*>(data);
+  g_main_loop_quit(loop);
+  // This function can return false to remove this signal handler as we are
+  // quitting the main loop anyway.
 
-	inline uint8_t TriggerCount() { return m_triggerCount; }
+  return false;
+}
 
-	inline int AverageArea() { return m_averageArea; }
-	inline size_t TrackedCount() { return m_rects.size(); }
+/*
+* https://forums.developer.nvidia.com/t/rtsp-server-cleanup-from-thread-does-not-stop-client-apps-video/107137/15
+*/
 
-	friend class Tracker;
-};
+std::atomic<uint32_t> g_clientCount(0);
 
-uint32_t Target::s_id = 0;
+GstRTSPFilterResult clientFilter(GstRTSPServer* server, GstRTSPClient* client, gpointer user) {
+	return GST_RTSP_FILTER_REMOVE;
+}
 
-static inline bool TargetSortByArea(Target & a, Target & b)
+void closeClients(GstRTSPServer* server)
 {
-	return a.LastRect().area() > b.LastRect().area();
+	printf("RTSP Server - closing clients [%u]\n", g_clientCount.load());
+	if(g_clientCount.load() > 0)
+		gst_rtsp_server_client_filter(server, clientFilter, nullptr);
 }
 
-static inline bool TargetSortByTrackedCount(Target & a, Target & b)
+void clientClosed(GstRTSPClient* client, gpointer user)
 {
-    return a.TrackedCount() > b.TrackedCount();
+	printf("RTSP Server - clients closed [%u]\n", --g_clientCount);
 }
 
-static Rect MergeRect(Rect & r1, Rect & r2) {
-    Rect r;
-    r.x = min(r1.x, r2.x);
-    r.y = min(r1.y, r2.y);
-    r.width = max(r1.x + r1.width, r2.x + r2.width) - r.x;
-    r.height = max(r1.y + r1.height, r2.y + r2.height) - r.y;
-	return r;
+void clientConnected(GstRTSPServer* server, GstRTSPClient* client, gpointer user)
+{
+	g_signal_connect(client, "closed", reinterpret_cast<GCallback>(clientClosed), nullptr);
+	printf("RTSP Server - client connected [%u]\n", ++g_clientCount);
 }
 
-/*
-*
-*/
+static VideoProperties s_videoProperties;
+static GstRTSPServer *s_server = 0;
 
-class Tracker
+int gst_rtsp_server_task(int width, int height, int fps)
 {
-private:
-	int m_width, m_height;
-	unsigned long m_lastFrameTick;
-	list< Target > m_targets;
-	Rect m_newTargetRestrictionRect;
-	list< list< Rect > > m_newTargetsHistory;
-	int m_horizonHeight;
-
-    size_t MaxTrackedCountOfTargets() {
-        size_t maxCount = 0;
-        for(list< Target >::iterator t=m_targets.begin();t!=m_targets.end();t++) {
-            if(t->TrackedCount() > maxCount)
-                maxCount = t->TrackedCount();
-        }
-        return maxCount;
-    }
-
-public:
-	Tracker() : m_width(CAMERA_WIDTH), m_height(CAMERA_HEIGHT), m_lastFrameTick(0), m_horizonHeight(CAMERA_HEIGHT * HORIZON_RATIO) {}
-	Tracker(int width, int height) : Tracker() {
-		m_width = width;
-		m_height = height;
-		m_horizonHeight = height * HORIZON_RATIO;
-	}
-
-	void UpdateHorizonRatio(uint16_t horizonRatio) {
-		switch(horizonRatio) {
-			case 20: m_horizonHeight = m_height * 8 / 10;
-				break;
-			case 30: m_horizonHeight = m_height * 7 / 10;
-				break;
-		}
-	}
-
-	void Initialisize(int width, int height) {
-		m_width = width;
-		m_height = height;
-	}
+	GMainLoop *loop;
+	//GstRTSPServer *server;
+	GstRTSPMountPoints *mounts;
+	GstRTSPMediaFactory *factory;
 
-	int HorizonHeight() const { return m_horizonHeight; }
+	s_videoProperties.width = width;
+	s_videoProperties.height = height;
+	s_videoProperties.fps = fps;
 
-	void NewTargetRestriction(const Rect & r) {
-		m_newTargetRestrictionRect = r;
-	}
+	char *args[] = {
+		(char*)"gst-rtsp-server",
+		NULL
+	};
+	int argv = 0;
+	gst_init (&argv, (char ***)&args);
 
-	Rect NewTargetRestrictionRect() const {   return m_newTargetRestrictionRect; }
+	loop = g_main_loop_new (NULL, FALSE);
 
-	void Update(list< Rect > & roiRect, bool enableFakeTargetDetection = false) {
-		++m_lastFrameTick;
-		for(list< Target >::iterator t=m_targets.begin();t!=m_targets.end();) { /* Try to find lost targets */
-			list<Rect>::iterator rr;
-			Rect r1 = t->m_rects.back();
-			Rect r2 = r1;
-			int f = m_lastFrameTick - t->FrameTick();
-			if(t->m_vectors.size() > 0) {
-				Point v = t->m_vectors.back();
-				for(int i=0;i<f;i++) {
-					v.x += t->m_acceleration.x;
-					v.y += t->m_acceleration.y;
-					r2.x += v.x;
-					r2.y += v.y;
-				}
-			}
+	// Set up a signal handler for handling SIGUSR1.
+	g_unix_signal_add(SIGUSR1, HangupSignalCallback, loop);
+	
+	/* create a server instance */
+	s_server = gst_rtsp_server_new ();
+	/* get the mount points for this server, every server has a default object
+	* that be used to map uri mount points to media factories */
+	mounts = gst_rtsp_server_get_mount_points (s_server);
 
-			if(t->m_triggerCount > 0 &&
-					(r2.x < 0 || r2.x > m_width)) {
-				dprintf("\033[0;35m"); /* Puple */
-				dprintf("<%u> Out of range target : (%d, %d), samples : %lu\n", t->m_id, t->m_rects.back().tl().x, t->m_rects.back().tl().y, t->m_rects.size());
-				dprintf("\033[0m"); /* Default color */
-				t = m_targets.erase(t); /* Remove tracing target */
-				continue;
-			}
+	/* make a media factory for a test stream. The default media factory can use
+	* gst-launch syntax to create pipelines.
+	* any launch line works as long as it contains elements named pay%d. Each
+	* element with pay%d names will be a stream */
+	factory = gst_rtsp_media_factory_new ();
+	gst_rtsp_media_factory_set_launch (factory,
+		"( appsrc name=mysrc is-live=true format=time ! video/x-h265, stream-format=(string)byte-stream, alignment=(string)au ! \
+h265parse ! rtph265pay mtu=1400 config-interval=-1 name=pay0 pt=96 )");
+	gst_rtsp_media_factory_set_eos_shutdown(factory, TRUE);
+	gst_rtsp_media_factory_set_shared (factory, TRUE);
+	/* notify when our media is ready, This is called whenever someone asks for
+	* the media and a new pipeline with our appsrc is created */
+	g_signal_connect (factory, "media-configure", (GCallback) media_configure, &s_videoProperties);
 
-			double n0 = 0;
-			if(t->m_vectors.size() > 0) {
-				n0 = cv::norm(Center(r2) - Center(r1)); /* Moving distance of predict target */
-			}
-			
-			for(rr=roiRect.begin();rr!=roiRect.end();++rr) {
+	/* attach the test factory to the /test url */
+	gst_rtsp_mount_points_add_factory (mounts, "/test", factory);
 
-				if(r1.area() > (rr->area() * 32) ||
-					rr->area() > (r1.area() * 32)) /* Object and target area difference */
-					continue;
+	/* don't need the ref to the mounts anymore */
+	g_object_unref (mounts);
 
-                Point rrct = Center(*rr);
-                double n1 = cv::norm(rrct - Center(r1)); /* Distance between object and target */
+	/* attach the server to the default maincontext */
+	const auto server_id = gst_rtsp_server_attach (s_server, NULL);
 
-				if(n1 > MAX_TARGET_TRACKING_DISTANCE)
-					continue; /* Too far */
-#if 0
-				if(t->m_vectors.size() > 1) {
-					double n = cv::norm(t->m_vectors.back());
-					if(n1 > (n0 * 3) / 2)
-						continue; /* Too far */
-				}
-#endif
-				if((r1 & *rr).area() > 0) { /* Target tracked ... */
-					//if(t->DotProduct(rr->tl()) >= 0) /* Two vector less than 90 degree */
-						break;                
-				}
+	g_signal_connect(s_server, "client-connected", reinterpret_cast<GCallback>(clientConnected), nullptr);
 
-				if(t->m_vectors.size() > 0) {
-					Rect r = r1;
-					bool tracked = false;
-					Point v = t->m_vectors.back();
-					for(int i=0;i<f;i++) {
-						r.x += v.x;
-						r.y += v.y;
-						if((r & *rr).area() > 0) { /* Target tracked with velocity ... */
-							tracked = true;
-							break;
-						}
-					}
-					if(tracked)
-						break;
-				}
 
-				if(t->m_vectors.size() > 0) {
-					Rect r = r1;
-					bool tracked = false;
-					Point v = t->m_vectors.back();
-					for(int i=0;i<f;i++) {
-						v.x += t->m_acceleration.x;
-						v.y += t->m_acceleration.y;
-						r.x += v.x;
-						r.y += v.y;
-						if((r & *rr).area() > 0) { /* Target tracked with velocity ... */
-							tracked = true;
-							break;
-						}
-					}
-					if(tracked)
-						break;
-				}
+	/* start serving */
+	g_print ("stream ready at rtsp://127.0.0.1:8554/test\n");
+	g_main_loop_run (loop);
 
-				if(t->m_vectors.size() == 0) { /* new target with zero velocity */
-					if(rr->y >= m_horizonHeight) {
-						if(n1 < (rr->width + rr->height)) /* Target tracked with Euclidean distance ... */
-							break;
-					} else {
-						if(n1 < (rr->width + rr->height) * 2) /* Target tracked with Euclidean distance ... */
-							break;
-					}
-				} else if(n1 < (n0 * 3) / 2) { /* Target tracked with velocity and Euclidean distance ... */
-					if(rr->y >= m_horizonHeight) {
-						double a = t->CosineAngleCt(rrct);
-						if(a > 0.9659) /* cos(PI/12) */
-							break;
-					} else {
-						//double a = t->CosineAngleTl(rr->tl());
-						//if(a > 0.8587) /* cos(PI/6) */
-						//    break;
-					}
-				}
-			}
- 
-			if(rr == roiRect.end() && 
-				t->m_vectors.size() > 0) { /* Target missing ... */
-				for(rr=roiRect.begin();rr!=roiRect.end();++rr) { /* */
+	printf("RTSP Server - stopped\n");
 
-					if(r1.area() > (rr->area() * 32) ||
-						rr->area() > (r1.area() * 32)) /* Object and target area difference */
-						continue;
+	if(g_clientCount.load() > 0)
+		closeClients(s_server);
 
-					Point rrct = Center(*rr);
-					double n1 = cv::norm(rrct - Center(r1)); /* Distance between object and target */
+	g_source_remove(server_id);
+	if(G_IS_OBJECT(s_server))
+		g_object_unref(s_server);
+	s_server = 0;
+	if(G_IS_OBJECT(loop))
+		g_object_unref(loop);
 
-					if(n1 > (MAX_TARGET_TRACKING_DISTANCE/ 2))
-						continue; /* Too far */
 
-                    double a = t->CosineAngleCt(rrct);
-                    double n2 = cv::norm(rrct - Center(r2));
+	return 0;
+}
 
-                    if(a > 0.5 && /* cos(PI/3) */
-                        n2 < (n0 * 3) / 2) { 
-                        break;
-                    }
+static gboolean remove_func (GstRTSPSessionPool *pool, GstRTSPSession *session, GstRTSPServer *server) {
+  return GST_RTSP_FILTER_REMOVE;
+}
 
-                    if(a > 0.8587 && /* cos(PI/6) */
-                        n1 < (t->m_normVelocity * f * 2)) {
-                        break;
-                    }
-				}
-			}
+void gst_rtsp_server_close_clients() {
+	if(s_server == 0)
+		return;
 
-			if(rr == roiRect.end()) { /* Target missing ... */
-				bool isTargetLost = false;
-				if(t->m_vectors.size() > 1) {
-					uint32_t compensation = (t->TrackedCount() / 6); /* Tracking more frames with more sample */
-					if(compensation > 5)
-						compensation = 5;
-					if(f > (MAX_NUM_FRAME_MISSING_TARGET + compensation)) /* Target still missing for over X frames */
-						isTargetLost = true;
-				} else { /* new target with zero velocity */
-					if(f > MAX_NUM_FRAME_MISSING_TARGET) 
-						isTargetLost = true;
-				}
-				if(isTargetLost) {
-					dprintf("\033[0;35m"); /* Puple */
-					dprintf("<%u> Lost target : (%d, %d), samples : %lu\n", t->m_id, t->m_rects.back().tl().x, t->m_rects.back().tl().y, t->m_rects.size());
-					dprintf("\033[0m"); /* Default color */
-					t = m_targets.erase(t); /* Remove tracing target */
-					continue;
-				} else {
-#if 0                    
-					Point p = t->m_rects.back().tl();
-					dprintf("<%u> Search target : (%d, %d) -> [%d, %d]\n", t->m_id, p.x, p.y, 
-						(t->m_velocity.x + t->m_acceleration.x) * f, (t->m_velocity.y + t->m_acceleration.y) * f);
-					for(list< Target >::iterator tt=m_targets.begin();tt!=m_targets.end();++tt) {
-						if(tt->m_id == t->m_id)
-							continue;
-						if((t->m_rects.back() & tt->m_rects.front()).area() > 0) { /**/
-							t->Update(*tt);
-
-							dprintf("\033[0;33m"); /* Yellow */
-							dprintf("Merge targets : <%d> -->> <%d>\n", tt->m_id, t->m_id);
-							dprintf("\033[0m"); /* Default color */
-
-							m_targets.erase(tt);
-							break;
-						}
-					}
-#endif                                       
-				}
-			} else { /* Target tracked ... */
-				Point p = t->m_rects.back().tl();
-				dprintf("\033[0;32m"); /* Green */
-				dprintf("<%u> Target tracked : [%lu](%d, %d) -> (%d, %d)[%d, %d]\n", t->m_id, m_lastFrameTick, p.x, p.y, 
-					rr->x, rr->y, rr->x - t->m_rects.back().x, rr->y - t->m_rects.back().y);
-				dprintf("\033[0m"); /* Default color */
-				t->Update(*rr, m_lastFrameTick);
-				roiRect.erase(rr);
-			}
-			++t;
-		}
-
-		list< Rect > newTargetList;
-
-		for(list<Rect>::iterator rr=roiRect.begin();rr!=roiRect.end();++rr) { /* New targets registration */
-			if(!m_newTargetRestrictionRect.empty()) {
-				if((m_newTargetRestrictionRect & *rr).area() > 0)
-					continue;
-			}
-
-			uint32_t overlap_count = 0;
-			for(auto & l : m_newTargetsHistory) {
-				for(auto & r : l) {
-					if(rr->y < m_horizonHeight)
-						continue;
-					if((r & *rr).area() > 0) { /* new target overlap previous new target */
-						++overlap_count;
-					}
-				}
-			}
-			if(rr->y >= m_horizonHeight) {
-				if(overlap_count > 0) {
-					rr->x -= rr->width;
-					rr->y -= rr->height;
-					rr->width = rr->width << 1;
-					rr->height = rr->height << 1;
-				}
-				newTargetList.push_back(*rr);
-			}
-
-			if(enableFakeTargetDetection && 
-				overlap_count >= 2) {
-				dprintf("[X] Fake target : (%u)\n", overlap_count);
-			} else {
-				m_targets.push_back(Target(*rr, m_lastFrameTick));
-				dprintf("\033[0;32m"); /* Green */
-				dprintf("<%u> New target : [%lu](%d, %d)\n", m_targets.back().m_id, m_lastFrameTick, rr->tl().x, rr->tl().y);
-				dprintf("\033[0m"); /* Default color */
-			}
-		}
-
-		m_newTargetsHistory.push_back(newTargetList);
-		if(m_newTargetsHistory.size() >= 90) {
-			m_newTargetsHistory.pop_front();
-		}
-
-		if(m_targets.size() > 1) {
-			if(MaxTrackedCountOfTargets() > 6)
-				m_targets.sort(TargetSortByTrackedCount);
-			else
-				m_targets.sort(TargetSortByArea);
-		}
-	}
-
-	inline list< Target > & TargetList() { return m_targets; }
-	inline list< list< Rect > > & NewTargetHistory() { return m_newTargetsHistory; }
-};
-
-static Tracker tracker;
-
-/*
-*
-*/
-
-class FrameQueue
-{
-public:
-	struct cancelled {};
-
-public:
-	FrameQueue() : isCancelled(false), refCnt(0) {}
-
-	void push(Mat const & image);
-	void pop();
-	size_t size() { return matQueue.size(); }
-	const Mat & front();
-
-	void cancel();
-	void reset();
-
-private:
-	std::queue<cv::Mat> matQueue;
-	std::mutex matMutex;
-	std::condition_variable condEvent;
-	bool isCancelled;
-
-	std::atomic_long refCnt;
-};
-
-void FrameQueue::cancel()
-{
-	std::unique_lock<std::mutex> mlock(matMutex);
-	isCancelled = true;
-	condEvent.notify_all();
-}
-
-void FrameQueue::push(cv::Mat const & image)
-{
-	std::unique_lock<std::mutex> mlock(matMutex);
-
-	while(matQueue.size() >= 15) { /* Prevent memory overflow ... */
-		printf("Video Frame droped !!!\n");
-		if(refCnt == 0)
-			matQueue.pop();
-		else
-			return;
-	}
-
-	matQueue.push(image);
-	condEvent.notify_all();
-}
-
-void FrameQueue::pop()
-{
-	std::unique_lock<std::mutex> mlock(matMutex);
-
-	if(matQueue.empty())
-		return;
-
-	if(refCnt > 0)
-		--refCnt;
-
-	if(refCnt == 0)
-		matQueue.pop();
-}
-
-const Mat & FrameQueue::front()
-{
-	std::unique_lock<std::mutex> mlock(matMutex);
-
-	while (matQueue.empty() && !isCancelled) {
-		condEvent.wait(mlock);
-	}
-
-	if(isCancelled) {
-		throw cancelled();
-	}
-
-	++refCnt;
-
-	return matQueue.front();
+	printf("RTSP Server - shutdown\n");
+/*	
+	GstRTSPSessionPool *pool;
+	pool = gst_rtsp_server_get_session_pool(s_server);
+	gst_rtsp_session_pool_filter(pool, (GstRTSPSessionPoolFilterFunc) remove_func, s_server);
+	g_object_unref(pool);
+*/	
+	if(g_clientCount.load() > 0)
+		closeClients(s_server); /* It's chance to hang inside if client running */
 }
 
-void FrameQueue::reset()
-{
-	std::unique_lock<std::mutex> mlock(matMutex);
-
-	matQueue = std::queue<cv::Mat>();
-	isCancelled = false;
-}
+static thread rtspServerThread;
 
 /*
 *
 */
 
-static FrameQueue videoOutputQueue;
-static FrameQueue videoRtspQueue;
-
 /*
-*
+* One thread converts and encodes result frames once, see VideoEncoder for branches of outputs.
+* Reads videoFrameRing with its own cursor, frames are dropped if encoder is behind, tracking is not blocked.
 */
 
-typedef struct {
-	int width;
-	int height;
-	int fps;
-} VideoProperties;
+static VideoEncoder videoEncoder;
+static EventRecorder eventRecorder;
+static std::atomic<long> s_encodeUs(0); /* Overlay rendering and write of the latest frame, a stage of load governor */
 
-typedef struct {
-	int numberFrames;
-	GstClockTime timestamp;
-	VideoProperties videoProperties;
-	GstBuffer *buffer;
-} RtspServerContext;
-
-/* called when we need to give data to appsrc */
-static void
-need_data (GstElement * appsrc, guint unused, RtspServerContext *ctx)
+/* Next index of fileFormat on disk, loops back to 0 */
+static int NextVideoFileIndex(const string & fileFormat)
 {
-	GstBuffer *buffer;
-//	uint64_t size = ctx->videoProperties.width * ctx->videoProperties.height * 4; // Image size * deth of BGRx;
-	uint64_t size = ctx->videoProperties.width * ctx->videoProperties.height * 3; // Image size * deth of BGR;
-	GstFlowReturn ret;
-
-	if(ctx->buffer == 0) {
-		ctx->buffer = gst_buffer_new_allocate (NULL, size, NULL);
-	}
-	buffer = ctx->buffer;
-
-	//buffer = gst_buffer_new_allocate (NULL, size, NULL);
-	GstMapInfo map;
-	gint8 *raw;
-
-	gst_buffer_map (buffer, &map, GST_MAP_WRITE); // make buffer writable
-	raw = (gint8 *)map.data;
-
-	const Mat & lastFrame = videoRtspQueue.front();
-/*
-#if 0
-	for (int i=0;i<ctx->videoProperties.height;i++) {
-		const Vec3b* ptr = lastFrame.ptr<Vec3b>(i);
-		for (int j = 0; j<ctx->videoProperties.width; j++) {
-			uint64_t offset = ((i*ctx->videoProperties.width)+j)*4;
-			raw[offset] = ptr[j][0];
-			raw[offset+1] = ptr[j][1];
-			raw[offset+2] = ptr[j][2];
-			raw[offset+3] = 127;
-		}
-	}
-#else
-	for (int i=0;i<ctx->videoProperties.height;i++) {
-		const Vec3b* ptr = lastFrame.ptr<Vec3b>(i);
-		uint64_t offset = (i*ctx->videoProperties.width) * 4;
-		for (int j=0; j<ctx->videoProperties.width; j++) {
-			raw[offset++] = ptr[j][0];
-			raw[offset++] = ptr[j][1];
-			raw[offset++] = ptr[j][2];
-			raw[offset++] = 127;
-		}
+	int videoOutoutIndex = 0;
+	char filePath[STR_SIZE];
+	while(videoOutoutIndex < VIDEO_OUTPUT_MAX_FILES) {
+		snprintf(filePath, STR_SIZE, fileFormat.c_str(), videoOutoutIndex);
+		FILE *fp = fopen(filePath, "rb");
+		if(fp) { /* file exist ... */
+			fclose(fp);
+			++videoOutoutIndex;
+		} else
+			break; /* File doesn't exist. OK */
 	}
-#endif
-*/
-	memcpy(raw, lastFrame.data, size);
-	videoRtspQueue.pop();
-
-	gst_buffer_unmap (buffer, &map);
-
-	/* increment the timestamp every 1/FPS second */
-	GST_BUFFER_PTS (buffer) = ctx->timestamp;
-	GST_BUFFER_DURATION (buffer) = gst_util_uint64_scale_int (1, GST_SECOND, VIDEO_OUTPUT_FPS);
-	ctx->timestamp += GST_BUFFER_DURATION (buffer);
-
-	g_signal_emit_by_name (appsrc, "push-buffer", buffer, &ret);
-	//gst_buffer_unref (buffer);
+	if(videoOutoutIndex == VIDEO_OUTPUT_MAX_FILES)
+		videoOutoutIndex = 0; /* Loop */
+	return videoOutoutIndex;
 }
 
-static void free_ctx(gpointer mem) {
-//printf("%s:%d\n", __PRETTY_FUNCTION__, __LINE__);
-	RtspServerContext *ctx = (RtspServerContext *)mem;
-	if(ctx->buffer)
-		gst_buffer_unref(ctx->buffer);
-	g_free(ctx);
-}
-
-/* called when a new media pipeline is constructed. CAMERA_WIDTHe can query the
- * pipeline and configure our appsrc */
-static void
-media_configure (GstRTSPMediaFactory * factory, GstRTSPMedia * media, gpointer user_data)
+/* Access unit of video encoder to RTSP media and event recorder */
+static void PushEncodedBuffer(GstBuffer *buffer, void *user)
 {
-	// should be incremented once on each frame for timestamping
-	GstElement *element, *appsrc;
-	RtspServerContext *ctx;
-	VideoProperties *vp = (VideoProperties *)user_data;
-
-	/* get the element used for providing the streams of the media */
-	element = gst_rtsp_media_get_element (media);
-
-	/* get our appsrc, we named it 'mysrc' with the name property */
-	appsrc = gst_bin_get_by_name_recurse_up (GST_BIN (element), "mysrc");
-
-	/* this instructs appsrc that we will be dealing with timed buffer */
-	gst_util_set_object_arg (G_OBJECT (appsrc), "format", "time");
-	/* configure the caps of the video */
-	g_object_set (G_OBJECT (appsrc), "caps",
-	gst_caps_new_simple ("video/x-raw",
-				"format", G_TYPE_STRING, "BGR",
-				"width", G_TYPE_INT, vp->width,
-				"height", G_TYPE_INT, vp->height,
-				"framerate", GST_TYPE_FRACTION, vp->fps, 1, NULL), NULL);
-
-	ctx = g_new0 (RtspServerContext, 1);
-	ctx->timestamp = 0;
-	ctx->numberFrames = 0;
-	ctx->videoProperties.width = vp->width;
-	ctx->videoProperties.height = vp->height;
-	ctx->videoProperties.fps = vp->fps;
-	ctx->buffer = 0;
-
-	/* make sure ther datais freed when the media is gone */
-	g_object_set_data_full (G_OBJECT (media), "my-extra-data", ctx, (GDestroyNotify) free_ctx);
-
-	/* install the callback that will be called when a buffer is needed */
-	g_signal_connect (appsrc, "need-data", (GCallback) need_data, ctx);
-	gst_object_unref (appsrc);
-	gst_object_unref (element);
-}
-
-#include <glib-object.h>
-#include <glib-unix.h>
-
-// This callback will be inovked when this process receives SIGUSR1.
-gboolean HangupSignalCallback(gpointer data) {
-  //out << "Received a signal to terminate the daemon";
-  GMainLoop* loop = reinterpret_cast<GMainLoop*>(data);
-  g_main_loop_quit(loop);
-  // This function can return false to remove this signal handler as we are
-  // quitting the main loop anyway.
-
-  return false;
+	PushRtspBuffer(buffer, user);
+	eventRecorder.Push(buffer);
 }
 
 /*
-* https://forums.developer.nvidia.com/t/rtsp-server-cleanup-from-thread-does-not-stop-client-apps-video/107137/15
+* Recording goes on across segments, splitmuxsink of encoder names each segment by the next index.
 */
 
-std::atomic<uint32_t> g_clientCount(0);
-
-GstRTSPFilterResult clientFilter(GstRTSPServer* server, GstRTSPClient* client, gpointer user) {
-	return GST_RTSP_FILTER_REMOVE;
-}
-
-void closeClients(GstRTSPServer* server)
-{
-	printf("RTSP Server - closing clients [%u]\n", g_clientCount.load());
-	if(g_clientCount.load() > 0)
-		gst_rtsp_server_client_filter(server, clientFilter, nullptr);
-}
-
-void clientClosed(GstRTSPClient* client, gpointer user)
-{
-	printf("RTSP Server - clients closed [%u]\n", --g_clientCount);
-}
-
-void clientConnected(GstRTSPServer* server, GstRTSPClient* client, gpointer user)
+void VideoEncodeTask(VideoEncoderConfig cfg, BaseType_t baseType, string fileName)
 {
-	g_signal_connect(client, "closed", reinterpret_cast<GCallback>(clientClosed), nullptr);
-	printf("RTSP Server - client connected [%u]\n", ++g_clientCount);
-}
-
-static VideoProperties s_videoProperties;
-static GstRTSPServer *s_server = 0;
-
-int gst_rtsp_server_task(int width, int height, int fps)
-{
-	GMainLoop *loop;
-	//GstRTSPServer *server;
-	GstRTSPMountPoints *mounts;
-	GstRTSPMediaFactory *factory;
-
-	s_videoProperties.width = width;
-	s_videoProperties.height = height;
-	s_videoProperties.fps = fps;
-
-	char *args[] = {
-		(char*)"gst-rtsp-server",
-		NULL
-	};
-	int argv = 0;
-	gst_init (&argv, (char ***)&args);
-
-	loop = g_main_loop_new (NULL, FALSE);
-
-	// Set up a signal handler for handling SIGUSR1.
-	g_unix_signal_add(SIGUSR1, HangupSignalCallback, loop);
-	
-	/* create a server instance */
-	s_server = gst_rtsp_server_new ();
-	/* get the mount points for this server, every server has a default object
-	* that be used to map uri mount points to media factories */
-	mounts = gst_rtsp_server_get_mount_points (s_server);
-
-	/* make a media factory for a test stream. The default media factory can use
-	* gst-launch syntax to create pipelines.
-	* any launch line works as long as it contains elements named pay%d. Each
-	* element with pay%d names will be a stream */
-	factory = gst_rtsp_media_factory_new ();
-#ifdef VIDEO_OMXH265ENC
-	gst_rtsp_media_factory_set_launch (factory,
-		"appsrc name=mysrc is-live=true ! video/x-raw, format=(string)BGR ! videoconvert ! \
-omxh265enc insert-sps-pps=1 ! rtph265pay mtu=1400 name=pay0 pt=96 )");
-#else
-	gst_rtsp_media_factory_set_launch (factory,
-		"appsrc name=mysrc is-live=true ! video/x-raw, format=(string)BGR ! videoconvert ! video/x-raw, format=(string)BGRx ! \
-nvvidconv ! video/x-raw(memory:NVMM), format=(string)I420 ! \
-nvv4l2h265enc bitrate=8000000 maxperf-enable=1 ! rtph265pay mtu=1400 name=pay0 pt=96 )");
-//nvv4l2h265enc maxperf-enable=1 iframeinterval=10 bitrate=8000000 ! rtph265pay mtu=1400 name=pay0 pt=96 )");
-#endif
-	gst_rtsp_media_factory_set_eos_shutdown(factory, TRUE);
-	gst_rtsp_media_factory_set_shared (factory, TRUE);
-	/* notify when our media is ready, This is called whenever someone asks for
-	* the media and a new pipeline with our appsrc is created */
-	g_signal_connect (factory, "media-configure", (GCallback) media_configure, &s_videoProperties);
-
-	/* attach the test factory to the /test url */
-	gst_rtsp_mount_points_add_factory (mounts, "/test", factory);
-
-	/* don't need the ref to the mounts anymore */
-	g_object_unref (mounts);
-
-	/* attach the server to the default maincontext */
-	const auto server_id = gst_rtsp_server_attach (s_server, NULL);
-
-	g_signal_connect(s_server, "client-connected", reinterpret_cast<GCallback>(clientConnected), nullptr);
-
-	videoRtspQueue.reset();   
-
-	/* start serving */
-	g_print ("stream ready at rtsp://127.0.0.1:8554/test\n");
-	g_main_loop_run (loop);
-
-	printf("RTSP Server - stopped\n");
-
-	if(g_clientCount.load() > 0)
-		closeClients(s_server);
-
-	g_source_remove(server_id);
-	if(G_IS_OBJECT(s_server))
-		g_object_unref(s_server);
-	s_server = 0;
-	if(G_IS_OBJECT(loop))
-		g_object_unref(loop);
-
-	videoRtspQueue.cancel();
-
-	return 0;
-}
-
-static gboolean remove_func (GstRTSPSessionPool *pool, GstRTSPSession *session, GstRTSPServer *server) {
-  return GST_RTSP_FILTER_REMOVE;
-}
-
-void gst_rtsp_server_close_clients() {
-	if(s_server == 0)
-		return;
+	char typeName = (baseType == BASE_A) ? 'A' : 'B';
 
-	printf("RTSP Server - shutdown\n");
-/*	
-	GstRTSPSessionPool *pool;
-	pool = gst_rtsp_server_get_session_pool(s_server);
-	gst_rtsp_session_pool_filter(pool, (GstRTSPSessionPoolFilterFunc) remove_func, s_server);
-	g_object_unref(pool);
-*/	
-	if(g_clientCount.load() > 0)
-		closeClients(s_server); /* It's chance to hang inside if client running */
-}
-
-static thread rtspServerThread;
-
-/*
-*
-*/
-
-void VideoOutputTask(BaseType_t baseType, bool isVideoOutputScreen, bool isVideoOutputFile, 
-	bool isVideoOutputRTP, const char *rtpRemoteHost, uint16_t rtpRemotePort, 
-	bool isVideoOutputHLS, int width, int height, int fps)
-{    
-	Size videoSize = Size((int)width,(int)height);
-	char gstStr[STR_SIZE];
-
-	VideoWriter outFile;
-	VideoWriter outScreen;
-	VideoWriter outRTP;
-	VideoWriter outHLS;
-	VideoWriter outRTSP;
-
-	int videoOutoutIndex = 0;
-
-	if(isVideoOutputFile) {       
-		char filePath[64];
-		while(videoOutoutIndex < VIDEO_OUTPUT_MAX_FILES) {
-#ifdef VIDEO_OMXH265ENC
-			snprintf(filePath, 64, "%s/%s%c%03d.mkv", VIDEO_OUTPUT_DIR, VIDEO_OUTPUT_FILE_NAME, (baseType == BASE_A) ? 'A' : 'B', videoOutoutIndex);
-#else
-			snprintf(filePath, 64, "%s/%s%c%03d.mp4", VIDEO_OUTPUT_DIR, VIDEO_OUTPUT_FILE_NAME, (baseType == BASE_A) ? 'A' : 'B', videoOutoutIndex);
-#endif
-			FILE *fp = fopen(filePath, "rb");
-			if(fp) { /* file exist ... */
-				fclose(fp);
-				++videoOutoutIndex;
-			} else
-				break; /* File doesn't exist. OK */
-		}
-		if(videoOutoutIndex == VIDEO_OUTPUT_MAX_FILES)
-			videoOutoutIndex = 0; /* Loop */
-		/* Countclockwise rote 90 degree - nvvidconv flip-method=1 */
-#ifdef VIDEO_OMXH265ENC
-		snprintf(gstStr, STR_SIZE, "appsrc ! video/x-raw, format=(string)BGR ! \
-videoconvert ! video/x-raw, format=(string)I420, framerate=(fraction)%d/1 ! \
-omxh265enc preset-level=3 bitrate=8000000 ! h265parse ! qtmux ! filesink location=%s/%s%c%03d.mkv ", 
-			VIDEO_OUTPUT_FPS, VIDEO_OUTPUT_DIR, VIDEO_OUTPUT_FILE_NAME, (baseType == BASE_A) ? 'A' : 'B', videoOutoutIndex);
-#else
-		snprintf(gstStr, STR_SIZE, "appsrc ! video/x-raw, format=(string)BGR ! \
-videoconvert ! video/x-raw, format=(string)BGRx ! \
-nvvidconv ! video/x-raw(memory:NVMM), format=(string)I420, framerate=(fraction)%d/1 ! \
-nvv4l2h265enc bitrate=8000000 maxperf-enable=1 ! h265parse ! qtmux ! filesink location=%s/%s%c%03d.mp4 ",
-						VIDEO_OUTPUT_FPS, VIDEO_OUTPUT_DIR, VIDEO_OUTPUT_FILE_NAME, (baseType == BASE_A) ? 'A' : 'B', videoOutoutIndex);
-#endif
-#if 0 /* NOT work, due to tee */
-		snprintf(gstStr, STR_SIZE, "appsrc ! video/x-raw, format=(string)BGR ! \
-videoconvert ! video/x-raw, format=(string)BGRx ! \
-nvvidconv ! video/x-raw(memory:NVMM), format=(string)I420, framerate=(fraction)%d/1 ! \
-nvv4l2h265enc bitrate=8000000 maxperf-enable=1 ! \
-tee name=t \
-t. ! queue ! h265parse ! qtmux ! filesink location=%s/%s%c%03d.mkv  \
-t. ! queue ! video/x-h265, stream-format=byte-stream ! h265parse ! rtph265pay mtu=1400 ! \
-udpsink host=224.1.1.1 port=5000 auto-multicast=true sync=false async=false ",
-			VIDEO_OUTPUT_FPS, VIDEO_OUTPUT_DIR, VIDEO_OUTPUT_FILE_NAME, (baseType == BASE_A) ? 'A' : 'B', videoOutoutIndex);
-#endif
-		outFile.open(gstStr, VideoWriter::fourcc('X', '2', '6', '4'), 30, videoSize);
-		cout << endl;
-		cout << gstStr << endl;
-		cout << endl;
-		cout << "*** Start record video ***" << endl;
+	if(cfg.isOutput[VIDEO_OUTPUT_FILE]) {
+		/* Name + base type + index, e.g. baseA001.mp4 */
+		cfg.fileFormat = string(VIDEO_OUTPUT_DIR) + "/" + fileName + typeName + "%03d." VIDEO_OUTPUT_FILE_EXT;
+		cfg.fileIndex = NextVideoFileIndex(cfg.fileFormat);
+		cfg.maxFiles = VIDEO_OUTPUT_MAX_FILES;
 	}
 
-	if(isVideoOutputScreen) {
-		snprintf(gstStr, STR_SIZE, "appsrc is-live=true ! video/x-raw, format=(string)BGR ! \
-videoconvert ! video/x-raw, format=(string)I420, framerate=(fraction)%d/1 ! \
-nvvidconv flip-method=3 ! video/x-raw(memory:NVMM) ! \
-nvoverlaysink sync=false ", VIDEO_OUTPUT_FPS);
-		outScreen.open(gstStr, VideoWriter::fourcc('I', '4', '2', '0'), 30, Size(width, height));
-		cout << endl;
-		cout << gstStr << endl;
-		cout << endl;
-		cout << "*** Start display video ***" << endl;
+	if(cfg.isOutput[VIDEO_OUTPUT_CLIP]) { /* e.g. clipA001.mp4 */
+		string clipFormat = string(VIDEO_OUTPUT_DIR) + "/" VIDEO_CLIP_FILE_NAME + typeName + "%03d.mp4";
+		eventRecorder.Start(cfg.clipPreSeconds, cfg.clipPostSeconds, VIDEO_ENCODER_BITRATE, clipFormat, 
+			NextVideoFileIndex(clipFormat), VIDEO_OUTPUT_MAX_FILES);
 	}
 
-	if(isVideoOutputRTP && rtpRemoteHost) {
-#ifdef VIDEO_OMXH265ENC
-		snprintf(gstStr, STR_SIZE, "appsrc ! video/x-raw, format=(string)BGR ! \
-videoconvert ! video/x-raw, format=(string)I420, framerate=(fraction)%d/1 ! \
-omxh264enc control-rate=2 bitrate=4000000 ! video/x-h265, stream-format=byte-stream ! \
-h265parse ! rtph265pay mtu=1400 config-interval=10 pt=96 ! udpsink host=%s port=%u sync=false async=false ",
-			VIDEO_OUTPUT_FPS, rtpRemoteHost, rtpRemotePort);
-#else
-		snprintf(gstStr, STR_SIZE, "appsrc ! video/x-raw, format=(string)BGR ! \
-videoconvert ! video/x-raw, format=(string)BGRx ! \
-nvvidconv ! video/x-raw(memory:NVMM), format=(string)I420, framerate=(fraction)%d/1 ! \
-nvv4l2h265enc bitrate=8000000 maxperf-enable=1 ! video/x-h265, stream-format=byte-stream ! \
-h265parse ! rtph265pay mtu=1400 config-interval=10 pt=96 ! udpsink host=%s port=%u sync=false async=false ",
-			VIDEO_OUTPUT_FPS, rtpRemoteHost, rtpRemotePort);
-#endif
-		outRTP.open(gstStr, VideoWriter::fourcc('X', '2', '6', '4'), VIDEO_OUTPUT_FPS, Size(width, height));
-		cout << endl;
-		cout << gstStr << endl;
-		cout << endl;
-		cout << "*** Start RTP video ***" << endl;        
-	}
+	if(cfg.isOutput[VIDEO_OUTPUT_RTSP] || cfg.isOutput[VIDEO_OUTPUT_CLIP])
+		videoEncoder.EncodedSink(PushEncodedBuffer, 0);
 
-	if(isVideoOutputHLS) {
-#ifdef VIDEO_OMXH265ENC
-		snprintf(gstStr, STR_SIZE, "appsrc is-live=true ! video/x-raw, format=(string)BGR ! \
-videoconvert ! video/x-raw, format=(string)I420, framerate=(fraction)%d/1 ! \
-omxh264enc control-rate=2 bitrate=4000000 ! h264parse ! mpegtsmux ! \
-hlssink playlist-location=/tmp/playlist.m3u8 location=/tmp/segment%%05d.ts target-duration=1 max-files=10 ", VIDEO_OUTPUT_FPS);
-#else
-		snprintf(gstStr, STR_SIZE, "appsrc is-live=true ! video/x-raw, format=(string)BGR ! \
-videoconvert ! video/x-raw, format=(string)BGRx ! \
-nvvidconv ! video/x-raw(memory:NVMM), format=(string)I420, framerate=(fraction)%d/1 ! \
-nvv4l2h265enc bitrate=8000000 maxperf-enable=1 ! h264parse ! mpegtsmux ! \
-hlssink playlist-location=/tmp/playlist.m3u8 location=/tmp/segment%%05d.ts target-duration=1 max-files=10 ", VIDEO_OUTPUT_FPS);
-#endif
-		outHLS.open(gstStr, VideoWriter::fourcc('X', '2', '6', '4'), VIDEO_OUTPUT_FPS, Size(width, height));
-		cout << endl;
-		cout << gstStr << endl;
-		cout << endl;
-		cout << "*** Start HLS video ***" << endl;        
+	if(videoEncoder.Open(cfg) == false) {
+		eventRecorder.Stop(); /* Clip thread and ring go, next start takes its own config */
+		return;
 	}
 
-	videoOutputQueue.reset();
-
-	steady_clock::time_point t1 = steady_clock::now();
+	FrameRing::Cursor cursor;
+	videoFrameRing.Attach(cursor, "encoder");
 
 	try {
+		Mat frame;
+		OverlayPtr overlay;
+		OverlayRenderer renderer; /* Encoder is the only reader of result frames, overlay is drawn in place */
 		while(1) {
 			if(bShutdown)
 				break;
 
-			const Mat & frame = videoOutputQueue.front(); /* Copy frame to avoid frame queue overflow */
+			videoFrameRing.Read(cursor, frame, overlay);
 
-			if(isVideoOutputFile) {
-				if(outFile.isOpened())
-					outFile.write(frame);
+			steady_clock::time_point t0(steady_clock::now()); /* Waiting for frames is not load */
+			if(overlay && overlay->isDraw)
+				renderer.Render(frame, *overlay);
 
-				steady_clock::time_point t2 = steady_clock::now();
-				double secs(static_cast<double>(duration_cast<seconds>(t2 - t1).count()));
-
-				if(secs >= VIDEO_FILE_OUTPUT_DURATION) { /* Reach duration limit, stop record video */
-					cout << endl;
-					cout << "*** Stop record video ***" << endl;
-					outFile.release();
-
-					if(videoOutoutIndex < VIDEO_OUTPUT_MAX_FILES)
-						++videoOutoutIndex;
-					else
-						videoOutoutIndex = 0; /* loop */
-#ifdef VIDEO_OMXH265ENC
-					snprintf(gstStr, STR_SIZE, "appsrc ! video/x-raw, format=(string)BGR ! \
-videoconvert ! video/x-raw, format=(string)I420, framerate=(fraction)%d/1 ! \
-omxh265enc preset-level=3 bitrate=8000000 ! h265parse ! qtmux ! filesink location=%s/%s%c%03d.mkv ", 
-						VIDEO_OUTPUT_FPS, VIDEO_OUTPUT_DIR, VIDEO_OUTPUT_FILE_NAME, (baseType == BASE_A) ? 'A' : 'B', videoOutoutIndex);
-#else
-		snprintf(gstStr, STR_SIZE, "appsrc ! video/x-raw, format=(string)BGR ! \
-videoconvert ! video/x-raw, format=(string)BGRx ! \
-nvvidconv ! video/x-raw(memory:NVMM), format=(string)I420, framerate=(fraction)%d/1 ! \
-nvv4l2h265enc bitrate=8000000 maxperf-enable=1 ! h265parse ! qtmux ! filesink location=%s/%s%c%03d.mp4 ",
-						VIDEO_OUTPUT_FPS, VIDEO_OUTPUT_DIR, VIDEO_OUTPUT_FILE_NAME, (baseType == BASE_A) ? 'A' : 'B', videoOutoutIndex);
-#endif
-
-					outFile.open(gstStr, VideoWriter::fourcc('X', '2', '6', '4'), VIDEO_OUTPUT_FPS, videoSize);
-					cout << endl;
-					cout << gstStr << endl;
-					cout << endl;
-					cout << "*** Start record video ***" << endl;
-
-					t1 = steady_clock::now();
-				}
-			}
+			videoEncoder.Write(frame, overlay.get());
+			overlay.reset(); /* Back to pool */
+			frame.release(); /* Encoder keeps its own reference until converted */
+			s_encodeUs = duration_cast<microseconds>(steady_clock::now() - t0).count();
+		}
+	} catch (FrameRing::cancelled & /*e*/) {
+	}
+	s_encodeUs = 0;
 
-			if(isVideoOutputScreen)
-				outScreen.write(frame);
-			if(isVideoOutputRTP)
-				outRTP.write(frame);
-			if(isVideoOutputHLS)
-				outHLS.write(frame);
+	videoFrameRing.Detach(cursor);
 
-			videoOutputQueue.pop();
-		}
-	} catch (FrameQueue::cancelled & /*e*/) {
-		if(isVideoOutputFile) {
-			cout << endl;
-			cout << "*** Stop record video ***" << endl;
-			outFile.release();
-		}
-		if(isVideoOutputScreen) {
-			cout << endl;
-			cout << "*** Stop display video ***" << endl;
-			outScreen.release();
-		}
-		if(isVideoOutputRTP) {
-			cout << endl;
-			cout << "*** Stop RTP video ***" << endl;
-			outRTP.release();
-		}
-		if(isVideoOutputHLS) {
-			cout << endl;
-			cout << "*** Stop HLS video ***" << endl;
-			outHLS.release();
-		}
-	}    
+	cout << endl;
+	cout << "*** Stop video outputs ***" << endl;
+	videoEncoder.Close();
+	eventRecorder.Stop(); /* After encoder, running clip takes the last frames */
 }
 
 /*
@@ -1589,15 +672,107 @@ static size_t ParseConfigStream(istringstream & iss, vector<pair<string, string>
 *
 */
 
+/*
+* Frame of appsink sample, Mat refers to mapped GstBuffer without copy.
+* The buffer goes back to pool of GStreamer only after Release().
+*/
+
+class CaptureFrame {
+private:
+	GstSample *m_sample;
+	GstBuffer *m_buffer;
+	GstMapInfo m_map;
+	Mat m_mat;
+	Mat m_copy; /* I420 with padded planes, packed here */
+
+	CaptureFrame(const CaptureFrame &) = delete;
+	CaptureFrame & operator=(const CaptureFrame &) = delete;
+
+public:
+	CaptureFrame() : m_sample(0), m_buffer(0) {}
+	~CaptureFrame() { Release(); }
+
+	/* Takes ownership of sample */
+	bool Wrap(GstSample *sample, bool isI420) {
+		Release();
+		m_sample = sample;
+
+		GstVideoInfo info;
+		GstBuffer *buffer = gst_sample_get_buffer(sample);
+		if(buffer == NULL || gst_video_info_from_caps(&info, gst_sample_get_caps(sample)) == FALSE ||
+				gst_buffer_map(buffer, &m_map, GST_MAP_READ) == FALSE) {
+			Release();
+			return false;
+		}
+		m_buffer = buffer;
+
+		int w = GST_VIDEO_INFO_WIDTH(&info);
+		int h = GST_VIDEO_INFO_HEIGHT(&info);
+		if(isI420 == false) {
+			m_mat = Mat(h, w, CV_8UC3, m_map.data + GST_VIDEO_INFO_PLANE_OFFSET(&info, 0), GST_VIDEO_INFO_PLANE_STRIDE(&info, 0));
+			return true;
+		}
+
+		/* cvtColor() takes I420 as Y plane of h rows then U / V planes in h / 2 rows, all without padding */
+		int cw = w / 2, ch = h / 2;
+		if(GST_VIDEO_INFO_PLANE_STRIDE(&info, 0) == w &&
+				GST_VIDEO_INFO_PLANE_STRIDE(&info, 1) == cw && 
+				GST_VIDEO_INFO_PLANE_STRIDE(&info, 2) == cw &&
+				GST_VIDEO_INFO_PLANE_OFFSET(&info, 1) == (gsize)w * h &&
+				GST_VIDEO_INFO_PLANE_OFFSET(&info, 2) == (gsize)w * h + cw * ch) {
+			m_mat = Mat(h + ch, w, CV_8UC1, m_map.data);
+			return true;
+		}
+
+		m_copy.create(h + ch, w, CV_8UC1);
+		for(int y=0;y<h;y++)
+			memcpy(m_copy.ptr<uchar>(y), m_map.data + GST_VIDEO_INFO_PLANE_OFFSET(&info, 0) + y * GST_VIDEO_INFO_PLANE_STRIDE(&info, 0), w);
+		uchar *uv = m_copy.ptr<uchar>(h);
+		for(int p=1;p<=2;p++) {
+			for(int y=0;y<ch;y++) {
+				memcpy(uv, m_map.data + GST_VIDEO_INFO_PLANE_OFFSET(&info, p) + y * GST_VIDEO_INFO_PLANE_STRIDE(&info, p), cw);
+				uv += cw;
+			}
+		}
+		m_mat = m_copy;
+		return true;
+	}
+
+	void Release() {
+		m_mat.release();
+		if(m_buffer) {
+			gst_buffer_unmap(m_buffer, &m_map);
+			m_buffer = 0;
+		}
+		if(m_sample) {
+			gst_sample_unref(m_sample);
+			m_sample = 0;
+		}
+	}
+
+	inline bool Empty() const { return m_mat.empty(); }
+	inline const Mat & Frame() const { return m_mat; }
+	inline GstClockTime Pts() const { return m_buffer ? GST_BUFFER_PTS(m_buffer) : GST_CLOCK_TIME_NONE; }
+};
+
+/*
+*
+*/
+
 class Camera {
 private:
-	VideoCapture cap;
+	GstElement *m_pipeline;
+	GstElement *m_appSink;
 	char gstStr[STR_SIZE];
 	int m_width, m_height;
 	int m_fps;
+	bool m_isLumaCapture; /* I420 to appsink, detection takes Y plane as is */
+	int m_captureBuffers; /* Samples queued in appsink */
+	const char *m_configFile; /* Under CONFIG_FILE_DIR */
 
 public:
 	int sensor_id = 0;
+	string source; /* Video file instead of camera, default null */
 	int wbmode = 0;
 	int tnr_mode = 1;
 	float tnr_strength = -1;
@@ -1609,7 +784,7 @@ public:
 	float exposurecompensation = 0;
 	int exposurethreshold = 5;
 
-	Camera() : m_width(CAMERA_WIDTH), m_height(CAMERA_HEIGHT), m_fps(CAMERA_FPS), sensor_id(0), wbmode(0), tnr_mode(1), tnr_strength(-1), ee_mode(1), ee_strength(-1),
+	Camera() : m_pipeline(0), m_appSink(0), m_width(CAMERA_WIDTH), m_height(CAMERA_HEIGHT), m_fps(CAMERA_FPS), m_isLumaCapture(false), m_captureBuffers(CAPTURE_BUFFERS), m_configFile("camera.config"), sensor_id(0), wbmode(0), tnr_mode(1), tnr_strength(-1), ee_mode(1), ee_strength(-1),
 		gainrange("1 16"), ispdigitalgainrange("1 8"), exposuretimerange("5000000 10000000"),
 		exposurecompensation(0), exposurethreshold(5) {
 	}
@@ -1627,8 +802,15 @@ public:
 	}
 
 	bool Open() {
-		if(cap.isOpened())
+		if(m_pipeline)
 			return true;
+
+		/* Frames in flight hold their buffers, converter needs enough output buffers not to stall */
+		int outputBuffers = m_captureBuffers + NUM_FRAME_SLOTS + 2;
+
+		const char *outputCaps = m_isLumaCapture ?
+			"video/x-raw, format=(string)I420" : /* No BGRx / BGR conversion, BGR is made from I420 only if output needs it */
+			"video/x-raw, format=(string)BGRx ! videoconvert ! video/x-raw, format=(string)BGR";
 /* Reference : nvarguscamerasrc.txt */
 /* export GST_DEBUG=2 to show debug message */
 #if 0
@@ -1637,18 +819,26 @@ video/x-raw(memory:NVMM), width=(int)%d, height=(int)%d, format=(string)NV12, fr
 nvvidconv flip-method=3 ! video/x-raw, format=(string)BGRx ! videoconvert ! video/x-raw, format=(string)BGR ! appsink max-buffers=1 drop=true ", 
 		m_height, m_width, CAMERA_FPS);
 #else
-		if(sensor_id < 2) {
+		if(source.size() > 0) { /* Video file in real time, no camera needed */
+			snprintf(gstStr, STR_SIZE, "filesrc location=%s ! decodebin ! videoconvert ! videoscale ! videorate ! \
+video/x-raw, width=(int)%d, height=(int)%d, framerate=(fraction)%d/1 ! videoconvert ! %s ! appsink name=sink max-buffers=%d drop=true sync=true", 
+				source.c_str(), m_width, m_height, m_fps, outputCaps, m_captureBuffers);
+		} else if(sensor_id < 0) { /* Test pattern, no camera needed */
+			snprintf(gstStr, STR_SIZE, "videotestsrc is-live=true pattern=ball ! \
+video/x-raw, width=(int)%d, height=(int)%d, framerate=(fraction)%d/1 ! videoconvert ! %s ! appsink name=sink max-buffers=%d drop=true sync=false", 
+				m_width, m_height, m_fps, outputCaps, m_captureBuffers);
+		} else if(sensor_id < 2) {
 			snprintf(gstStr, STR_SIZE, "nvarguscamerasrc sensor-id=%d wbmode=%d tnr-mode=%d tnr-strength=%f ee-mode=%d ee-strength=%f gainrange=%s ispdigitalgainrange=%s exposuretimerange=%s exposurecompensation=%f ! \
 video/x-raw(memory:NVMM), width=(int)%d, height=(int)%d, format=(string)NV12, framerate=(fraction)%d/1 ! \
-nvvidconv flip-method=3 ! video/x-raw, format=(string)BGRx ! videoconvert ! video/x-raw, format=(string)BGR ! appsink max-buffers=1 drop=true ", 
+nvvidconv flip-method=3 output-buffers=%d ! %s ! appsink name=sink max-buffers=%d drop=true sync=false ", 
 				sensor_id, wbmode, tnr_mode, tnr_strength, ee_mode, ee_strength, gainrange.c_str(), ispdigitalgainrange.c_str(), exposuretimerange.c_str(), exposurecompensation,
-				m_height, m_width, m_fps);
+				m_height, m_width, m_fps, outputBuffers, outputCaps, m_captureBuffers);
 		} else { /* USB camera - MJPG */
 			snprintf(gstStr, STR_SIZE, "v4l2src device=/dev/video%d io-mode=2 ! image/jpeg, width=(int)%d, height=(int)%d, framerate=(fraction)%d/1 ! \
 nvv4l2decoder mjpeg=1 ! \
-nvvidconv flip-method=3 ! video/x-raw,format=BGRx ! videoconvert ! video/x-raw, format=(string)BGR ! appsink max-buffers=1 drop=true", 
+nvvidconv flip-method=3 output-buffers=%d ! %s ! appsink name=sink max-buffers=%d drop=true sync=false", 
 				sensor_id, 
-				m_height, m_width, m_fps);			
+				m_height, m_width, m_fps, outputBuffers, outputCaps, m_captureBuffers);			
 		}
 #endif
 
@@ -1665,7 +855,20 @@ t. ! nvvidconv flip-method=3 ! video/x-raw, format=(string)BGRx ! videoconvert !
 		cout << gstStr << endl;
 		cout << endl;
 
-		if(!cap.open(gstStr, cv::CAP_GSTREAMER)) {
+		gst_init(NULL, NULL);
+
+		GError *error = NULL;
+		m_pipeline = gst_parse_launch(gstStr, &error);
+		if(error) {
+			cout << error->message << endl;
+			g_error_free(error);
+		}
+		if(m_pipeline)
+			m_appSink = gst_bin_get_by_name(GST_BIN(m_pipeline), "sink");
+
+		if(m_appSink == NULL || 
+				gst_element_set_state(m_pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+			Close();
 			cout << endl;
 			cout << "!!! Could not open video" << endl;
 			return false;
@@ -1674,15 +877,29 @@ t. ! nvvidconv flip-method=3 ! video/x-raw, format=(string)BGRx ! videoconvert !
 		return true;
 	}
 
+	/* All CaptureFrame must be released before */
 	void Close() {
-		if(cap.isOpened())
-			cap.release();
+		if(m_pipeline)
+			gst_element_set_state(m_pipeline, GST_STATE_NULL);
+		if(m_appSink) {
+			gst_object_unref(m_appSink);
+			m_appSink = 0;
+		}
+		if(m_pipeline) {
+			gst_object_unref(m_pipeline);
+			m_pipeline = 0;
+		}
 	}
 
-	inline bool Read(OutputArray & a) { 
-		bool r = cap.read(a);
-		//cout << "timestamp : " << cap.get(CAP_PROP_POS_MSEC) << endl;
-		return r;
+	inline bool Read(CaptureFrame & frame) { 
+		if(m_appSink == NULL)
+			return false;
+		GstSample *sample = gst_app_sink_try_pull_sample(GST_APP_SINK(m_appSink), CAPTURE_TIMEOUT_MS * GST_MSECOND);
+		if(sample == NULL) { /* Timeout or EOS */
+			frame.Release();
+			return false;
+		}
+		return frame.Wrap(sample, m_isLumaCapture);
 	}
 
 	void ApplyConfig(vector<pair<string, string> > & cfg)
@@ -1694,6 +911,8 @@ t. ! nvvidconv flip-method=3 ! video/x-raw, format=(string)BGRx ! videoconvert !
 			cout << it->first << " = " << it->second << endl;
 			if(it->first == "sensor-id")
 				sensor_id = stoi(it->second);
+			else if(it->first == "source")
+				source = it->second;
 			else if(it->first == "wbmode")
 				wbmode = stoi(it->second);
 			else if(it->first == "tnr-mode")
@@ -1719,7 +938,6 @@ t. ! nvvidconv flip-method=3 ! video/x-raw, format=(string)BGRx ! videoconvert !
 	}
 
 	const char *defaultConfig = "# White balence 0 : off / 1 : auto\n\
-sensor-id=0\n\
 wbmode=1\n\
 tnr-mode=2\n\
 tnr-strength=-1\n\
@@ -1735,12 +953,13 @@ exposurethreshold=3\n";
 
 	void LoadConfig() {
 		char fn[STR_SIZE];
-		snprintf(fn, STR_SIZE, "%s/camera.config", CONFIG_FILE_DIR);
+		snprintf(fn, STR_SIZE, "%s/%s", CONFIG_FILE_DIR, m_configFile);
 		ifstream in(fn);
 		if(in.is_open() == false){
 			cout << "!!! Load default config" << endl;
 			ofstream out(fn);
 			if(out.is_open()) {
+				out << "sensor-id=" << sensor_id << endl; /* Second camera defaults to sensor 1 */
 				out << defaultConfig;
 				out.close();
 			}
@@ -1754,7 +973,7 @@ exposurethreshold=3\n";
 
 	void SaveConfig(string s) {
 		char fn[STR_SIZE];
-		snprintf(fn, STR_SIZE, "%s/camera.config", CONFIG_FILE_DIR);
+		snprintf(fn, STR_SIZE, "%s/%s", CONFIG_FILE_DIR, m_configFile);
 		ofstream out(fn);
 		if(out.is_open()) {
 			out << s;
@@ -1859,11 +1078,20 @@ nvvidconv flip-method=2 ! video/x-raw, format=(string)BGRx ! videoconvert ! vide
 	int Height() const { return m_height; }
 	int Fps() const { return m_fps; }
 
+	void LumaCapture(bool isLumaCapture) { m_isLumaCapture = isLumaCapture; } /* Takes effect on next Open() */
+	bool IsLumaCapture() const { return m_isLumaCapture; }
+
+	void CaptureBuffers(int captureBuffers) { m_captureBuffers = captureBuffers; } /* Takes effect on next Open() */
+
+	/* Config file name under CONFIG_FILE_DIR and sensor-id of its default config */
+	void ConfigFile(const char *name, int sensorId) { m_configFile = name; sensor_id = sensorId; }
+
 	int ExposureThreshold() const { return exposurethreshold; }
 };
 
 //static Camera camera(CAMERA_WIDTH, CAMERA_HEIGHT, CAMERA_FPS);
 static Camera camera;
+static Camera camera1; /* Second camera of dual camera mode, camera1.config */
 
 /*
 *
@@ -1940,6 +1168,11 @@ private:
 	bool m_isVideoOutputHLS;
 	bool m_isVideoOutputRTSP;
 	bool m_isVideoOutputResult;
+	bool m_isVideoOutputClip; /* Event clips around triggers instead of recording everything */
+	uint8_t m_clipPreSeconds;
+	uint8_t m_clipPostSeconds;
+	uint16_t m_videoFileDuration; /* Seconds of recorded segment */
+	string m_videoFileName; /* Recorded files are name + base type + index */
 
 	uint16_t m_udpLocalPort;
 
@@ -1947,11 +1180,21 @@ private:
 	uint16_t m_rtpRemotePort;
 
 	uint8_t m_mog2_threshold; /* 0 ~ 64 / Most senstive is 0 / Default 16 */
+	BackendType_t m_backendType; /* Compute backend of detection, CPU keeps GPU for encoders */
+	bool m_isLumaCapture; /* Capture I420, BGR only for video output */
+	uint8_t m_captureBuffers; /* Samples queued in appsink */
+	bool m_isDualCamera; /* camera and camera1 at once */
+	TriggerMode_t m_triggerMode; /* Combined trigger of dual camera */
+	uint8_t m_preferredCamera;
 	bool m_isNewTargetRestriction;
 	bool m_isFakeTargetDetection;
 	bool m_isBugTrigger;
 	uint16_t m_relayDebouence;
 	uint16_t m_horizonRatio;
+	Rect m_processRegion; /* Detection region, empty is whole frame */
+	bool m_isAutoProcessRegion; /* Detection region above horizon */
+	uint8_t m_pyramidScale; /* Coarse level of detection, 1 is full resolution */
+	uint16_t m_minCoarseArea; /* 0 is half of minimum target */
 	bool m_isBuzzer;
 
 	thread m_udpServerThread;
@@ -2079,14 +1322,28 @@ public:
 		m_isVideoOutputHLS(false),
 		m_isVideoOutputRTSP(false),
 		m_isVideoOutputResult(false),
+		m_isVideoOutputClip(false),
+		m_clipPreSeconds(5),
+		m_clipPostSeconds(5),
+		m_videoFileDuration(VIDEO_FILE_OUTPUT_DURATION),
+		m_videoFileName(VIDEO_OUTPUT_FILE_NAME),
 		m_udpLocalPort(4999), 
 		m_rtpRemotePort(5000),
 		m_mog2_threshold(16),
+		m_backendType(BACKEND_AUTO),
+		m_isLumaCapture(false),
+		m_captureBuffers(CAPTURE_BUFFERS),
+		m_isDualCamera(false),
+		m_triggerMode(TRIGGER_EITHER),
+		m_preferredCamera(0),
 		m_isNewTargetRestriction(false),
 		m_isFakeTargetDetection(false),
 		m_isBugTrigger(false),
 		m_relayDebouence(800),
 		m_horizonRatio(20),
+		m_isAutoProcessRegion(false),
+		m_pyramidScale(1),
+		m_minCoarseArea(0),
 		m_isBuzzer(true),
 		m_bUdpServerRun(false),
 		m_srcIp(0), m_srcPort(0),
@@ -2548,6 +1805,10 @@ public:
 						WriteSourceUdpSocket(reinterpret_cast<const uint8_t *>(stopped), strlen(stopped));
 					else
 						WriteSourceUdpSocket(reinterpret_cast<const uint8_t *>(started), strlen(started));
+				} else if(line == "#LoadLevel") {
+					string raw("#LoadLevel:");
+					raw.append(to_string(governor.Level()));
+					WriteSourceUdpSocket(reinterpret_cast<const uint8_t *>(raw.c_str()), raw.size());
 				} else if(line == "#CompassLock") {
 					const uint8_t cmd[] = {0xff, 0xaa, 0x69, 0x88, 0xb5}; /* Enter command mode */
 					WriteTty(m_jy901Fd, cmd, 5);
@@ -3028,6 +2289,40 @@ public:
 						cout << "Out of range " << it->first << "=" << s << endl;
 				} else
 					cout << "Invalid " << it->first << "=" << s << endl;
+			} else if(it->first == "base.backend") { /* Compute backend of detection, auto / cpu / cuda */
+				if(ParseBackendType(it->second, m_backendType) == false)
+					cout << "Invalid " << it->first << "=" << it->second << endl;
+			} else if(it->first == "base.mog2.cpu") { /* Old config, same as base.backend=cpu */
+				if(it->second == "yes" || it->second == "1")
+					m_backendType = BACKEND_CPU;
+			} else if(it->first == "base.capture.luma") { /* Detection on Y plane of camera, no BGR round trip */
+				if(it->second == "yes" || it->second == "1")
+					m_isLumaCapture = true;
+				else
+					m_isLumaCapture = false;
+			} else if(it->first == "base.camera.dual") { /* camera.config and camera1.config processed at once */
+				if(it->second == "yes" || it->second == "1")
+					m_isDualCamera = true;
+				else
+					m_isDualCamera = false;
+			} else if(it->first == "base.trigger.mode") { /* either / both / preferred */
+				if(TriggerCombiner::ParseMode(it->second, m_triggerMode) == false)
+					cout << "Invalid " << it->first << "=" << it->second << endl;
+			} else if(it->first == "base.trigger.preferred") {
+				if(it->second == "0" || it->second == "1")
+					m_preferredCamera = stoi(it->second);
+				else
+					cout << "Invalid " << it->first << "=" << it->second << endl;
+			} else if(it->first == "base.capture.buffers") {
+				string & s = it->second;
+				if(::all_of(s.begin(), s.end(), ::isdigit)) {
+					int v = stoi(s);
+					if(v >= 1 && v <= MAX_CAPTURE_BUFFERS)
+						m_captureBuffers = v;
+					else
+						cout << "Out of range " << it->first << "=" << s << endl;
+				} else
+					cout << "Invalid " << it->first << "=" << s << endl;
 			} else if(it->first == "base.rtp.remote.host") {
 				if(IsValidateIpAddress(it->second))
 					m_rtpRemoteHost = it->second;
@@ -3067,6 +2362,40 @@ public:
 					m_isVideoOutputResult = true;
 				else
 					m_isVideoOutputResult = false;
+			} else if(it->first == "video.output.clip") {
+				if(it->second == "yes" || it->second == "1")
+					m_isVideoOutputClip = true;
+				else
+					m_isVideoOutputClip = false;
+			} else if(it->first == "video.output.clip.pre" || it->first == "video.output.clip.post") { /* Seconds */
+				string & s = it->second;
+				if(::all_of(s.begin(), s.end(), ::isdigit)) {
+					int v = stoi(s);
+					if(v >= 1 && v <= 60) {
+						if(it->first == "video.output.clip.pre")
+							m_clipPreSeconds = v;
+						else
+							m_clipPostSeconds = v;
+					} else
+						cout << "Out of range " << it->first << "=" << s << endl;
+				} else
+					cout << "Invalid " << it->first << "=" << s << endl;
+			} else if(it->first == "video.output.file.duration") { /* Seconds */
+				string & s = it->second;
+				if(::all_of(s.begin(), s.end(), ::isdigit)) {
+					int v = stoi(s);
+					if(v >= 10 && v <= 3600)
+						m_videoFileDuration = v;
+					else
+						cout << "Out of range " << it->first << "=" << s << endl;
+				} else
+					cout << "Invalid " << it->first << "=" << s << endl;
+			} else if(it->first == "video.output.file.name") { /* Letters, digits, '-' and '_' */
+				string & s = it->second;
+				if(!s.empty() && ::all_of(s.begin(), s.end(), [](char c) { return ::isalnum(c) || c == '-' || c == '_'; }))
+					m_videoFileName = s;
+				else
+					cout << "Invalid " << it->first << "=" << s << endl;
 			} else if(it->first == "base.relay.debouence") {
 				string & s = it->second;
 				if(::all_of(s.begin(), s.end(), ::isdigit))
@@ -3079,6 +2408,32 @@ public:
 					m_horizonRatio = stoi(s);
 				else
 					cout << "Invalid " << it->first << "=" << s << endl;			
+			} else if(it->first == "base.process.region") { /* full / auto / x,y,width,height */
+				string & s = it->second;
+				int x, y, w, h;
+				if(s == "full") {
+					m_processRegion = Rect();
+					m_isAutoProcessRegion = false;
+				} else if(s == "auto") {
+					m_processRegion = Rect();
+					m_isAutoProcessRegion = true;
+				} else if(sscanf(s.c_str(), "%d,%d,%d,%d", &x, &y, &w, &h) == 4 && w > 0 && h > 0) {
+					m_processRegion = Rect(x, y, w, h);
+					m_isAutoProcessRegion = false;
+				} else
+					cout << "Invalid " << it->first << "=" << s << endl;
+			} else if(it->first == "base.detect.pyramid") { /* 1 / 2 / 4 */
+				string & s = it->second;
+				if(s == "1" || s == "2" || s == "4")
+					m_pyramidScale = stoi(s);
+				else
+					cout << "Invalid " << it->first << "=" << s << endl;
+			} else if(it->first == "base.detect.pyramid.min.area") {
+				string & s = it->second;
+				if(::all_of(s.begin(), s.end(), ::isdigit))
+					m_minCoarseArea = stoi(s);
+				else
+					cout << "Invalid " << it->first << "=" << s << endl;
 			} else if(it->first == "base.buzzer") {
 				if(it->second == "yes" || it->second == "1")
 					m_isBuzzer = true;
@@ -3097,10 +2452,24 @@ video.output.rtp=no\n\
 video.output.hls=no\n\
 video.output.rtsp=yes\n\
 video.output.result=no\n\
+video.output.clip=no\n\
+video.output.clip.pre=5\n\
+video.output.clip.post=5\n\
+video.output.file.duration=90\n\
+video.output.file.name=base\n\
 base.mog2.threshold=32\n\
+base.backend=auto\n\
+base.capture.luma=no\n\
+base.capture.buffers=2\n\
+base.camera.dual=no\n\
+base.trigger.mode=either\n\
+base.trigger.preferred=0\n\
 base.new.target.restriction=no\n\
 base.relay.debouence=800\n\
 base.horizon.ratio=20\n\
+base.process.region=full\n\
+base.detect.pyramid=1\n\
+base.detect.pyramid.min.area=0\n\
 base.buzzer=yes";
 
 	void LoadSystemConfig() {
@@ -3164,7 +2533,7 @@ base.buzzer=yes";
 	}
 
 	inline bool IsVideoOutput() const {
-		return (m_isVideoOutputScreen || m_isVideoOutputFile || m_isVideoOutputRTP || m_isVideoOutputHLS);
+		return (m_isVideoOutputScreen || m_isVideoOutputFile || m_isVideoOutputRTP || m_isVideoOutputHLS || m_isVideoOutputClip);
 	}
 
 	inline bool IsVideoOutputRTSP() const {
@@ -3175,10 +2544,54 @@ base.buzzer=yes";
 		return m_isVideoOutputResult;
 	}
 
+	inline bool IsVideoOutputClip() const {
+		return m_isVideoOutputClip;
+	}
+
+	inline uint8_t ClipPreSeconds() const {
+		return m_clipPreSeconds;
+	}
+
+	inline uint8_t ClipPostSeconds() const {
+		return m_clipPostSeconds;
+	}
+
+	inline uint16_t VideoFileDuration() const {
+		return m_videoFileDuration;
+	}
+
+	inline const string & VideoFileName() const {
+		return m_videoFileName;
+	}
+
 	inline uint8_t Mog2Threshold() const {
 		return m_mog2_threshold;
 	}
 
+	inline BackendType_t Backend() const {
+		return m_backendType;
+	}
+
+	inline bool IsLumaCapture() const {
+		return m_isLumaCapture;
+	}
+
+	inline bool IsDualCamera() const {
+		return m_isDualCamera;
+	}
+
+	inline TriggerMode_t TriggerMode() const {
+		return m_triggerMode;
+	}
+
+	inline uint8_t PreferredCamera() const {
+		return m_preferredCamera;
+	}
+
+	inline uint8_t CaptureBuffers() const {
+		return m_captureBuffers;
+	}
+
 	inline bool IsNewTargetRestriction() const {
 		return m_isNewTargetRestriction;
 	}
@@ -3199,6 +2612,22 @@ base.buzzer=yes";
 		return m_horizonRatio;
 	}
 
+	inline const Rect & ProcessRegion() const {
+		return m_processRegion;
+	}
+
+	inline bool IsAutoProcessRegion() const {
+		return m_isAutoProcessRegion;
+	}
+
+	inline uint8_t PyramidScale() const {
+		return m_pyramidScale;
+	}
+
+	inline uint16_t MinCoarseArea() const {
+		return m_minCoarseArea;
+	}
+
 	inline bool IsBuzzer() const {
 		return m_isBuzzer;
 	}
@@ -3287,90 +2716,540 @@ int progress_func(void* ptr, double TotalToDownload, double NowDownloaded, doubl
 *
 */
 
-static Size minTargetSize(MIN_TARGET_WIDTH, MIN_TARGET_HEIGHT);
-static Size maxTargetSize(MAX_TARGET_WIDTH, MAX_TARGET_HEIGHT);
-
 void F3xBase::Initialisize()
 {
 	switch(f3xBase.m_jetsonDevice) {
 		case JETSON_NANO:
 			camera.Initialisize(720, 1280, 30); /* 720p */
 			tracker.Initialisize(720, 1280);
-			minTargetSize.width = 6;
-			minTargetSize.height = 8;
-			maxTargetSize.width = 320;
-			maxTargetSize.height = 320;
+			detector.Initialisize(720, 1280);
+			camera1.Initialisize(720, 1280, 30);
+			tracker1.Initialisize(720, 1280);
+			detector1.Initialisize(720, 1280);
 			break;
 		case JETSON_XAVIER_NX:
 			camera.Initialisize(1080, 1920, 30); /* 1080p */
 			tracker.Initialisize(1080, 1920);
 			//camera.Initialisize(720, 1280, 60); /* 720p60 */
 			//tracker.Initialisize(720, 1280);
-			minTargetSize.width = 9;
-			minTargetSize.height = 12;
-			maxTargetSize.width = 480;
-			maxTargetSize.height = 480;
+			detector.Initialisize(1080, 1920);
+			camera1.Initialisize(1080, 1920, 30);
+			tracker1.Initialisize(1080, 1920);
+			detector1.Initialisize(1080, 1920);
 			break;
 	}
 }
 
-static Ptr<cuda::BackgroundSubtractorMOG2> bsModel;
-#if 0
-static Ptr<cuda::Filter> erodeFilter;
-static Ptr<cuda::Filter> dilateFilter;
-#else
-static Mat elementErode;
-static Mat elementDilate;
-#endif
+static thread videoEncodeThread;
 
-static thread videoOutputThread;
+/*
+* Capture -> Detection -> Tracking & trigger pipeline, each stage is a thread.
+* Preallocated frame slots go around through lock free rings : free -> captured -> detected -> free
+* Throughput is bound by the slowest stage instead of sum of all stages.
+*/
 
-void F3xBase::Start()
+typedef struct {
+	uint64_t seq; /* Frame sequence number from capture */
+	unsigned long frameTick; /* Frame periods from PTS of first frame, time base of tracker */
+	steady_clock::time_point captureTime;
+	bool isLuma; /* Luma capture, frame is I420 otherwise BGR */
+	CaptureFrame frame; /* Held until tracking is done with the slot */
+	Mat grayFrame; /* Y plane of frame in luma capture */
+	Rect processRect; /* Processing region of detection */
+	list<Rect> roiRect;
+	long captureUs, detectUs; /* Stage time, waiting excluded */
+} FrameSlot;
+
+/*
+* Camera with its own detector, tracker and pipeline threads. Camera 0 feeds video outputs and load governor,
+* trigger decision of all cameras is combined by triggerCombiner.
+*/
+
+class CameraChannel {
+public:
+	const int index;
+	Camera & camera;
+	Detector & detector;
+	Tracker & tracker;
+	FrameSlot frameSlots[NUM_FRAME_SLOTS];
+	SpscRing<uint8_t, NUM_FRAME_SLOTS> freeSlots; /* Tracking -> Capture */
+	SpscRing<uint8_t, NUM_FRAME_SLOTS> capturedSlots; /* Capture -> Detection */
+	SpscRing<uint8_t, NUM_FRAME_SLOTS> detectedSlots; /* Detection -> Tracking */
+	std::atomic<uint64_t> droppedFrames;
+	unsigned long lastFrameTick; /* Ticks go on over stop / start as tracker keeps its targets */
+	thread captureThread, detectionThread, trackingThread;
+
+	CameraChannel(int i, Camera & c, Detector & d, Tracker & t) : index(i), camera(c), detector(d), tracker(t), droppedFrames(0), lastFrameTick(0) {}
+
+	inline bool IsPrimary() const { return index == 0; }
+};
+
+static CameraChannel channels[NUM_CAMERA] = { { 0, camera, detector, tracker }, { 1, camera1, detector1, tracker1 } };
+static int s_numCamera = 1; /* Channels running, 2 in dual camera mode */
+static std::atomic<bool> bPipelineRun(false);
+static TriggerCombiner triggerCombiner;
+static FramePool outFramePool; /* Result frames, recycled once video outputs release them */
+static OverlayPool overlayPool; /* Overlay records of result frames */
+
+/* BGR of frame, luma capture converts from I420 here only when an output needs it */
+static void CopyBgrFrame(const FrameSlot & fs, Mat & dst)
 {
-	camera.UpdateExposure();
+	if(fs.isLuma)
+		cvtColor(fs.frame.Frame(), dst, COLOR_YUV2BGR_I420);
+	else
+		fs.frame.Frame().copyTo(dst);
+}
+
+static inline void PipelineWait()
+{
+	std::this_thread::sleep_for(std::chrono::microseconds(PIPELINE_WAIT_US));
+}
+
+static void CaptureTask(CameraChannel & ch)
+{
+	uint64_t seq = 0;
+	CaptureFrame dropFrame;
+	bool isLuma = ch.camera.IsLumaCapture();
+	GstClockTime period = GST_SECOND / ch.camera.Fps();
+	GstClockTime basePts = GST_CLOCK_TIME_NONE;
+	unsigned long baseTick = ch.lastFrameTick + 1;
+	unsigned long lastTick = ch.lastFrameTick;
+	bool isPending = false; /* Slot i popped but not captured yet, tracking thread is the only producer of freeSlots */
+	uint8_t i = 0;
+
+	while(bPipelineRun) {
+		if(isPending == false) {
+			if(ch.freeSlots.Pop(i) == false) { /* All slots in flight, keep camera drained and drop the frame */
+				ch.camera.Read(dropFrame); /* Counted as PTS gap of next frame */
+				dropFrame.Release();
+				seq++;
+				continue;
+			}
+			isPending = true;
+		}
+
+		FrameSlot & fs = ch.frameSlots[i];
+		if(ch.camera.Read(fs.frame) == false) { /* Retry into the same slot */
+			PipelineWait();
+			continue;
+		}
+		isPending = false;
+		fs.captureTime = steady_clock::now();
+		fs.seq = seq++;
+		fs.isLuma = isLuma;
+
+		/* Frames dropped by appsink or by this thread leave a gap of PTS */
+		GstClockTime pts = fs.frame.Pts();
+		unsigned long tick = lastTick + 1;
+		if(GST_CLOCK_TIME_IS_VALID(pts)) {
+			if(GST_CLOCK_TIME_IS_VALID(basePts) == false)
+				basePts = pts; /* First frame is baseTick */
+			if(pts >= basePts) {
+				unsigned long t = baseTick + (pts - basePts + period / 2) / period;
+				if(t > lastTick) /* Jitter never goes backward */
+					tick = t;
+			}
+		}
+		if(tick > lastTick + 1 && lastTick >= baseTick) {
+			ch.droppedFrames += tick - lastTick - 1;
+			dprintf("[X] camera %d : %lu frames dropped before #%lu\n", ch.index, tick - lastTick - 1, tick);
+		}
+		fs.frameTick = tick;
+		lastTick = tick;
+
+		if(isLuma) { /* I420 is Y plane of full height then U / V planes of quarter size, Y is gray frame as is */
+			fs.grayFrame = fs.frame.Frame().rowRange(0, fs.frame.Frame().rows * 2 / 3);
+			fs.captureUs = 0;
+			ch.capturedSlots.Push(i);
+			continue;
+		}
+
+		/* Gray color space for whole region */
+		ch.detector.Backend().CvtColor(fs.frame.Frame(), fs.grayFrame, COLOR_BGR2GRAY);
+		fs.captureUs = duration_cast<microseconds>(steady_clock::now() - fs.captureTime).count();
+		ch.capturedSlots.Push(i);
+	}
+
+	ch.lastFrameTick = lastTick;
+}
+
+static void DetectionTask(CameraChannel & ch)
+{
+	while(bPipelineRun) {
+		uint8_t i;
+		if(ch.capturedSlots.Pop(i) == false) {
+			PipelineWait();
+			continue;
+		}
+
+		steady_clock::time_point t0(steady_clock::now());
+
+		LoadLevel_t loadLevel = governor.Level();
+		ch.detector.ShrinkRegion(loadLevel >= LOAD_LEVEL_SHRINK_REGION);
+		ch.detector.HalfResolutionBand(loadLevel >= LOAD_LEVEL_HALF_RESOLUTION_BAND);
+
+		FrameSlot & fs = ch.frameSlots[i];
+		fs.roiRect.clear();
+		fs.processRect = ch.detector.ProcessRect(fs.grayFrame.size());
+		ch.detector.ExtractMovingObject(fs.grayFrame, fs.roiRect);
+		fs.detectUs = duration_cast<microseconds>(steady_clock::now() - t0).count();
 
-	if(camera.Open() == false) {
-		s_errorString = "Camera";
-		f3xBase.Error(s_errorString.c_str());
-		bStopped = true;
+		ch.detectedSlots.Push(i);
+	}
+}
+
+/*
+* Relay, red led and trigger messages are shared by all cameras, the camera fired last turns them off on its next frame
+*/
+
+static std::mutex triggerMutex;
+static steady_clock::time_point s_lastTriggerTime, s_lastRelayTriggerTime;
+static int s_triggerOwner = 0;
+
+static void ResetTrigger()
+{
+	s_lastTriggerTime = steady_clock::now();
+	s_lastRelayTriggerTime = steady_clock::now();
+	s_triggerOwner = 0;
+}
+
+static void ReleaseTrigger(int camera)
+{
+	std::unique_lock<std::mutex> mlock(triggerMutex);
+
+	if(camera != s_triggerOwner)
 		return;
+	f3xBase.RedLed(off);
+	f3xBase.Relay(off);
+}
+
+static void FireTrigger(int camera, uint8_t & doTriggerCount)
+{
+	std::unique_lock<std::mutex> mlock(triggerMutex);
+
+	s_triggerOwner = camera;
+
+	long long duration = duration_cast<milliseconds>(steady_clock::now() - s_lastRelayTriggerTime).count();
+	//printf("duration = %lld\n" , duration);
+	if(duration > f3xBase.RelayDebouence()) {
+		f3xBase.Relay(on);
+		s_lastRelayTriggerTime = steady_clock::now();
 	}
 
-	tracker.UpdateHorizonRatio(f3xBase.HorizonRatio());
+	bool isNewTrigger = false;
+	duration = duration_cast<milliseconds>(steady_clock::now() - s_lastTriggerTime).count();
+	if(duration > 330) /* new trigger */
+		isNewTrigger = true;
 
-	if(f3xBase.IsNewTargetRestriction())
-		tracker.NewTargetRestriction(Rect(180, camera.Height() - 180, 360, 180));
-	else
-		tracker.NewTargetRestriction(Rect());
+	if(isNewTrigger)
+		doTriggerCount = MAX_NUM_TRIGGER;
+
+	s_lastTriggerTime = steady_clock::now();
+
+	f3xBase.TriggerMulticastSocket(isNewTrigger);
+	f3xBase.TriggerSourceUdpSocket(isNewTrigger);
+	f3xBase.TriggerTtyTHSx(isNewTrigger);			
+	f3xBase.TriggerTtyUSB0(isNewTrigger);
+	if(isNewTrigger) /* Only marks a clip pending, clip thread opens it */
+		eventRecorder.Trigger();
+	if(f3xBase.IsBuzzer())
+		f3xBase.RedLed(on);
+
+	if(doTriggerCount > 0)
+		doTriggerCount--;
+}
+
+static void TrackingTask(CameraChannel & ch)
+{
+	int cx = (ch.camera.Width() / 2) - 1;
+
+	double fps = CAMERA_FPS;
+	double dt_us = 1000000.0 / CAMERA_FPS;
+	steady_clock::time_point t1(steady_clock::now());
+	uint64_t frameCount = 0;
+	unsigned long allocationBase = 0; /* Large allocations after the first second are not expected */
+	Mat lastOutFrame; /* Repeated by half output fps */
+	bool isOutput = ch.IsPrimary() && (f3xBase.IsVideoOutput() || f3xBase.IsVideoOutputRTSP());
+
+	uint8_t doTriggerCount = 0;
+
+	while(bPipelineRun) {
+		uint8_t i;
+		if(ch.detectedSlots.Pop(i) == false) {
+			PipelineWait();
+			continue;
+		}
+
+		steady_clock::time_point t0(steady_clock::now());
+
+		FrameSlot & fs = ch.frameSlots[i];
+		list<Rect> & roiRect = fs.roiRect;
+
+		frameCount++;
+
+		/* Overlay drawing is the first to go, encoders run at fixed frame rate so half output fps repeats frames */
+		LoadLevel_t loadLevel = governor.Level();
+		bool isResult = isOutput && f3xBase.IsVideoOutputResult() && loadLevel < LOAD_LEVEL_NO_OVERLAY;
+		bool isRepeatOutput = loadLevel >= LOAD_LEVEL_HALF_OUTPUT_FPS && (frameCount & 1) && lastOutFrame.empty() == false;
+
+		if(ch.IsPrimary() == false) {
+		} else if(frameCount % 2 == 0) {
+			f3xBase.GreenLed(on); /* Flash during frames */
+			if(f3xBase.IsVideoOutputFile())
+				f3xBase.BlueLed(on);
+		} else {
+			f3xBase.GreenLed(off); /* Flash during frames */
+			if(f3xBase.IsVideoOutputFile())
+				f3xBase.BlueLed(off);
+		}
+
+		/* Overlay is only recorded here, output thread draws it. Tracks of every output frame go to stream metadata */
+		OverlayPtr overlay;
+		if(isOutput) {
+			overlay = overlayPool.Acquire();
+			overlay->isDraw = isResult;
+			overlay->seq = fs.seq;
+		}
+		if(isResult) {
+			OverlayRecord & rec = *overlay;
+			rec.centerX = cx;
+			rec.horizonY = ch.tracker.HorizonHeight();
+			rec.rois.assign(roiRect.begin(), roiRect.end());
+			if(f3xBase.IsNewTargetRestriction())
+				rec.restrictionRect = ch.tracker.NewTargetRestrictionRect();
+			if(fs.processRect.size() != fs.grayFrame.size())
+				rec.processRect = fs.processRect;
+		}
+
+		ReleaseTrigger(ch.index);
+
+		ch.tracker.Update(roiRect, fs.frameTick, f3xBase.IsFakeTargetDetection());
+
+		TargetPool & targets = ch.tracker.TargetList();
+
+		if(isResult)
+			ch.tracker.NewTargetHistory().Draw(*overlay);
+
+		bool doTrigger = false;
+
+		for(TargetPool::iterator t=targets.begin();t!=targets.end();++t) {
+			if(isResult)
+				t->Draw(*overlay); /* Draw target */
+
+			if(t->TriggerCount() > 0 && t->TriggerCount() < MAX_NUM_TRIGGER)
+				doTrigger = true;
+
+			if(t->IsCrossLine(cx)) {
+				bool tgr = t->Trigger(f3xBase.IsBugTrigger());
+				if(doTrigger == false)
+					doTrigger = tgr;
+			}
+		}
+
+		bool isFire = triggerCombiner.Submit(ch.index, doTrigger, fs.captureTime);
+
+		if(isFire || doTriggerCount > 0) { /* t->TriggerCount() > 0 */
+			if(isOutput)
+				overlay->isTrigger = true;
+
+			FireTrigger(ch.index, doTriggerCount);
+		} 
+
+		if(isOutput) {
+			for(TargetPool::iterator t=targets.begin();t!=targets.end();++t) {
+				OverlayTrack track = { t->Id(), t->LastRect(), t->TriggerCount() > 0 };
+				overlay->tracks.push_back(track);
+			}
+
+			if(isResult) {
+				OverlayRecord & rec = *overlay;
+				rec.time = time(0);
+				rec.fps = fps;
+				rec.mog2Threshold = f3xBase.Mog2Threshold();
+				rec.exposureThreshold = ch.camera.ExposureThreshold();
+				rec.droppedFrames = ch.droppedFrames.load();
+			}
+
+			if(isRepeatOutput)
+				videoFrameRing.Publish(lastOutFrame, overlay);
+			else if(videoFrameRing.HasConsumer()) { /* Slot is reused by capture, outputs take their own copy */
+				Mat outFrame = outFramePool.Acquire();
+				CopyBgrFrame(fs, outFrame);
+				videoFrameRing.Publish(outFrame, overlay);
+				lastOutFrame = outFrame;
+			}
+		}
+
+		if(fs.isLuma)
+			fs.grayFrame.release(); /* Refers to frame */
+		fs.frame.Release(); /* Buffer back to GStreamer */
+		ch.freeSlots.Push(i);
+
+		steady_clock::time_point t2(steady_clock::now());
+		dt_us = (dt_us + static_cast<double>(duration_cast<microseconds>(t2 - t1).count())) / 2;
+		fps = 1000000.0 / dt_us;
+
+		long trackUs = duration_cast<microseconds>(t2 - t0).count();
+		long stageUs = max(max(trackUs, s_encodeUs.load()), max(fs.captureUs, fs.detectUs)); /* Overlay is drawn on encoder thread */
+		if(ch.IsPrimary() && governor.Update(stageUs)) { /* One thread updates, level applies to all cameras */
+			cout << "*** Load level " << governor.Level() << " : " << LoadGovernor::LevelName(governor.Level()) << " ***" << endl;
+			if(governor.Level() < LOAD_LEVEL_HALF_OUTPUT_FPS)
+				lastOutFrame.release(); /* Back to frame pool */
+		}
 
-	/* background history count, varThreshold, shadow detection */
-	bsModel = cuda::createBackgroundSubtractorMOG2(30, f3xBase.Mog2Threshold(), false);
-	//cout << bsModel->getVarInit() << " / " << bsModel->getVarMax() << " / " << bsModel->getVarMax() << endl;
-	/* Default variance of each gaussian component 15 / 75 / 75 */ 
-	bsModel->setVarInit(15);
-	bsModel->setVarMax(20);
-	bsModel->setVarMin(4);    
+		/* t2 - t1 = interval of frames out of pipeline */
+		/* t2 - captureTime = latency from capture to trigger */
+		if(frameCount == VIDEO_OUTPUT_FPS) /* Buffers are allocated by first frames */
+			allocationBase = allocationCounter.Count();
+		if(frameCount % VIDEO_OUTPUT_FPS == 0) /* Display fps every second */
+			std::cout << ((s_numCamera > 1) ? (ch.IsPrimary() ? "[0] " : "[1] ") : "") << "FPS : " << fixed  << setprecision(2) << fps << " / " << duration_cast<milliseconds>(t2 - fs.captureTime).count() << " ms / " << ch.droppedFrames.load() << " dropped / " 
+				<< allocationCounter.Count() - allocationBase << " large allocs / load level " << governor.Level() << std::endl;
+
+		if(ch.IsPrimary())
+			s_fps = static_cast<int>(fps);
+
+		t1 = t2;
+	}
+}
+
+static void StartPipeline()
+{
+	for(int c=0;c<s_numCamera;c++) {
+		CameraChannel & ch = channels[c];
+		ch.capturedSlots.Clear();
+		ch.detectedSlots.Clear();
+		ch.freeSlots.Clear();
+		for(int i=0;i<NUM_FRAME_SLOTS;i++) {
+			if(ch.camera.IsLumaCapture())
+				ch.frameSlots[i].grayFrame.release(); /* Refers to Y plane of captured frame */
+			else
+				ch.frameSlots[i].grayFrame.create(ch.camera.Height(), ch.camera.Width(), CV_8UC1); /* Kept over stop / start of the same size */
+			ch.freeSlots.Push(i);
+		}
+		ch.droppedFrames = 0;
+	}
+	outFramePool.Create(OUTPUT_FRAME_POOL_SIZE, camera.Height(), camera.Width(), CV_8UC3);
+	overlayPool.Create(FRAME_RING_SIZE + 2); /* Held by ring until encoder renders */
+	governor.Reset(camera.Fps());
+	triggerCombiner.Reset(s_numCamera, f3xBase.TriggerMode(), f3xBase.PreferredCamera());
+	ResetTrigger();
+
+	bPipelineRun = true;
+	for(int c=0;c<s_numCamera;c++) {
+		CameraChannel & ch = channels[c];
+		ch.captureThread = thread(&CaptureTask, std::ref(ch));
+		ch.detectionThread = thread(&DetectionTask, std::ref(ch));
+		ch.trackingThread = thread(&TrackingTask, std::ref(ch));
+	}
+}
+
+static void StopPipeline()
+{
+	bPipelineRun = false;
+	for(int c=0;c<s_numCamera;c++) {
+		CameraChannel & ch = channels[c];
+		if(ch.captureThread.joinable())
+			ch.captureThread.join();
+		if(ch.detectionThread.joinable())
+			ch.detectionThread.join();
+		if(ch.trackingThread.joinable())
+			ch.trackingThread.join();
+
+		for(int i=0;i<NUM_FRAME_SLOTS;i++) { /* Frames left in rings, camera could be closed then */
+			if(ch.frameSlots[i].isLuma)
+				ch.frameSlots[i].grayFrame.release();
+			ch.frameSlots[i].frame.Release();
+		}
+	}
+
+	triggerCombiner.PrintStats();
+}
+
+void F3xBase::Start()
+{
+	s_numCamera = f3xBase.IsDualCamera() ? NUM_CAMERA : 1;
+
+	for(int c=0;c<s_numCamera;c++) {
+		Camera & cam = channels[c].camera;
+		cam.UpdateExposure();
+		cam.LumaCapture(f3xBase.IsLumaCapture());
+		cam.CaptureBuffers(f3xBase.CaptureBuffers());
+
+		if(cam.Open() == false) {
+			for(int i=0;i<c;i++)
+				channels[i].camera.Close();
+			s_errorString = (c == 0) ? "Camera" : "Camera1";
+			f3xBase.Error(s_errorString.c_str());
+			bStopped = true;
+			return;
+		}
+	}
+
+	for(int c=0;c<s_numCamera;c++) { /* Same detection settings, each camera has its own background model and targets */
+		CameraChannel & ch = channels[c];
+		ch.tracker.UpdateHorizonRatio(f3xBase.HorizonRatio());
+
+		if(f3xBase.IsNewTargetRestriction())
+			ch.tracker.NewTargetRestriction(Rect(180, ch.camera.Height() - 180, 360, 180));
+		else
+			ch.tracker.NewTargetRestriction(Rect());
+
+		ch.detector.HorizonHeight(ch.tracker.HorizonHeight());
+		if(f3xBase.IsAutoProcessRegion())
+			ch.detector.AutoProcessRegion();
+		else
+			ch.detector.ProcessRegion(f3xBase.ProcessRegion());
+		ch.detector.Pyramid(f3xBase.PyramidScale(), f3xBase.MinCoarseArea());
+		ch.detector.CreateBackgroundModel(f3xBase.Mog2Threshold(), f3xBase.Backend());
+		if(s_numCamera > 1)
+			cout << "Camera " << c << " : ";
+		cout << "Compute backend " << ch.detector.Backend().Name() << endl;
+		if(ch.detector.PyramidScale() > 1)
+			cout << "Detection pyramid 1 / " << ch.detector.PyramidScale() << ", minimum coarse area " << ch.detector.MinCoarseArea() << endl;
+	}
+	if(s_numCamera > 1)
+		cout << "Dual camera, trigger " << TriggerCombiner::ModeName(f3xBase.TriggerMode()) << endl;
 
 	cout << endl;
 	cout << "*** Object tracking started ***" << endl;
 
-	Mat frame;
-	for(int i=0;i<30;i++) /* Read out unstable frames ... */
-		camera.Read(frame);
-
-	if(f3xBase.IsVideoOutput()) { /* NOT include RTSP video output */
-		F3xBase & fb = f3xBase;
-		videoOutputThread = thread(&VideoOutputTask, fb.BaseType(), fb.IsVideoOutputScreen(), fb.IsVideoOutputFile(), 
-			fb.IsVideoOutputRTP(), fb.RtpRemoteHost(), fb.RtpRemotePort(), 
-			fb.IsVideoOutputHLS(), camera.Width(), camera.Height(), camera.Fps());
+	CaptureFrame frame;
+	for(int c=0;c<s_numCamera;c++) {
+		for(int i=0;i<30;i++) /* Read out unstable frames ... */
+			channels[c].camera.Read(frame);
 	}
+	frame.Release();
 
-	if(f3xBase.IsVideoOutputRTSP()) {
+	videoFrameRing.Reset();
+
+	if(f3xBase.IsVideoOutputRTSP()) { /* Media of RTSP takes frames of video encoder */
 		rtspServerThread = thread(&gst_rtsp_server_task, camera.Width(), camera.Height(), camera.Fps());
 		cout << endl;
 		cout << "*** Start RTSP video ***" << endl;
 	}
 
+	if(f3xBase.IsVideoOutput() || f3xBase.IsVideoOutputRTSP()) {
+		F3xBase & fb = f3xBase;
+		VideoEncoderConfig cfg;
+		cfg.isOutput[VIDEO_OUTPUT_FILE] = fb.IsVideoOutputFile();
+		cfg.isOutput[VIDEO_OUTPUT_SCREEN] = fb.IsVideoOutputScreen();
+		cfg.isOutput[VIDEO_OUTPUT_RTP] = fb.IsVideoOutputRTP();
+		cfg.isOutput[VIDEO_OUTPUT_HLS] = fb.IsVideoOutputHLS();
+		cfg.isOutput[VIDEO_OUTPUT_RTSP] = fb.IsVideoOutputRTSP();
+		cfg.isOutput[VIDEO_OUTPUT_CLIP] = fb.IsVideoOutputClip();
+		cfg.width = camera.Width();
+		cfg.height = camera.Height();
+		cfg.fps = VIDEO_OUTPUT_FPS;
+		cfg.rtpHost = fb.RtpRemoteHost() ? fb.RtpRemoteHost() : "";
+		cfg.rtpPort = fb.RtpRemotePort();
+		cfg.segmentSeconds = fb.VideoFileDuration();
+		cfg.clipPreSeconds = fb.ClipPreSeconds();
+		cfg.clipPostSeconds = fb.ClipPostSeconds();
+		videoEncodeThread = thread(&VideoEncodeTask, cfg, fb.BaseType(), fb.VideoFileName());
+	}
+
+	StartPipeline();
+
 	f3xBase.GreenLed(off);
 
 	bStopped = false;
@@ -3378,16 +3257,17 @@ void F3xBase::Start()
 
 void F3xBase::Stop()
 {
+	StopPipeline();
+
 	f3xBase.GreenLed(on); /* On while pause */
 
 	cout << endl;
 	cout << "*** Object tracking stoped ***" << endl;
 	
-	if(f3xBase.IsVideoOutput()) {
-		videoOutputQueue.cancel();
-		if(videoOutputThread.joinable())
-			videoOutputThread.join();
-	}
+	videoFrameRing.Cancel(); /* Wakes up all video outputs and RTSP */
+
+	if(videoEncodeThread.joinable())
+		videoEncodeThread.join();
 
 	if(f3xBase.IsVideoOutputRTSP()) {
 		if(f3xBase.IsVideoOutputRTSP())
@@ -3399,7 +3279,8 @@ void F3xBase::Stop()
 			rtspServerThread.join();
 	}
 
-	camera.Close();
+	for(int c=0;c<s_numCamera;c++)
+		channels[c].camera.Close();
 
 	signal(SIGUSR1, SIG_IGN); /* Ignore SIGUSR1 here or causes abnormal exit code */
 
@@ -3407,102 +3288,6 @@ void F3xBase::Stop()
 	s_fps = 0;
 }
 
-static void contour_moving_object(Mat & frame, Mat & foregroundFrame, list<Rect> & roiRect)
-{
-	uint32_t num_target = 0;
-
-	vector< vector<Point> > contours;
-	vector< Vec4i > hierarchy;
-	findContours(foregroundFrame, contours, hierarchy, RETR_EXTERNAL, CHAIN_APPROX_SIMPLE);
-#if 1 /* Anti exposure burst */   
-	if(contours.size() > 64)
-		return;
-#endif
-	vector<Rect> boundRect;
-
-    for(int i=0; i<contours.size(); i++) {
-        Rect r = boundingRect(Mat(contours[i]));
-        if(r.area() < 400 && r.br().y > tracker.HorizonHeight()) {
-	        Point ct = Center(r);
-	        bool isMerged = false;
-	        for(auto it=boundRect.begin();it!=boundRect.end();++it) {
-				if(it->area() < 400) { /* Less than 20x20 */
-	                if((r & *it).area() > 0) { /* Merge overlaped rect */
-	                    isMerged = true;
-	                } else if(cv::norm(ct - Center(*it)) < 36) { /* Merge closely enough rect */
-	                    isMerged = true;
-	                }
-	            }
-	            if(isMerged) {
-	                *it = MergeRect(r, *it);
-	                break;
-	            }
-	        }
-	        if(isMerged)
-	            continue;
-	    }
-        boundRect.push_back(r);
-    }
-
-	sort(boundRect.begin(), boundRect.end(), [](const Rect & r1, const Rect & r2) {  
-			return (r1.area() > r2.area()); /* Area */
-		}); /* Rects sort by area, boundRect[0] is largest */
-
-	for(int i=0; i<boundRect.size(); i++) {
-		if(boundRect[i].width > maxTargetSize.width &&
-			boundRect[i].height > maxTargetSize.height)
-			continue; /* Extremely large object */
-
-		if(boundRect[i].width < minTargetSize.width && 
-			boundRect[i].height < minTargetSize.height)
-			break; /* Rest are small objects, ignore them */
-
-		Mat roiFrame = frame(boundRect[i]);
-#if 1 /* Anti cloud ... */
-		double minVal; 
-		double maxVal; 
-		Point minLoc; 
-		Point maxLoc;
-
-		minMaxLoc(roiFrame, &minVal, &maxVal, &minLoc, &maxLoc ); 
-			/* If difference of max and min value of ROI rect is too small then it could be noise such as cloud or sea */
-		if((maxVal - minVal) < 16)
-			continue; /* Too small, drop it. */
-#endif
-#if 1
-		if(roiFrame.cols > roiFrame.rows && (roiFrame.cols >> 4) > roiFrame.rows)
-			continue; /* Ignore thin object */
-#endif                        
-		roiRect.push_back(boundRect[i]);
-		if(++num_target >= MAX_NUM_TARGET)
-			break;
-	}    
-}
-
-static void extract_moving_object(Mat & frame, list<Rect> & roiRect)
-{
-	Mat foregroundFrame;
-	cuda::GpuMat gpuFrame;
-	cuda::GpuMat gpuForegroundFrame;
-
-	gpuFrame.upload(frame); 
-	// pass the frame to background bsGrayModel
-	bsModel->apply(gpuFrame, gpuForegroundFrame, 0.05);
-	//cuda::threshold(gpuForegroundFrame, gpuForegroundFrame, 10.0, 255.0, THRESH_BINARY);
-#if 0 /* Run with GPU */
-	cuda::GpuMat gpuErodeFrame;
-	cuda::GpuMat gpuDilateFrame;
-	erodeFilter->apply(gpuForegroundFrame, gpuErodeFrame);
-	dilateFilter->apply(gpuErodeFrame, gpuDilateFrame);
-	gpuDilateFrame.download(foregroundFrame);
-#else /* Run with CPU */
-	gpuForegroundFrame.download(foregroundFrame);
-	morphologyEx(foregroundFrame, foregroundFrame, MORPH_ERODE, elementErode);
-	morphologyEx(foregroundFrame, foregroundFrame, MORPH_DILATE, elementDilate);
-#endif
-	contour_moving_object(frame, foregroundFrame, roiRect);
-}
-
 /*
 *
 */
@@ -3536,7 +3321,12 @@ int main(int argc, char**argv)
 	} else
 		cout << "Error open " << PID_FILE << endl;
 
-	cuda::printShortCudaDeviceInfo(cuda::getDevice());
+	allocationCounter.Install(); /* Before any frame is allocated */
+
+#ifdef HAVE_CUDA_BACKEND
+	if(IsCudaBackendAvailable())
+		cuda::printShortCudaDeviceInfo(cuda::getDevice());
+#endif
 	std::cout << cv::getBuildInformation() << std::endl;
 
 	f3xBase.Initialisize();
@@ -3552,36 +3342,18 @@ int main(int argc, char**argv)
 
 	camera.LoadConfig();
 	camera.UpdateExposure();
-
-	int cy = camera.Height() - 1;
-	int cx = (camera.Width() / 2) - 1;
-
-	int erosion_size = 1;   
-	elementErode = cv::getStructuringElement(cv::MORPH_RECT,
-					cv::Size(2 * erosion_size + 1, 2 * erosion_size + 1), 
-					cv::Point(-1, -1) ); /* Default anchor point */
-
-	int dilate_size = 2;   
-	elementDilate = cv::getStructuringElement(cv::MORPH_RECT,
-					cv::Size(2 * dilate_size + 1, 2 * dilate_size + 1), 
-					cv::Point(-1, -1) ); /* Default anchor point */
+	camera1.ConfigFile("camera1.config", 1);
+	if(f3xBase.IsDualCamera())
+		camera1.LoadConfig();
 
 	cout << endl;
 	cout << "### Press button to start object tracking !!!" << endl;
 
-	double fps = CAMERA_FPS;
-	double dt_us = 1000000.0 / CAMERA_FPS;
-	steady_clock::time_point t1(steady_clock::now());
 	uint64_t loopCount = 0;
 
 	if(bStopped == false)
 		F3xBase::Start();
 
-	auto lastTriggerTime(steady_clock::now());
-	auto lastRelayTriggerTime(steady_clock::now());
-
-	uint8_t doTriggerCount = 0;
-
 	while(1) {
 		if(bShutdown)
 			break;
@@ -3628,202 +3400,7 @@ int main(int argc, char**argv)
 			continue;
 		}
 
-		if(loopCount % 2 == 0) {
-			f3xBase.GreenLed(on); /* Flash during frames */
-			if(f3xBase.IsVideoOutputFile())
-				f3xBase.BlueLed(on);
-		} else {
-			f3xBase.GreenLed(off); /* Flash during frames */
-			if(f3xBase.IsVideoOutputFile())
-				f3xBase.BlueLed(off);
-		}
-
-		Mat capFrame;
-		camera.Read(capFrame);
-
-		steady_clock::time_point t3(steady_clock::now());
-
-		Mat outFrame;
-		if(f3xBase.IsVideoOutputResult()) {
-			if(f3xBase.IsVideoOutput() || f3xBase.IsVideoOutputRTSP()) {
-				capFrame.copyTo(outFrame);
-				line(outFrame, Point(cx, 0), Point(cx, cy), Scalar(0, 255, 0), 1);
-			}
-		}
-
-		/* Gray color space for whole region */
-		Mat grayFrame;
-#if 0
-		cuda::GpuMat gpuCap, gpuGray;
-		gpuCap.upload(capFrame);
-		cuda::cvtColor(gpuCap, gpuGray, COLOR_BGR2GRAY);
-		gpuGray.download(grayFrame);
-#else
-		cvtColor(capFrame, grayFrame, COLOR_BGR2GRAY);
-#endif
-		list<Rect> roiRect;
-
-		extract_moving_object(grayFrame, roiRect);
-
-		if(f3xBase.IsVideoOutputResult()) {
-			if(f3xBase.IsVideoOutput() || f3xBase.IsVideoOutputRTSP()) {
-				for(list<Rect>::iterator rr=roiRect.begin();rr!=roiRect.end();++rr)
-					rectangle( outFrame, rr->tl(), rr->br(), Scalar(0, 255, 0), 2, 8, 0 );
-				if(f3xBase.IsNewTargetRestriction()) {
-					Rect nr = tracker.NewTargetRestrictionRect();
-					rectangle(outFrame, nr.tl(), nr.br(), Scalar(127, 0, 127), 2, 8, 0 );
-					writeText(outFrame, "New Target Restriction Area", Point(120, CAMERA_HEIGHT - 180));
-				}
-				//line(outFrame, Point(0, (camera.Height() / 5) * 4), Point(camera.Width(), (camera.Height() / 5) * 4), Scalar(127, 127, 0), 1);
-				line(outFrame, Point(0, tracker.HorizonHeight()), Point(camera.Width(), tracker.HorizonHeight()), Scalar(0, 255, 255), 1);
-/*
-				int viewAngle = 60;
-				int yOffset = 0;
-				int interval = camera.Width() / viewAngle;
-				int offset = f3xBase.Yaw() % 10;
-				for(int i=0;i<viewAngle;i++) {
-					if((offset + i) % 10 == 0) { // Long line
-						line(outFrame, Point(i * interval, 0), Point(i * interval, 36), Scalar(0, 255, 0), 1);
-						int yaw = (f3xBase.Yaw() + i) - (viewAngle / 2);
-						if(yaw < 0)
-							yaw += 360;
-						String strYaw = to_string(yaw);
-						putText(outFrame, strYaw.c_str(), Point(i * interval - (strYaw.size() * 10), 80), FONT_HERSHEY_DUPLEX, 1, Scalar(0, 255, 0), 2, cv::LINE_8);
-					 } else if((offset + i) % 10 == 5) { //
-						line(outFrame, Point(i * interval, 0), Point(i * interval, 30), Scalar(0, 255, 0), 1);
-					 } else { // Short line
-						line(outFrame, Point(i * interval, 0), Point(i * interval, 24), Scalar(0, 255, 0), 1);
-					}
-				}
-*/				
-			}
-		}
-
-		f3xBase.RedLed(off);
-		f3xBase.Relay(off);
-
-		tracker.Update(roiRect, f3xBase.IsFakeTargetDetection());
-
-		list< Target > & targets = tracker.TargetList();
-
-		if(f3xBase.IsVideoOutput() || f3xBase.IsVideoOutputRTSP()) {
-			if(f3xBase.IsVideoOutputResult()) {
-				list< list< Rect > > & newTargetHistory = tracker.NewTargetHistory();
-				for(auto & it : newTargetHistory) {
-					for(auto & r : it) {
-						rectangle( outFrame, r.tl(), r.br(), Scalar(127, 127, 0), 2, 8, 0 );
-					}
-				}
-			}
-		}
-
-		bool doTrigger = false;
-
-		for(list< Target >::iterator t=targets.begin();t!=targets.end();++t) {
-			if(f3xBase.IsVideoOutputResult()) { 
-				if(f3xBase.IsVideoOutput() || f3xBase.IsVideoOutputRTSP()) {
-					t->Draw(outFrame, true); /* Draw target */
-				}
-			}
-
-			if(t->TriggerCount() > 0 && t->TriggerCount() < MAX_NUM_TRIGGER)
-				doTrigger = true;
-
-			if(t->ArcLength() > MIN_COURSE_LENGTH && 
-				t->AbsLength() > MIN_COURSE_LENGTH && 
-				t->TrackedCount() > MIN_TARGET_TRACKED_COUNT) {
-				if((t->BeginCenterPoint().x > cx && t->EndCenterPoint().x <= cx) ||
-						(t->BeginCenterPoint().x < cx && t->EndCenterPoint().x >= cx) ||
-						(t->PreviousCenterPoint().x > cx && t->CurrentCenterPoint().x <= cx) ||
-						(t->PreviousCenterPoint().x < cx && t->CurrentCenterPoint().x >= cx)) {
-					bool tgr = t->Trigger(f3xBase.IsBugTrigger());
-					if(doTrigger == false)
-						doTrigger = tgr;
-				}
-			}
-		}
-
-		if(doTrigger || doTriggerCount > 0) { /* t->TriggerCount() > 0 */
-			if(f3xBase.IsVideoOutputResult()) {
-				if(f3xBase.IsVideoOutput() || f3xBase.IsVideoOutputRTSP())
-					line(outFrame, Point(cx, 0), Point(cx, cy), Scalar(0, 0, 255), 3);
-			}
-
-			long long duration = duration_cast<milliseconds>(steady_clock::now() - lastRelayTriggerTime).count();
-			//printf("duration = %lld\n" , duration);
-			if(duration > f3xBase.RelayDebouence()) {
-				f3xBase.Relay(on);
-				lastRelayTriggerTime = steady_clock::now();
-			}
-
-			bool isNewTrigger = false;
-			duration = duration_cast<milliseconds>(steady_clock::now() - lastTriggerTime).count();
-			if(duration > 330) /* new trigger */
-				isNewTrigger = true;
-
-			if(isNewTrigger)
-				doTriggerCount = MAX_NUM_TRIGGER;
-
-			lastTriggerTime = steady_clock::now();
-
-			f3xBase.TriggerMulticastSocket(isNewTrigger);
-			f3xBase.TriggerSourceUdpSocket(isNewTrigger);
-			f3xBase.TriggerTtyTHSx(isNewTrigger);			
-			f3xBase.TriggerTtyUSB0(isNewTrigger);
-			if(f3xBase.IsBuzzer())
-				f3xBase.RedLed(on);
-
-			if(doTriggerCount > 0)
-				doTriggerCount--;
-		} 
-
-		if(f3xBase.IsVideoOutput() || f3xBase.IsVideoOutputRTSP()) {
-			if(f3xBase.IsVideoOutputResult()) {
-				writeText(outFrame, currentDateTime(), Point(40, 160));
-				char str[32];
-				snprintf(str, 32, "FPS %.2lf", fps);
-				writeText(outFrame, string(str), Point( 40, 200 ));
-				
-				//snprintf(str, 32, "Yaw %d", f3xBase.Yaw());
-				//writeText(outFrame, string(str), Point( 480, 200 ));
-/*
-				int xOffset = 400;
-				int yOffset = 200;
-				writeText(outFrame, "Roll", Point( xOffset, yOffset ));
-				writeText(outFrame, "Pitch", Point( xOffset + 120, yOffset ));
-				writeText(outFrame, "Yaw", Point( xOffset + 240, yOffset ));
-				writeText(outFrame, to_string(f3xBase.Roll()), Point( xOffset, yOffset + 40 ));
-				writeText(outFrame, to_string(f3xBase.Pitch()), Point( xOffset + 120, yOffset + 40 ));
-				writeText(outFrame, to_string(f3xBase.Yaw()), Point( xOffset + 240, yOffset + 40 ));
-*/
-				snprintf(str, 32, "MOG2 threshold %d", f3xBase.Mog2Threshold());
-				writeText(outFrame, str, Point( 40, 240 ));
-				snprintf(str, 32, "Exposure threshold %d", camera.ExposureThreshold());
-				writeText(outFrame, str, Point( 40, 280 ));
-
-				if(f3xBase.IsVideoOutput())
-					videoOutputQueue.push(outFrame);
-				if(f3xBase.IsVideoOutputRTSP() && g_clientCount.load() > 0)
-					videoRtspQueue.push(outFrame);
-			} else {
-				if(f3xBase.IsVideoOutput())
-					videoOutputQueue.push(capFrame);
-				if(f3xBase.IsVideoOutputRTSP() && g_clientCount.load() > 0)
-					videoRtspQueue.push(capFrame);
-			}
-		}
-
-		steady_clock::time_point t2(steady_clock::now());
-		dt_us = (dt_us + static_cast<double>(duration_cast<microseconds>(t2 - t1).count())) / 2;
-
-		/* t2 - t1 = interval of loop */
-		/* t2 - t3 = detection process time */
-		if(loopCount > 0 && loopCount % VIDEO_OUTPUT_FPS == 0) /* Display fps every second */
-			std::cout << "FPS : " << fixed  << setprecision(2) <<  (1000000.0 / dt_us) << " / " << duration_cast<milliseconds>(t2 - t3).count() << " ms" << std::endl;
-
-		s_fps = static_cast<int>(1000000.0 / dt_us);
-
-		t1 = steady_clock::now();
+		std::this_thread::sleep_for(std::chrono::milliseconds(20)); /* Frames go through pipeline threads */
 	}
 
 	f3xBase.GreenLed(off); /* Flash during frames */
@@ -0,0 +1,103 @@
+#ifndef DRAGON_EYE_H
+#define DRAGON_EYE_H
+
+#include <opencv2/opencv.hpp>
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <list>
+#include <vector>
+
+using namespace cv;
+using namespace std;
+
+#ifndef DEBUG
+//#define DEBUG
+#endif
+
+#ifdef DEBUG
+#define dprintf(...) do{ fprintf( stderr, __VA_ARGS__ ); } while( false )
+#else
+#define dprintf(...) do{ } while ( false )
+#endif
+
+//#define CAMERA_1080P
+
+#ifdef CAMERA_1080P
+	#define CAMERA_WIDTH 1080
+	#define CAMERA_HEIGHT 1920
+	#define CAMERA_FPS 30
+	#define MIN_TARGET_WIDTH 9
+	#define MIN_TARGET_HEIGHT 12
+	#define MAX_TARGET_WIDTH 480
+	#define MAX_TARGET_HEIGHT 480
+#else
+	#define CAMERA_WIDTH 720
+	#define CAMERA_HEIGHT 1280
+	#define CAMERA_FPS 30
+	#define MIN_TARGET_WIDTH 6
+	#define MIN_TARGET_HEIGHT 8
+	#define MAX_TARGET_WIDTH 320
+	#define MAX_TARGET_HEIGHT 320
+#endif
+
+#define MAX_TARGET_TRACKING_DISTANCE    360
+
+#define MAX_NUM_TARGET               	9      /* Maximum targets to tracing */
+#define MAX_NUM_OBJECT               	64     /* Maximum moving objects of a frame, detector bails out beyond (anti exposure burst) */
+#define MAX_NUM_TRIGGER              	6      /* Maximum number of RF trigger after detection of cross line */
+#define MAX_NUM_FRAME_MISSING_TARGET 	3      /* Maximum number of frames to keep tracing lost target */
+#define MAX_TARGET_HISTORY           	128    /* Latest rects / vectors kept by target */
+#define MAX_TARGET_POOL              	128    /* Maximum targets in tracker, preallocated */
+
+#define NEW_TARGET_HISTORY_FRAMES    	90     /* New targets of latest 3 seconds for fake target detection */
+#define NEW_TARGET_HISTORY_PER_FRAME 	MAX_NUM_OBJECT /* Maximum new targets recorded per frame, no less than objects from detector */
+#define NEW_TARGET_GRID_SIZE         	32     /* Cell size of new target history grid */
+#define NEW_TARGET_GRID_SLOTS        	8      /* New targets referenced by a cell before overflow */
+
+#define MIN_COURSE_LENGTH            	16     /* Minimum course length of RF trigger after detection of cross line */
+#define MIN_TARGET_TRACKED_COUNT     	3      /* Minimum target tracked count of RF trigger after detection of cross line */
+
+#define HORIZON_RATIO                	8 / 10
+#define PROCESS_REGION_MARGIN_RATIO  	1 / 10 /* Rows below horizon in auto processing region */
+
+#define PYRAMID_WINDOW_MARGIN        	2      /* Coarse pixels around coarse blob revisited at full resolution */
+#define PYRAMID_FINE_VARIANCE        	15     /* Pixel variance of fine test against coarse background, varInit of MOG2 */
+
+#define LOAD_SHRINK_WIDTH_RATIO      	3 / 4  /* Width of processing region kept around center line when shrunk */
+#define LOAD_CENTER_BAND_RATIO       	1 / 3  /* Width of full resolution band around center line */
+#define LOAD_OVER_BUDGET_FRAMES      	15     /* Over budget frames to step up load shedding level */
+#define LOAD_HEADROOM_FRAMES         	90     /* Successive frames with headroom to step down */
+#define LOAD_HEADROOM_RATIO          	7 / 10 /* Headroom is slowest stage under 70 % of frame budget */
+
+#define NUM_FRAME_SLOTS              	4      /* Frames in flight through capture / detection / tracking threads, power of 2 */
+#define PIPELINE_WAIT_US             	500    /* Sleep of idle pipeline stage */
+
+#define VIDEO_ENCODER_BITRATE        	8000000
+#define VIDEO_ENCODER_KEY_INTERVAL   	30     /* Frames between IDR, new RTSP clients start at an IDR */
+#define VIDEO_ENCODER_QUEUE_FRAMES   	2      /* Raw frames waiting in encoder before new frames are dropped */
+//#define VIDEO_OMXH265ENC
+
+#define NUM_CAMERA                   	2      /* Cameras processed at once in dual camera mode */
+#define TRIGGER_PAIR_WINDOW_MS       	200    /* Triggers of both cameras closer than this are one crossing */
+#define CAMERA_STALL_MS              	500    /* Camera without frames longer than this is down, preferred camera falls back */
+
+/*
+*
+*/
+
+static inline Point Center(const Rect & r) {
+	return Point(r.tl().x + (r.width / 2), r.tl().y + (r.height / 2));
+}
+
+static inline Rect MergeRect(const Rect & r1, const Rect & r2) {
+    Rect r;
+    r.x = min(r1.x, r2.x);
+    r.y = min(r1.y, r2.y);
+    r.width = max(r1.x + r1.width, r2.x + r2.width) - r.x;
+    r.height = max(r1.y + r1.height, r2.y + r2.height) - r.y;
+	return r;
+}
+
+#endif
@@ -0,0 +1,320 @@
+#include "eventrecorder.h"
+
+#include <iostream>
+#include <chrono>
+
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+
+static inline int64_t NowUs()
+{
+	return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void EventRecorder::Start(int preSeconds, int postSeconds, int bitrate, const string & fileFormat, int fileIndex, int maxFiles)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	if(m_isStarted)
+		return;
+
+	m_preSeconds = preSeconds;
+	m_postSeconds = postSeconds;
+	m_fileFormat = fileFormat;
+	m_fileIndex = fileIndex;
+	m_maxFiles = max(1, maxFiles);
+
+	/* Pre seconds plus one GOP before it, twice for peaks of bitrate */
+	size_t seconds = preSeconds + (VIDEO_ENCODER_KEY_INTERVAL + CAMERA_FPS - 1) / CAMERA_FPS + 1;
+	m_data.assign(seconds * (bitrate / 8) * 2, 0);
+	m_head = 0;
+	m_units.clear();
+
+	m_clip = 0;
+	m_clipSrc = 0;
+	m_clipEndUs = 0;
+	m_clips = 0;
+	m_isClipPending = false;
+	m_isFlushing = false;
+	m_isStarted = true;
+
+	m_clipThread = std::thread(&EventRecorder::ClipTask, this);
+
+	cout << endl;
+	cout << "*** Start clip video, " << preSeconds << " s before / " << postSeconds << " s after trigger, "
+		<< m_data.size() / 1024 << " KB ring ***" << endl;
+}
+
+void EventRecorder::Stop()
+{
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		if(m_isStarted == false)
+			return;
+
+		if(m_clip)
+			FinishClip();
+		m_isClipPending = false;
+		m_isStarted = false;
+		m_cond.notify_all();
+	}
+
+	if(m_clipThread.joinable())
+		m_clipThread.join();
+
+	vector<uint8_t>().swap(m_data);
+	m_units.clear();
+
+	cout << endl;
+	cout << "*** Stop clip video, " << m_clips << " clips ***" << endl;
+}
+
+bool EventRecorder::Reserve(size_t size)
+{
+	if(size > m_data.size())
+		return false;
+
+	if(m_units.empty())
+		m_head = 0;
+
+	if(m_head + size > m_data.size()) { /* Wrap, units of previous lap behind head are the oldest */
+		while(!m_units.empty() && m_units.front().offset >= m_head)
+			m_units.pop_front();
+		m_head = 0;
+	}
+
+	while(!m_units.empty() && m_units.front().offset >= m_head && m_units.front().offset < m_head + size)
+		m_units.pop_front();
+
+	while(!m_units.empty() && m_units.front().isKeyFrame == false) /* Ring starts from a key frame */
+		m_units.pop_front();
+
+	return true;
+}
+
+void EventRecorder::Trim(int64_t nowUs)
+{
+	int64_t cutoffUs = nowUs - (int64_t)m_preSeconds * 1000000;
+
+	/* Drop whole GOPs while the next key frame is still before cutoff */
+	while(1) {
+		size_t k = 1;
+		while(k < m_units.size() && m_units[k].isKeyFrame == false)
+			k++;
+		if(k >= m_units.size() || m_units[k].us > cutoffUs)
+			break;
+		m_units.erase(m_units.begin(), m_units.begin() + k);
+	}
+}
+
+GstElement *EventRecorder::OpenClip(const char *location)
+{
+	string s = "appsrc name=src format=time caps=video/x-h265,stream-format=byte-stream,alignment=au ! h265parse ! mp4mux ! filesink location=";
+	s += location;
+
+	GError *err = 0;
+	GstElement *clip = gst_parse_launch(s.c_str(), &err);
+	if(clip == 0 || err) {
+		printf("Event recorder - %s\n", err ? err->message : "parse error");
+		g_clear_error(&err);
+		if(clip)
+			gst_object_unref(clip);
+		return 0;
+	}
+
+	if(gst_element_set_state(clip, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+		printf("Event recorder - Fail to start %s\n", location);
+		gst_element_set_state(clip, GST_STATE_NULL);
+		gst_object_unref(clip);
+		return 0;
+	}
+
+	cout << endl;
+	cout << "*** Record clip " << location << " ***" << endl;
+
+	return clip;
+}
+
+GstBuffer *EventRecorder::ClipBuffer(const AccessUnit & au)
+{
+	if(m_clipStartPts == GST_CLOCK_TIME_NONE) {
+		if(au.isKeyFrame == false)
+			return 0; /* Clip starts from a key frame */
+		m_clipStartPts = au.pts;
+	}
+	m_clipLastPts = au.pts;
+
+	GstBuffer *buffer = gst_buffer_new_allocate(NULL, au.size, NULL);
+	gst_buffer_fill(buffer, 0, &m_data[au.offset], au.size);
+
+	GstClockTime pts = (au.pts > m_clipStartPts) ? au.pts - m_clipStartPts : 0;
+	GST_BUFFER_PTS(buffer) = pts;
+	GST_BUFFER_DTS(buffer) = pts; /* No B frames */
+	if(au.isKeyFrame == false)
+		GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+
+	return buffer;
+}
+
+void EventRecorder::FlushClip(GstElement *clip, GstElement *src)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	/* Ring goes on while flushing, one access unit a time so that Push is never held for the whole ring */
+	while(m_clip == clip) {
+		GstBuffer *buffer = 0;
+		for(auto & au : m_units) { /* Next to the latest written, ring starts from a key frame */
+			if(m_clipLastPts != GST_CLOCK_TIME_NONE && au.pts <= m_clipLastPts)
+				continue;
+			buffer = ClipBuffer(au);
+			if(buffer)
+				break;
+		}
+		if(buffer == 0) {
+			m_isFlushing = false; /* Push writes the following access units itself */
+			break;
+		}
+
+		lock.unlock();
+		gst_app_src_push_buffer(GST_APP_SRC(src), buffer); /* Takes buffer */
+		lock.lock();
+	}
+}
+
+void EventRecorder::FinishClip()
+{
+	gst_app_src_end_of_stream(GST_APP_SRC(m_clipSrc));
+	gst_object_unref(m_clipSrc);
+	m_clipSrc = 0;
+
+	m_closing.push_back(m_clip); /* Muxer writes trailer on clip thread, not to block encoder */
+	m_clip = 0;
+	m_isFlushing = false;
+	m_clips++;
+	m_cond.notify_all();
+
+	cout << endl;
+	cout << "*** Stop clip ***" << endl;
+}
+
+void EventRecorder::CloseClip(GstElement *clip)
+{
+	GstBus *bus = gst_element_get_bus(clip);
+	GstMessage *msg = gst_bus_timed_pop_filtered(bus, 5 * GST_SECOND, (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+	if(msg) {
+		if(GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR)
+			printf("Event recorder - Error of clip\n");
+		gst_message_unref(msg);
+	} else
+		printf("Event recorder - Timeout of end of stream\n");
+	gst_object_unref(bus);
+
+	gst_element_set_state(clip, GST_STATE_NULL);
+	gst_object_unref(clip);
+}
+
+/* Opens, flushes and closes clips, file system and muxer never run on tracking or encoder thread */
+void EventRecorder::ClipTask()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while(1) {
+		m_cond.wait(lock, [this] { return !m_closing.empty() || (m_isClipPending && m_isStarted) || !m_isStarted; });
+
+		if(!m_closing.empty()) {
+			GstElement *clip = m_closing.front();
+			m_closing.pop_front();
+
+			lock.unlock();
+			CloseClip(clip);
+			lock.lock();
+			continue;
+		}
+
+		if(m_isStarted == false)
+			break; /* Stopped and nothing left */
+
+		char location[256];
+		snprintf(location, sizeof(location), m_fileFormat.c_str(), m_fileIndex);
+		m_fileIndex = (m_fileIndex + 1) % m_maxFiles;
+
+		lock.unlock();
+		GstElement *clip = OpenClip(location);
+		lock.lock();
+
+		m_isClipPending = false;
+		if(clip == 0)
+			continue;
+
+		m_clip = clip;
+		m_clipSrc = gst_bin_get_by_name(GST_BIN(clip), "src");
+		m_clipStartPts = GST_CLOCK_TIME_NONE;
+		m_clipLastPts = GST_CLOCK_TIME_NONE;
+		m_isFlushing = true;
+		if(m_isStarted == false) { /* Stopped while opening */
+			FinishClip();
+			continue;
+		}
+
+		GstElement *src = (GstElement *)gst_object_ref(m_clipSrc); /* Kept over FinishClip of Stop */
+		lock.unlock();
+		FlushClip(clip, src); /* Pre trigger seconds */
+		gst_object_unref(src);
+		lock.lock();
+	}
+}
+
+void EventRecorder::Push(GstBuffer *buffer)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	if(m_isStarted == false)
+		return;
+
+	int64_t nowUs = NowUs();
+	size_t size = gst_buffer_get_size(buffer);
+	if(Reserve(size) == false) {
+		printf("Event recorder - Access unit of %lu bytes is over ring\n", (unsigned long)size);
+		return;
+	}
+
+	AccessUnit au;
+	au.offset = m_head;
+	au.size = size;
+	au.pts = GST_BUFFER_PTS(buffer);
+	au.us = nowUs;
+	au.isKeyFrame = !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+
+	gst_buffer_extract(buffer, 0, &m_data[au.offset], size);
+	m_head += size;
+
+	if(!m_units.empty() || au.isKeyFrame) /* Deltas without their key frame are of no use */
+		m_units.push_back(au);
+
+	Trim(nowUs);
+
+	if(m_clip && m_isFlushing == false) { /* Clip thread takes it from ring until flushed */
+		GstBuffer *clipBuffer = ClipBuffer(au);
+		if(clipBuffer)
+			gst_app_src_push_buffer(GST_APP_SRC(m_clipSrc), clipBuffer); /* Takes buffer */
+		if(nowUs > m_clipEndUs)
+			FinishClip();
+	}
+}
+
+void EventRecorder::Trigger()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	if(m_isStarted == false)
+		return;
+
+	m_clipEndUs = NowUs() + (int64_t)m_postSeconds * 1000000; /* Overlapped trigger extends running clip */
+
+	if(m_clip == 0 && m_isClipPending == false) { /* Clip thread opens it */
+		m_isClipPending = true;
+		m_cond.notify_all();
+	}
+}
@@ -0,0 +1,89 @@
+#ifndef EVENTRECORDER_H
+#define EVENTRECORDER_H
+
+#include "dragon-eye.h"
+
+#include "gstreamer-1.0/gst/gst.h"
+#include <gstreamer-1.0/gst/app/app.h>
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+/*
+* Event clips instead of recording everything. The latest seconds of encoded access units are kept in a RAM ring,
+* a trigger writes them out and keeps writing until post seconds after the last trigger.
+* Triggers within a running clip extend it, so a whole run ends up in one file.
+*
+*   encoder (appsink) -> Push() -> ring -> clip : appsrc -> h265parse -> mp4mux -> filesink
+*
+* Ring is a preallocated byte buffer, access units are copied in, nothing is held of encoder.
+* Trigger only marks a clip pending, clip thread opens the file and flushes the ring a unit at a time.
+*/
+
+class EventRecorder
+{
+private:
+	typedef struct {
+		size_t offset, size; /* In m_data */
+		GstClockTime pts;
+		int64_t us; /* Arrival time, steady clock */
+		bool isKeyFrame;
+	} AccessUnit;
+
+	vector<uint8_t> m_data;
+	size_t m_head; /* Next write position */
+	deque<AccessUnit> m_units; /* Oldest first, starts from a key frame */
+
+	int m_preSeconds, m_postSeconds;
+	string m_fileFormat; /* %03d is replaced by index */
+	int m_fileIndex, m_maxFiles;
+
+	GstElement *m_clip; /* Pipeline of running clip */
+	GstElement *m_clipSrc;
+	GstClockTime m_clipStartPts;
+	GstClockTime m_clipLastPts; /* Latest access unit written to clip */
+	int64_t m_clipEndUs;
+	uint64_t m_clips;
+
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+	deque<GstElement *> m_closing; /* Finished clips, EOS sent, waiting for trailer of muxer */
+	std::thread m_clipThread;
+	bool m_isClipPending; /* Triggered, clip thread is to open a clip */
+	bool m_isFlushing; /* Clip thread still writes ring to clip, Push leaves clip to it */
+	bool m_isStarted;
+
+	EventRecorder(const EventRecorder &) = delete;
+	EventRecorder & operator=(const EventRecorder &) = delete;
+
+	bool Reserve(size_t size); /* Evicts oldest access units until size bytes fit at m_head */
+	void Trim(int64_t nowUs);
+	GstElement *OpenClip(const char *location);
+	GstBuffer *ClipBuffer(const AccessUnit & au); /* 0 before the first key frame */
+	void FlushClip(GstElement *clip, GstElement *src);
+	void FinishClip();
+	void CloseClip(GstElement *clip);
+	void ClipTask();
+
+public:
+	EventRecorder() : m_head(0), m_preSeconds(5), m_postSeconds(5), m_fileIndex(0), m_maxFiles(1),
+		m_clip(0), m_clipSrc(0), m_clipStartPts(0), m_clipLastPts(0), m_clipEndUs(0), m_clips(0),
+		m_isClipPending(false), m_isFlushing(false), m_isStarted(false) {}
+	~EventRecorder() { Stop(); }
+
+	/* Ring is sized by bitrate, clips are named by fileFormat from fileIndex */
+	void Start(int preSeconds, int postSeconds, int bitrate, const string & fileFormat, int fileIndex, int maxFiles);
+	void Stop(); /* Running clip is finished as is */
+
+	/* Encoded access unit of H.265 byte stream, buffer is not owned */
+	void Push(GstBuffer *buffer);
+
+	/* Clip from pre seconds before now, or running clip extended. Returns at once, clip is opened on clip thread */
+	void Trigger();
+
+	inline bool IsStarted() const { return m_isStarted; }
+};
+
+#endif
@@ -0,0 +1,77 @@
+#include "framepool.h"
+
+UMatData *AllocationCounter::allocate(int dims, const int *sizes, int type, void *data, size_t *step, AccessFlag flags, UMatUsageFlags usageFlags) const
+{
+	if(data == 0) { /* User data is wrapped, not allocated */
+		size_t total = CV_ELEM_SIZE(type);
+		for(int i=0;i<dims;i++)
+			total *= sizes[i];
+		if(total >= LARGE_ALLOCATION_SIZE)
+			m_count++;
+	}
+	return m_stdAllocator->allocate(dims, sizes, type, data, step, flags, usageFlags);
+}
+
+bool AllocationCounter::allocate(UMatData *data, AccessFlag accessFlags, UMatUsageFlags usageFlags) const
+{
+	return m_stdAllocator->allocate(data, accessFlags, usageFlags);
+}
+
+void AllocationCounter::deallocate(UMatData *data) const
+{
+	m_stdAllocator->deallocate(data);
+}
+
+void AllocationCounter::map(UMatData *data, AccessFlag accessFlags) const
+{
+	m_stdAllocator->map(data, accessFlags);
+}
+
+void AllocationCounter::unmap(UMatData *data) const
+{
+	m_stdAllocator->unmap(data);
+}
+
+BufferPoolController *AllocationCounter::getBufferPoolController(const char *id) const
+{
+	return m_stdAllocator->getBufferPoolController(id);
+}
+
+/*
+*
+*/
+
+void FramePool::Create(int count, int rows, int cols, int type)
+{
+	m_rows = rows;
+	m_cols = cols;
+	m_type = type;
+	m_next = 0;
+	m_frames.resize(count);
+	for(int i=0;i<count;i++)
+		m_frames[i].create(rows, cols, type); /* Kept if size and type are the same */
+}
+
+void FramePool::Release()
+{
+	m_frames.clear();
+	m_next = 0;
+}
+
+Mat FramePool::Acquire()
+{
+	size_t n = m_frames.size();
+	for(size_t k=0;k<n;k++) {
+		size_t i = (m_next + k) % n;
+		Mat & f = m_frames[i];
+		if(f.u && CV_XADD(&f.u->refcount, 0) == 1) { /* Only referred by pool */
+			m_next = (i + 1) % n;
+			return f;
+		}
+	}
+
+	dprintf("Frame pool grows to %lu\n", (unsigned long)n + 1);
+	m_frames.push_back(Mat(m_rows, m_cols, m_type));
+	m_next = 0;
+	return m_frames.back();
+}
@@ -0,0 +1,62 @@
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+#include "dragon-eye.h"
+
+#include <atomic>
+
+#define LARGE_ALLOCATION_SIZE        	(64 * 1024) /* Frame sized allocation, bytes */
+
+/*
+* Default Mat allocator counting large allocations, the steady state of frame loop should not increase the count.
+* Memory comes from and goes back to the standard allocator, buffers are freed by the allocator of UMatData as is.
+*/
+
+class AllocationCounter : public MatAllocator
+{
+private:
+	MatAllocator *m_stdAllocator;
+	mutable std::atomic<unsigned long> m_count;
+
+public:
+	AllocationCounter() : m_stdAllocator(Mat::getStdAllocator()), m_count(0) {}
+
+	/* Default allocator of all Mat created afterward, must outlive them */
+	void Install() { Mat::setDefaultAllocator(this); }
+
+	inline unsigned long Count() const { return m_count.load(); }
+
+	UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step, AccessFlag flags, UMatUsageFlags usageFlags) const override;
+	bool allocate(UMatData *data, AccessFlag accessFlags, UMatUsageFlags usageFlags) const override;
+	void deallocate(UMatData *data) const override;
+	void map(UMatData *data, AccessFlag accessFlags) const override;
+	void unmap(UMatData *data) const override;
+	BufferPoolController *getBufferPoolController(const char *id = NULL) const override;
+};
+
+/*
+* Frames of the same size and type allocated once at startup.
+* A frame is free again once every Mat refers to it is released, e.g. popped by all video output queues.
+* Pool grows by one frame if all are in use, counted by AllocationCounter as any other large allocation.
+*/
+
+class FramePool
+{
+private:
+	vector<Mat> m_frames;
+	int m_rows, m_cols, m_type;
+	size_t m_next; /* Round robin, the oldest frame is most likely free */
+
+public:
+	FramePool() : m_rows(0), m_cols(0), m_type(CV_8UC3), m_next(0) {}
+
+	void Create(int count, int rows, int cols, int type);
+	void Release();
+
+	/* Not thread safe, one thread acquires. Content of frame is left from last use */
+	Mat Acquire();
+
+	inline size_t Size() const { return m_frames.size(); }
+};
+
+#endif
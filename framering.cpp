@@ -0,0 +1,121 @@
+#include "framering.h"
+
+#include <algorithm>
+
+void FrameRing::ReleaseConsumed()
+{
+	uint64_t tail = m_head;
+	for(auto c : m_cursors)
+		tail = min(tail, c->m_next);
+	for(;m_tail<tail;m_tail++) {
+		m_frames[m_tail % FRAME_RING_SIZE].release(); /* Frame goes back to its pool */
+		m_overlays[m_tail % FRAME_RING_SIZE].reset();
+	}
+}
+
+void FrameRing::Attach(Cursor & c, const char *name, size_t depth)
+{
+	std::unique_lock<std::mutex> mlock(m_mutex);
+
+	if(c.m_isAttached)
+		return;
+	c.m_name = name;
+	c.m_next = m_head;
+	c.m_depth = max((size_t)1, min(depth, (size_t)FRAME_RING_SIZE));
+	c.m_frames = 0;
+	c.m_drops = 0;
+	c.m_maxLag = 0;
+	c.m_isAttached = true;
+	m_cursors.push_back(&c);
+}
+
+void FrameRing::Detach(Cursor & c)
+{
+	std::unique_lock<std::mutex> mlock(m_mutex);
+
+	if(c.m_isAttached == false)
+		return;
+	m_cursors.erase(std::remove(m_cursors.begin(), m_cursors.end(), &c), m_cursors.end());
+	c.m_isAttached = false;
+	ReleaseConsumed();
+
+	printf("%s : %lu frames, %lu dropped, max lag %lu\n", c.m_name,
+		(unsigned long)c.m_frames, (unsigned long)c.m_drops, (unsigned long)c.m_maxLag);
+}
+
+bool FrameRing::HasConsumer()
+{
+	std::unique_lock<std::mutex> mlock(m_mutex);
+
+	return m_cursors.empty() == false;
+}
+
+void FrameRing::Publish(const Mat & frame, const OverlayPtr & overlay)
+{
+	std::unique_lock<std::mutex> mlock(m_mutex);
+
+	if(m_cursors.empty()) /* Nobody would release it */
+		return;
+
+	if(m_head - m_tail == FRAME_RING_SIZE) /* Oldest is overwritten, cursors on it drop it at next read */
+		m_tail++;
+	m_frames[m_head % FRAME_RING_SIZE] = frame;
+	m_overlays[m_head % FRAME_RING_SIZE] = overlay;
+	m_head++;
+
+	m_event.notify_all();
+}
+
+void FrameRing::Read(Cursor & c, Mat & frame)
+{
+	OverlayPtr overlay;
+	Read(c, frame, overlay);
+}
+
+void FrameRing::Read(Cursor & c, Mat & frame, OverlayPtr & overlay)
+{
+	std::unique_lock<std::mutex> mlock(m_mutex);
+
+	while(c.m_next == m_head && !m_isCancelled)
+		m_event.wait(mlock);
+
+	if(m_isCancelled)
+		throw cancelled();
+
+	uint64_t oldest = (m_head > c.m_depth) ? max(m_tail, m_head - c.m_depth) : m_tail;
+	if(c.m_next < oldest) { /* Drop oldest of this cursor only */
+		c.m_drops += oldest - c.m_next;
+		dprintf("%s : %lu frames dropped\n", c.m_name, (unsigned long)(oldest - c.m_next));
+		c.m_next = oldest;
+	}
+
+	frame = m_frames[c.m_next % FRAME_RING_SIZE]; /* Reference, no copy */
+	overlay = m_overlays[c.m_next % FRAME_RING_SIZE];
+	c.m_next++;
+	c.m_frames++;
+	c.m_maxLag = max(c.m_maxLag, (size_t)(m_head - c.m_next));
+
+	ReleaseConsumed();
+}
+
+void FrameRing::Cancel()
+{
+	std::unique_lock<std::mutex> mlock(m_mutex);
+
+	m_isCancelled = true;
+	m_event.notify_all();
+}
+
+void FrameRing::Reset()
+{
+	std::unique_lock<std::mutex> mlock(m_mutex);
+
+	for(int i=0;i<FRAME_RING_SIZE;i++) {
+		m_frames[i].release();
+		m_overlays[i].reset();
+	}
+	m_tail = m_head;
+	for(auto c : m_cursors)
+		c->m_next = m_head;
+	m_isCancelled = false;
+}
@@ -0,0 +1,73 @@
+#ifndef FRAMERING_H
+#define FRAMERING_H
+
+#include "dragon-eye.h"
+#include "overlay.h"
+
+#include <mutex>
+#include <condition_variable>
+
+#define FRAME_RING_SIZE              	16     /* Frames kept for the slowest consumer */
+
+/*
+* Broadcast ring of frames, one producer publishes each frame once and every consumer reads it through its own cursor.
+* Producer never waits. A consumer lagging more than its depth drops its oldest frames, other consumers are not affected.
+* Frames are shared (Mat reference), a slot is released once all attached consumers have read it.
+* Overlay record of a frame goes with it, rasterized by consumer.
+*/
+
+class FrameRing
+{
+public:
+	struct cancelled {};
+
+	class Cursor {
+	private:
+		friend class FrameRing;
+		const char *m_name;
+		uint64_t m_next; /* Sequence of next frame to read */
+		size_t m_depth; /* Maximum lag before dropping */
+		uint64_t m_frames, m_drops;
+		size_t m_maxLag;
+		bool m_isAttached;
+
+	public:
+		Cursor() : m_name(""), m_next(0), m_depth(FRAME_RING_SIZE), m_frames(0), m_drops(0), m_maxLag(0), m_isAttached(false) {}
+
+		inline const char *Name() const { return m_name; }
+		inline uint64_t Frames() const { return m_frames; } /* Frames read */
+		inline uint64_t Drops() const { return m_drops; } /* Frames dropped by lag */
+		inline size_t MaxLag() const { return m_maxLag; } /* Frames behind producer, worst after read */
+	};
+
+private:
+	Mat m_frames[FRAME_RING_SIZE];
+	OverlayPtr m_overlays[FRAME_RING_SIZE];
+	uint64_t m_head; /* Sequence of next frame to publish */
+	uint64_t m_tail; /* Oldest frame still held */
+	vector< Cursor * > m_cursors;
+	bool m_isCancelled;
+	std::mutex m_mutex;
+	std::condition_variable m_event;
+
+	void ReleaseConsumed(); /* Locked */
+
+public:
+	FrameRing() : m_head(0), m_tail(0), m_isCancelled(false) {}
+
+	/* Cursor starts from next published frame, depth is limited to FRAME_RING_SIZE */
+	void Attach(Cursor & c, const char *name, size_t depth = FRAME_RING_SIZE);
+	void Detach(Cursor & c);
+	bool HasConsumer();
+
+	void Publish(const Mat & frame, const OverlayPtr & overlay = OverlayPtr());
+
+	/* Waits for a frame newer than cursor, throws cancelled */
+	void Read(Cursor & c, Mat & frame);
+	void Read(Cursor & c, Mat & frame, OverlayPtr & overlay); /* Overlay is empty if frame has none */
+
+	void Cancel(); /* Wakes up and cancels all consumers */
+	void Reset();
+};
+
+#endif
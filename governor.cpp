@@ -0,0 +1,46 @@
+#include "governor.h"
+
+static const char *s_levelName[NUM_LOAD_LEVEL] = {
+	"normal", "no overlay", "half output fps", "shrink region", "half resolution band"
+};
+
+void LoadGovernor::Reset(int fps)
+{
+	m_budgetUs = 1000000 / max(1, fps);
+	m_level = LOAD_LEVEL_NORMAL;
+	m_overCount = 0;
+	m_headroomCount = 0;
+}
+
+bool LoadGovernor::Update(long stageUs)
+{
+	int level = m_level.load();
+
+	if(stageUs > m_budgetUs) {
+		m_headroomCount = 0;
+		if(++m_overCount < LOAD_OVER_BUDGET_FRAMES || level == NUM_LOAD_LEVEL - 1)
+			return false;
+		level++;
+	} else {
+		if(m_overCount > 0)
+			m_overCount--;
+		if(stageUs > m_budgetUs * LOAD_HEADROOM_RATIO) {
+			m_headroomCount = 0;
+			return false;
+		}
+		if(++m_headroomCount < LOAD_HEADROOM_FRAMES || level == LOAD_LEVEL_NORMAL)
+			return false;
+		level--;
+	}
+
+	m_overCount = 0;
+	m_headroomCount = 0;
+	m_level = level;
+
+	return true;
+}
+
+const char *LoadGovernor::LevelName(LoadLevel_t level)
+{
+	return (level >= 0 && level < NUM_LOAD_LEVEL) ? s_levelName[level] : "unknown";
+}
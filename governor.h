@@ -0,0 +1,46 @@
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include "dragon-eye.h"
+
+#include <atomic>
+
+/*
+* Load shedding by measured frame budget. Levels degrade in fixed order, each includes the ones before.
+*/
+
+typedef enum {
+	LOAD_LEVEL_NORMAL,
+	LOAD_LEVEL_NO_OVERLAY, /* Result frames without overlay drawing, relieves encoder thread */
+	LOAD_LEVEL_HALF_OUTPUT_FPS, /* Every other output frame repeats the previous one */
+	LOAD_LEVEL_SHRINK_REGION, /* Processing region shrinks to rows above horizon and center of width */
+	LOAD_LEVEL_HALF_RESOLUTION_BAND, /* Processing region outside center band at half resolution */
+	NUM_LOAD_LEVEL
+} LoadLevel_t;
+
+class LoadGovernor
+{
+private:
+	long m_budgetUs;
+	std::atomic<int> m_level;
+	int m_overCount; /* Over budget frames, decays by frames within budget */
+	int m_headroomCount; /* Successive frames with headroom */
+
+public:
+	LoadGovernor() : m_budgetUs(1000000 / CAMERA_FPS), m_level(LOAD_LEVEL_NORMAL), m_overCount(0), m_headroomCount(0) {}
+
+	void Reset(int fps);
+
+	/*
+	* Slowest stage of a frame, capture / detection / tracking and encoder thread. Pipeline runs at the speed of its slowest stage, frames fall behind once it is over budget.
+	* Returns true if level is changed. Not thread safe, one thread updates.
+	*/
+	bool Update(long stageUs);
+
+	inline LoadLevel_t Level() const { return static_cast<LoadLevel_t>(m_level.load()); }
+	inline long BudgetUs() const { return m_budgetUs; }
+
+	static const char *LevelName(LoadLevel_t level);
+};
+
+#endif
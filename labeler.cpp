@@ -0,0 +1,222 @@
+#include "labeler.h"
+
+#define MIN_STRIPE_HEIGHT 64
+
+static inline int FindRoot(vector<BlobLabeler::Run> & runs, int i)
+{
+	while(runs[i].parent != i) {
+		runs[i].parent = runs[runs[i].parent].parent; /* Path halving */
+		i = runs[i].parent;
+	}
+	return i;
+}
+
+static inline int FindRoot(vector<int> & parent, int i)
+{
+	while(parent[i] != i) {
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+	return i;
+}
+
+static inline void Union(vector<BlobLabeler::Run> & runs, int a, int b)
+{
+	a = FindRoot(runs, a);
+	b = FindRoot(runs, b);
+	if(a < b) /* Root is always the earliest run */
+		runs[b].parent = a;
+	else if(b < a)
+		runs[a].parent = b;
+}
+
+static inline void Union(vector<int> & parent, int a, int b)
+{
+	a = FindRoot(parent, a);
+	b = FindRoot(parent, b);
+	if(a < b)
+		parent[b] = a;
+	else if(b < a)
+		parent[a] = b;
+}
+
+static void LabelStripe(const BitMask & mask, const Mat & gray, BlobLabeler::Stripe & s)
+{
+	const int cols = mask.Cols();
+	const int n = mask.WordsPerRow();
+
+	s.runs.clear();
+	s.lastRowRun = 0;
+
+	int prevBegin = 0, prevEnd = 0; /* Runs of previous row */
+
+	for(int y=s.rowStart;y<s.rowEnd;y++) {
+		const uint64_t *row = mask.Row(y);
+		const uchar *g = gray.ptr<uchar>(y);
+		int curBegin = s.runs.size();
+		int j = prevBegin;
+
+		int x = 0;
+		while(x < cols) {
+			/* Next set bit */
+			int i = x >> 6;
+			uint64_t w = row[i] & (~(uint64_t)0 << (x & 63));
+			while(w == 0 && ++i < n)
+				w = row[i];
+			if(i >= n)
+				break;
+			int x0 = (i << 6) + __builtin_ctzll(w);
+
+			/* Next clear bit, bits beyond width are 0 */
+			i = x0 >> 6;
+			w = ~row[i] & (~(uint64_t)0 << (x0 & 63));
+			while(w == 0 && ++i < n)
+				w = ~row[i];
+			int x1 = (i >= n) ? cols : min(cols, (i << 6) + __builtin_ctzll(w));
+
+			BlobLabeler::Run r;
+			r.y = y;
+			r.x0 = x0;
+			r.x1 = x1;
+			r.parent = s.runs.size();
+			uint8_t lo = 255, hi = 0;
+			for(int k=x0;k<x1;k++) {
+				lo = min(lo, g[k]);
+				hi = max(hi, g[k]);
+			}
+			r.minVal = lo;
+			r.maxVal = hi;
+			s.runs.push_back(r);
+
+			/* 8 connectivity : previous row run [p.x0, p.x1) touches [x0 - 1, x1] */
+			while(j < prevEnd && s.runs[j].x1 < x0)
+				j++;
+			for(int k=j;k<prevEnd && s.runs[k].x0 <= x1;k++)
+				Union(s.runs, r.parent, k);
+
+			x = x1;
+		}
+
+		prevBegin = curBegin;
+		prevEnd = s.runs.size();
+		s.lastRowRun = curBegin;
+	}
+}
+
+class LabelInvoker : public ParallelLoopBody
+{
+private:
+	const BitMask & m_mask;
+	const Mat & m_gray;
+	vector< BlobLabeler::Stripe > & m_stripes;
+
+public:
+	LabelInvoker(const BitMask & mask, const Mat & gray, vector< BlobLabeler::Stripe > & stripes) :
+		m_mask(mask), m_gray(gray), m_stripes(stripes) {}
+
+	void operator()(const Range & range) const override {
+		for(int i=range.start;i<range.end;i++)
+			LabelStripe(m_mask, m_gray, m_stripes[i]);
+	}
+};
+
+void BlobLabeler::Label(const BitMask & mask, const Mat & gray, vector<Blob> & blobs)
+{
+	CV_Assert(gray.type() == CV_8UC1 && gray.rows == mask.Rows() && gray.cols == mask.Cols());
+
+	blobs.clear();
+
+	int rows = mask.Rows();
+	if(rows == 0)
+		return;
+
+	int numStripes = max(1, min(getNumThreads(), rows / MIN_STRIPE_HEIGHT));
+	if(m_stripes.size() != (size_t)numStripes)
+		m_stripes.resize(numStripes);
+	for(int i=0;i<numStripes;i++) {
+		m_stripes[i].rowStart = rows * i / numStripes;
+		m_stripes[i].rowEnd = rows * (i + 1) / numStripes;
+	}
+
+	if(numStripes > 1)
+		parallel_for_(Range(0, numStripes), LabelInvoker(mask, gray, m_stripes), numStripes);
+	else
+		LabelStripe(mask, gray, m_stripes[0]);
+
+	/* Global labels : run index of stripe plus offset */
+	vector< int > & offset = m_offset;
+	offset.assign(numStripes + 1, 0);
+	for(int i=0;i<numStripes;i++)
+		offset[i + 1] = offset[i] + m_stripes[i].runs.size();
+
+	int total = offset[numStripes];
+	m_parent.resize(total);
+	for(int i=0;i<numStripes;i++) {
+		const vector< Run > & runs = m_stripes[i].runs;
+		for(size_t k=0;k<runs.size();k++)
+			m_parent[offset[i] + k] = offset[i] + runs[k].parent;
+	}
+
+	/* Merge at seams, last row of stripe i against first row of stripe i + 1 */
+	for(int i=0;i+1<numStripes;i++) {
+		const Stripe & a = m_stripes[i];
+		const Stripe & b = m_stripes[i + 1];
+		if(a.runs.empty() || b.runs.empty())
+			continue;
+		if(a.runs.back().y != a.rowEnd - 1 || b.runs.front().y != b.rowStart)
+			continue; /* Empty row at seam */
+
+		int aEnd = a.runs.size();
+		int j = a.lastRowRun;
+		for(size_t k=0;k<b.runs.size() && b.runs[k].y == b.rowStart;k++) {
+			const Run & r = b.runs[k];
+			while(j < aEnd && a.runs[j].x1 < r.x0)
+				j++;
+			for(int l=j;l<aEnd && a.runs[l].x0 <= r.x1;l++)
+				Union(m_parent, offset[i] + l, offset[i + 1] + k);
+		}
+	}
+
+	/* Accumulate stats of runs to their root, roots are in raster order */
+	m_blobIndex.resize(total);
+	m_sumX.clear();
+	m_sumY.clear();
+	for(int i=0;i<numStripes;i++) {
+		const vector< Run > & runs = m_stripes[i].runs;
+		for(size_t k=0;k<runs.size();k++) {
+			const Run & r = runs[k];
+			int g = offset[i] + k;
+			int root = FindRoot(m_parent, g);
+			int count = r.x1 - r.x0;
+			int64_t sumX = (int64_t)(r.x0 + r.x1 - 1) * count / 2;
+			if(root == g) {
+				m_blobIndex[g] = blobs.size();
+				Blob b;
+				b.rect = Rect(r.x0, r.y, count, 1);
+				b.area = count;
+				b.minVal = r.minVal;
+				b.maxVal = r.maxVal;
+				blobs.push_back(b);
+				m_sumX.push_back(sumX);
+				m_sumY.push_back((int64_t)r.y * count);
+			} else {
+				int bi = m_blobIndex[root];
+				Blob & b = blobs[bi];
+				int bx1 = max(b.rect.x + b.rect.width, r.x1);
+				int by1 = max(b.rect.y + b.rect.height, r.y + 1);
+				b.rect.x = min(b.rect.x, r.x0);
+				b.rect.y = min(b.rect.y, r.y);
+				b.rect.width = bx1 - b.rect.x;
+				b.rect.height = by1 - b.rect.y;
+				b.area += count;
+				b.minVal = min(b.minVal, r.minVal);
+				b.maxVal = max(b.maxVal, r.maxVal);
+				m_sumX[bi] += sumX;
+				m_sumY[bi] += (int64_t)r.y * count;
+			}
+		}
+	}
+
+	for(size_t i=0;i<blobs.size();i++)
+		blobs[i].centroid = Point2f((float)m_sumX[i] / blobs[i].area, (float)m_sumY[i] / blobs[i].area);
+}
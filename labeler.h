@@ -0,0 +1,47 @@
+#ifndef LABELER_H
+#define LABELER_H
+
+#include "dragon-eye.h"
+#include "bitmask.h"
+
+/*
+* Run length connected components (8 connectivity) of a bit packed mask.
+* One pass over mask and gray frame gives bounding box, pixel count, intensity min / max and centroid of every blob.
+* Horizontal stripes are labeled in parallel then merged at the seams.
+*/
+
+typedef struct {
+	Rect rect;
+	int area; /* Pixel count */
+	uint8_t minVal, maxVal; /* Intensity of gray frame over blob pixels */
+	Point2f centroid;
+} Blob;
+
+class BlobLabeler
+{
+public:
+	typedef struct {
+		int y, x0, x1; /* [x0, x1) */
+		int parent;
+		uint8_t minVal, maxVal;
+	} Run;
+
+	typedef struct {
+		vector< Run > runs;
+		int rowStart, rowEnd;
+		int lastRowRun; /* First run of last row */
+	} Stripe;
+
+private:
+	vector< Stripe > m_stripes;
+	vector< int > m_parent;
+	vector< int > m_offset; /* First global label of stripe */
+	vector< int > m_blobIndex;
+	vector< int64_t > m_sumX, m_sumY;
+
+public:
+	/* gray is CV_8UC1 with the same size of mask, blobs are ordered by their first pixel in raster order */
+	void Label(const BitMask & mask, const Mat & gray, vector<Blob> & blobs);
+};
+
+#endif
@@ -0,0 +1,290 @@
+#include "mog2simd.h"
+#include "simd.h"
+
+#include <float.h>
+
+/*
+* Model of a row is kept as planes of colsAligned floats, so one vector load reads the same mode of VFloat::N pixels.
+*/
+
+enum { PLANE_WEIGHT = 0, PLANE_MEAN = 1, PLANE_VARIANCE = 2 };
+
+#define MODEL_PLANES (3 * BackgroundSubtractorMOG2Simd::NMIXTURES + 1)
+
+typedef struct {
+	float alphaT, alpha1, prune;
+	float Tb, TB, Tg;
+	float varInit, varMin, varMax;
+} Mog2Params;
+
+static void Mog2Row(const float *data, uchar *mask, float *model, int cols, int colsAligned, const Mog2Params & p)
+{
+	const int nmix = BackgroundSubtractorMOG2Simd::NMIXTURES;
+
+	float *w = model + PLANE_WEIGHT * nmix * colsAligned;
+	float *mu = model + PLANE_MEAN * nmix * colsAligned;
+	float *var = model + PLANE_VARIANCE * nmix * colsAligned;
+	float *modesUsed = model + 3 * nmix * colsAligned;
+
+	const VFloat vAlphaT = VFloat::set1(p.alphaT);
+	const VFloat vAlpha1 = VFloat::set1(p.alpha1);
+	const VFloat vPrune = VFloat::set1(p.prune);
+	const VFloat vMinWeight = VFloat::set1(-p.prune);
+	const VFloat vTb = VFloat::set1(p.Tb);
+	const VFloat vTB = VFloat::set1(p.TB);
+	const VFloat vTg = VFloat::set1(p.Tg);
+	const VFloat vVarInit = VFloat::set1(p.varInit);
+	const VFloat vVarMin = VFloat::set1(p.varMin);
+	const VFloat vVarMax = VFloat::set1(p.varMax);
+	const VFloat vZero = VFloat::zero();
+	const VFloat vOne = VFloat::set1(1.f);
+	const VFloat vNMix = VFloat::set1((float)nmix);
+	const VFloat vEpsilon = VFloat::set1(FLT_EPSILON);
+
+	float fg[VFloat::N];
+
+	for(int x=0;x<colsAligned;x+=VFloat::N) {
+		VFloat d = VFloat::load(data + x);
+		VFloat nmodes = VFloat::load(modesUsed + x);
+		VFloat fitsPDF = vZero; /* Masks */
+		VFloat background = vZero;
+		VFloat totalWeight = vZero;
+
+		for(int mode=0;mode<nmix;mode++) {
+			VFloat active = VFloat::lt(VFloat::set1((float)mode), nmodes); /* nmodes shrinks while pruning */
+			if(!VFloat::any(active))
+				break;
+
+			float *wp = w + mode * colsAligned + x;
+			float *mp = mu + mode * colsAligned + x;
+			float *vp = var + mode * colsAligned + x;
+
+			VFloat wm = VFloat::load(wp);
+			VFloat mm = VFloat::load(mp);
+			VFloat vm = VFloat::load(vp);
+
+			VFloat weight = vAlpha1 * wm + vPrune;
+
+			VFloat check = VFloat::andnot(fitsPDF, active); /* Fit not found yet */
+			VFloat diff = mm - d;
+			VFloat dist2 = diff * diff;
+
+			background = background | (check & VFloat::lt(totalWeight, vTB) & VFloat::lt(dist2, vTb * vm));
+
+			VFloat fit = check & VFloat::lt(dist2, vTg * vm);
+			if(VFloat::any(fit)) { /* Belongs to the mode, update distribution */
+				VFloat weightFit = weight + vAlphaT;
+				VFloat k = vAlphaT / weightFit;
+				VFloat meanFit = mm - k * diff;
+				VFloat varFit = VFloat::min(VFloat::max(vm + k * (dist2 - vm), vVarMin), vVarMax);
+
+				weight = VFloat::select(fit, weightFit, weight);
+				mm = VFloat::select(fit, meanFit, mm);
+				vm = VFloat::select(fit, varFit, vm);
+				fitsPDF = fitsPDF | fit;
+			}
+
+			VFloat pruned = active & VFloat::lt(weight, vMinWeight);
+			weight = VFloat::select(pruned, vZero, weight);
+			nmodes = VFloat::select(pruned, nmodes - vOne, nmodes);
+
+			VFloat::store(wp, VFloat::select(VFloat::andnot(fit, active), weight, wm));
+			totalWeight = totalWeight + (active & weight);
+
+			if(VFloat::any(fit)) { /* Only the matched mode is higher, find the new place for it */
+				VFloat moving = fit;
+				for(int i=mode;i>0;i--) {
+					VFloat wPrev = VFloat::load(w + (i - 1) * colsAligned + x);
+					VFloat up = moving & VFloat::ge(weight, wPrev);
+					VFloat stop = VFloat::andnot(up, moving);
+					float *wi = w + i * colsAligned + x;
+					float *mi = mu + i * colsAligned + x;
+					float *vi = var + i * colsAligned + x;
+					VFloat::store(wi, VFloat::select(up, wPrev, VFloat::select(stop, weight, VFloat::load(wi))));
+					VFloat::store(mi, VFloat::select(up, VFloat::load(mi - colsAligned), VFloat::select(stop, mm, VFloat::load(mi))));
+					VFloat::store(vi, VFloat::select(up, VFloat::load(vi - colsAligned), VFloat::select(stop, vm, VFloat::load(vi))));
+					moving = up;
+				}
+				float *w0 = w + x;
+				float *m0 = mu + x;
+				float *v0 = var + x;
+				VFloat::store(w0, VFloat::select(moving, weight, VFloat::load(w0)));
+				VFloat::store(m0, VFloat::select(moving, mm, VFloat::load(m0)));
+				VFloat::store(v0, VFloat::select(moving, vm, VFloat::load(v0)));
+			}
+		}
+
+		/* Renormalize weights, set to zero if pixel does not agree with any modes */
+		VFloat invWeight = VFloat::select(VFloat::lt(vEpsilon, VFloat::max(totalWeight, vZero - totalWeight)),
+			vOne / totalWeight, vZero);
+		for(int mode=0;mode<nmix;mode++) {
+			VFloat active = VFloat::lt(VFloat::set1((float)mode), nmodes);
+			if(!VFloat::any(active))
+				break;
+			float *wp = w + mode * colsAligned + x;
+			VFloat wm = VFloat::load(wp);
+			VFloat::store(wp, VFloat::select(active, wm * invWeight, wm));
+		}
+
+		VFloat create = VFloat::andnot(fitsPDF, VFloat::lt(vZero, vAlphaT));
+		if(VFloat::any(create)) { /* Replace the weakest or add a new mode */
+			VFloat full = VFloat::ge(nmodes, vNMix);
+			VFloat pos = VFloat::select(full, vNMix - vOne, nmodes);
+			nmodes = VFloat::select(create, VFloat::select(full, nmodes, nmodes + vOne), nmodes);
+
+			VFloat single = VFloat::eq(nmodes, vOne);
+			VFloat weight = VFloat::select(single, vOne, vAlphaT);
+
+			VFloat renorm = VFloat::andnot(single, create);
+			for(int i=0;i<nmix-1;i++) { /* Renormalize all other weights */
+				VFloat m = renorm & VFloat::lt(VFloat::set1((float)i), nmodes - vOne);
+				float *wp = w + i * colsAligned + x;
+				VFloat wm = VFloat::load(wp);
+				VFloat::store(wp, VFloat::select(m, wm * vAlpha1, wm));
+			}
+
+			VFloat moving = create;
+			for(int i=nmix-1;i>0;i--) {
+				VFloat vi = VFloat::set1((float)i);
+				VFloat inRange = moving & VFloat::ge(pos, vi);
+				VFloat wPrev = VFloat::load(w + (i - 1) * colsAligned + x);
+				VFloat up = inRange & VFloat::ge(vAlphaT, wPrev);
+				VFloat stop = VFloat::andnot(up, inRange);
+				float *wi = w + i * colsAligned + x;
+				float *mi = mu + i * colsAligned + x;
+				float *ri = var + i * colsAligned + x;
+				VFloat::store(wi, VFloat::select(up, wPrev, VFloat::select(stop, weight, VFloat::load(wi))));
+				VFloat::store(mi, VFloat::select(up, VFloat::load(mi - colsAligned), VFloat::select(stop, d, VFloat::load(mi))));
+				VFloat::store(ri, VFloat::select(up, VFloat::load(ri - colsAligned), VFloat::select(stop, vVarInit, VFloat::load(ri))));
+				moving = VFloat::andnot(stop, moving);
+			}
+			float *w0 = w + x;
+			float *m0 = mu + x;
+			float *v0 = var + x;
+			VFloat::store(w0, VFloat::select(moving, weight, VFloat::load(w0)));
+			VFloat::store(m0, VFloat::select(moving, d, VFloat::load(m0)));
+			VFloat::store(v0, VFloat::select(moving, vVarInit, VFloat::load(v0)));
+		}
+
+		VFloat::store(modesUsed + x, nmodes);
+
+		VFloat::store(fg, VFloat::andnot(background, VFloat::set1(255.f)));
+		int n = min((int)VFloat::N, cols - x);
+		for(int i=0;i<n;i++)
+			mask[x + i] = (uchar)fg[i];
+	}
+}
+
+class Mog2Invoker : public ParallelLoopBody
+{
+private:
+	const Mat & m_src;
+	Mat & m_dst;
+	float *m_model;
+	int m_colsAligned;
+	const Mog2Params & m_params;
+
+public:
+	Mog2Invoker(const Mat & src, Mat & dst, float *model, int colsAligned, const Mog2Params & params) :
+		m_src(src), m_dst(dst), m_model(model), m_colsAligned(colsAligned), m_params(params) {}
+
+	void operator()(const Range & range) const override {
+		static thread_local vector< float > data; /* Row of pixels, grows once per worker thread, no allocation per frame */
+		if(data.size() < (size_t)m_colsAligned)
+			data.resize(m_colsAligned);
+		const size_t rowSize = (size_t)MODEL_PLANES * m_colsAligned;
+
+		for(int y=range.start;y<range.end;y++) {
+			const uchar *s = m_src.ptr<uchar>(y);
+			for(int x=0;x<m_src.cols;x++)
+				data[x] = s[x];
+			for(int x=m_src.cols;x<m_colsAligned;x++) /* Lanes past width, left from a wider frame */
+				data[x] = 0.f;
+			Mog2Row(data.data(), m_dst.ptr<uchar>(y), m_model + y * rowSize, m_src.cols, m_colsAligned, m_params);
+		}
+	}
+};
+
+BackgroundSubtractorMOG2Simd::BackgroundSubtractorMOG2Simd(int history, double varThreshold, bool detectShadows) :
+	m_history(history), m_varThreshold((float)varThreshold), m_backgroundRatio(0.9f), m_varThresholdGen(9.f),
+	m_varInit(15.f), m_varMin(4.f), m_varMax(75.f), m_complexityReductionThreshold(0.05f),
+	m_detectShadows(detectShadows), m_shadowValue(127), m_shadowThreshold(0.5),
+	m_nframes(0), m_colsAligned(0)
+{
+}
+
+void BackgroundSubtractorMOG2Simd::Initialize(Size frameSize)
+{
+	m_frameSize = frameSize;
+	m_nframes = 0;
+	m_colsAligned = (frameSize.width + VFloat::N - 1) / VFloat::N * VFloat::N;
+	m_model.assign((size_t)MODEL_PLANES * m_colsAligned * frameSize.height, 0.f);
+}
+
+void BackgroundSubtractorMOG2Simd::apply(InputArray _image, OutputArray _fgmask, double learningRate)
+{
+	Mat image = _image.getMat();
+	CV_Assert(image.type() == CV_8UC1);
+
+	if(m_nframes == 0 || learningRate >= 1 || image.size() != m_frameSize)
+		Initialize(image.size());
+
+	++m_nframes;
+	learningRate = (learningRate >= 0 && m_nframes > 1) ? learningRate : 1. / min(2 * m_nframes, m_history);
+
+	_fgmask.create(image.size(), CV_8UC1);
+	Mat fgmask = _fgmask.getMat();
+
+	Mog2Params p;
+	p.alphaT = (float)learningRate;
+	p.alpha1 = 1.f - p.alphaT;
+	p.prune = -(float)learningRate * m_complexityReductionThreshold;
+	p.Tb = m_varThreshold;
+	p.TB = m_backgroundRatio;
+	p.Tg = m_varThresholdGen;
+	p.varInit = m_varInit;
+	p.varMin = m_varMin;
+	p.varMax = m_varMax;
+
+	parallel_for_(Range(0, image.rows), Mog2Invoker(image, fgmask, m_model.data(), m_colsAligned, p),
+		image.total() / (double)(1 << 16));
+}
+
+void BackgroundSubtractorMOG2Simd::getBackgroundImage(OutputArray backgroundImage) const
+{
+	if(m_model.empty()) {
+		backgroundImage.release();
+		return;
+	}
+
+	const int nmix = NMIXTURES;
+	const size_t rowSize = (size_t)MODEL_PLANES * m_colsAligned;
+
+	backgroundImage.create(m_frameSize, CV_8UC1);
+	Mat bg = backgroundImage.getMat();
+
+	for(int y=0;y<m_frameSize.height;y++) {
+		const float *w = m_model.data() + y * rowSize;
+		const float *mu = w + nmix * m_colsAligned;
+		const float *modesUsed = w + 3 * nmix * m_colsAligned;
+		uchar *b = bg.ptr<uchar>(y);
+		for(int x=0;x<m_frameSize.width;x++) {
+			float totalWeight = 0.f;
+			float meanVal = 0.f;
+			int nmodes = (int)modesUsed[x];
+			for(int mode=0;mode<nmodes;mode++) { /* Weighted mean of modes until background ratio reached */
+				float weight = w[mode * m_colsAligned + x];
+				meanVal += weight * mu[mode * m_colsAligned + x];
+				totalWeight += weight;
+				if(totalWeight > m_backgroundRatio)
+					break;
+			}
+			b[x] = (totalWeight > FLT_EPSILON) ? saturate_cast<uchar>(meanVal / totalWeight) : 0;
+		}
+	}
+}
+
+Ptr<BackgroundSubtractorMOG2> createBackgroundSubtractorMOG2Simd(int history, double varThreshold, bool detectShadows)
+{
+	return makePtr<BackgroundSubtractorMOG2Simd>(history, varThreshold, detectShadows);
+}
@@ -0,0 +1,71 @@
+#ifndef MOG2SIMD_H
+#define MOG2SIMD_H
+
+#include "dragon-eye.h"
+
+/*
+* CPU background subtractor MOG2 for 8 bits gray frame.
+* Same model and update rules as OpenCV BackgroundSubtractorMOG2 (Zivkovic 2004 / 2006),
+* pixels are processed in SIMD lanes (SSE2 / AVX2 / NEON) and rows are split across cores.
+* Shadow detection is not supported.
+*/
+
+class BackgroundSubtractorMOG2Simd : public BackgroundSubtractorMOG2
+{
+public:
+	enum { NMIXTURES = 5 };
+
+private:
+	int m_history;
+	float m_varThreshold;
+	float m_backgroundRatio;
+	float m_varThresholdGen;
+	float m_varInit, m_varMin, m_varMax;
+	float m_complexityReductionThreshold;
+	bool m_detectShadows;
+	int m_shadowValue;
+	double m_shadowThreshold;
+
+	Size m_frameSize;
+	int m_nframes;
+	int m_colsAligned;
+	vector< float > m_model; /* Per row : weight[NMIXTURES] | mean[NMIXTURES] | variance[NMIXTURES] | modes used */
+
+	void Initialize(Size frameSize);
+
+public:
+	BackgroundSubtractorMOG2Simd(int history = 500, double varThreshold = 16, bool detectShadows = false);
+
+	virtual void apply(InputArray image, OutputArray fgmask, double learningRate = -1) override;
+	virtual void getBackgroundImage(OutputArray backgroundImage) const override;
+	virtual void clear() override { m_nframes = 0; }
+
+	virtual int getHistory() const override { return m_history; }
+	virtual void setHistory(int history) override { m_history = history; }
+	virtual int getNMixtures() const override { return NMIXTURES; }
+	virtual void setNMixtures(int) override { /* Fixed number of mixtures */ }
+	virtual double getBackgroundRatio() const override { return m_backgroundRatio; }
+	virtual void setBackgroundRatio(double ratio) override { m_backgroundRatio = (float)ratio; }
+	virtual double getVarThreshold() const override { return m_varThreshold; }
+	virtual void setVarThreshold(double varThreshold) override { m_varThreshold = (float)varThreshold; }
+	virtual double getVarThresholdGen() const override { return m_varThresholdGen; }
+	virtual void setVarThresholdGen(double varThresholdGen) override { m_varThresholdGen = (float)varThresholdGen; }
+	virtual double getVarInit() const override { return m_varInit; }
+	virtual void setVarInit(double varInit) override { m_varInit = (float)varInit; }
+	virtual double getVarMin() const override { return m_varMin; }
+	virtual void setVarMin(double varMin) override { m_varMin = (float)varMin; }
+	virtual double getVarMax() const override { return m_varMax; }
+	virtual void setVarMax(double varMax) override { m_varMax = (float)varMax; }
+	virtual double getComplexityReductionThreshold() const override { return m_complexityReductionThreshold; }
+	virtual void setComplexityReductionThreshold(double ct) override { m_complexityReductionThreshold = (float)ct; }
+	virtual bool getDetectShadows() const override { return m_detectShadows; }
+	virtual void setDetectShadows(bool detectShadows) override { m_detectShadows = detectShadows; }
+	virtual int getShadowValue() const override { return m_shadowValue; }
+	virtual void setShadowValue(int value) override { m_shadowValue = value; }
+	virtual double getShadowThreshold() const override { return m_shadowThreshold; }
+	virtual void setShadowThreshold(double threshold) override { m_shadowThreshold = threshold; }
+};
+
+Ptr<BackgroundSubtractorMOG2> createBackgroundSubtractorMOG2Simd(int history = 500, double varThreshold = 16, bool detectShadows = false);
+
+#endif
@@ -0,0 +1,150 @@
+#include "overlay.h"
+
+void OverlayRecord::Clear()
+{
+	isDraw = false;
+	seq = 0;
+	tracks.clear();
+	centerX = 0;
+	horizonY = 0;
+	rois.clear();
+	restrictionRect = Rect();
+	processRect = Rect();
+	newTargetCells.clear();
+	newTargetOverflow.clear();
+	targets.clear();
+	trajectories.clear();
+	isTrigger = false;
+	time = 0;
+	fps = 0;
+	mog2Threshold = 0;
+	exposureThreshold = 0;
+	droppedFrames = 0;
+}
+
+void OverlayPool::Create(int count)
+{
+	m_records.resize(count);
+	for(int i=0;i<count;i++) {
+		if(!m_records[i])
+			m_records[i] = std::make_shared<OverlayRecord>();
+		m_records[i]->tracks.reserve(MAX_NUM_TARGET * 2);
+		m_records[i]->targets.reserve(MAX_NUM_TARGET * 2);
+		m_records[i]->trajectories.reserve(MAX_NUM_TARGET * MAX_TARGET_HISTORY);
+	}
+	m_next = 0;
+}
+
+OverlayPtr OverlayPool::Acquire()
+{
+	size_t n = m_records.size();
+	for(size_t k=0;k<n;k++) {
+		size_t i = (m_next + k) % n;
+		if(m_records[i].use_count() == 1) { /* Only referred by pool */
+			m_next = (i + 1) % n;
+			m_records[i]->Clear();
+			return m_records[i];
+		}
+	}
+
+	dprintf("Overlay pool grows to %lu\n", (unsigned long)n + 1);
+	m_records.push_back(std::make_shared<OverlayRecord>());
+	m_next = 0;
+	return m_records.back();
+}
+
+OverlayRenderer::OverlayRenderer() : m_lastTime(0)
+{
+	int baseline = 0;
+	Size box = getTextSize("Ag", OVERLAY_FONT_FACE, OVERLAY_FONT_SCALE, OVERLAY_FONT_THICKNESS, &baseline);
+
+	m_pad = OVERLAY_FONT_THICKNESS;
+	m_ascent = box.height + m_pad;
+	m_cellHeight = m_ascent + baseline + m_pad;
+
+	int x = 0;
+	for(int i=0;i<96;i++) {
+		Size sz = getTextSize(string(1, (char)(' ' + i)), OVERLAY_FONT_FACE, OVERLAY_FONT_SCALE, OVERLAY_FONT_THICKNESS, &baseline);
+		m_advance[i] = max(1, sz.width - OVERLAY_FONT_THICKNESS); /* Width of text includes thickness once */
+		m_cellWidth[i] = m_advance[i] + m_pad * 2;
+		m_glyphX[i] = x;
+		x += m_cellWidth[i];
+	}
+
+	m_atlas = Mat::zeros(m_cellHeight, x, CV_8UC1);
+	for(int i=0;i<96;i++)
+		putText(m_atlas, string(1, (char)(' ' + i)), Point(m_glyphX[i] + m_pad, m_ascent), OVERLAY_FONT_FACE, OVERLAY_FONT_SCALE,
+			Scalar(255), OVERLAY_FONT_THICKNESS, cv::LINE_8);
+
+	m_timeText[0] = '\0';
+}
+
+/* Same place as putText with origin at bottom left of text, black */
+void OverlayRenderer::DrawText(Mat & frame, const char *text, Point org)
+{
+	Rect bound(0, 0, frame.cols, frame.rows);
+	int x = org.x;
+	for(const char *c=text;*c;c++) {
+		int i = (*c >= ' ' && *c < ' ' + 96) ? *c - ' ' : '?' - ' ';
+		Rect dst(x - m_pad, org.y - m_ascent, m_cellWidth[i], m_cellHeight);
+		Rect clip = dst & bound;
+		if(clip.area() > 0) {
+			Rect src(m_glyphX[i] + clip.x - dst.x, clip.y - dst.y, clip.width, clip.height);
+			frame(clip).setTo(Scalar(0, 0, 0), m_atlas(src));
+		}
+		x += m_advance[i];
+	}
+}
+
+void OverlayRenderer::Render(Mat & frame, const OverlayRecord & rec)
+{
+	int cy = frame.rows - 1;
+
+	line(frame, Point(rec.centerX, 0), Point(rec.centerX, cy), Scalar(0, 255, 0), 1);
+
+	for(auto & r : rec.rois)
+		rectangle(frame, r.tl(), r.br(), Scalar(0, 255, 0), 2, 8, 0);
+	if(rec.restrictionRect.area() > 0) {
+		rectangle(frame, rec.restrictionRect.tl(), rec.restrictionRect.br(), Scalar(127, 0, 127), 2, 8, 0);
+		DrawText(frame, "New Target Restriction Area", Point(120, frame.rows - 180));
+	}
+	line(frame, Point(0, rec.horizonY), Point(frame.cols, rec.horizonY), Scalar(0, 255, 255), 1);
+	if(rec.processRect.area() > 0)
+		rectangle(frame, rec.processRect.tl(), rec.processRect.br(), Scalar(255, 127, 0), 1, 8, 0);
+
+	for(auto & r : rec.newTargetCells)
+		rectangle(frame, r, Scalar(127, 127, 0), 1, 8, 0);
+	for(auto & r : rec.newTargetOverflow)
+		rectangle(frame, r.tl(), r.br(), Scalar(127, 127, 0), 2, 8, 0);
+
+	for(auto & t : rec.targets) { /* Trajectory with rects of all samples */
+		for(size_t i=t.begin;i<t.end;i++) {
+			const Rect & r = rec.trajectories[i];
+			rectangle(frame, r.tl(), r.br(), t.color, 1, 8, 0);
+			if(i + 1 < t.end) {
+				const Rect & n = rec.trajectories[i + 1];
+				line(frame, Point(r.x + r.width / 2, r.y + r.height / 2), Point(n.x + n.width / 2, n.y + n.height / 2), t.color, 1);
+			}
+		}
+	}
+
+	if(rec.isTrigger)
+		line(frame, Point(rec.centerX, 0), Point(rec.centerX, cy), Scalar(0, 0, 255), 3);
+
+	if(rec.time != m_lastTime) {
+		struct tm tstruct = *localtime(&rec.time);
+		strftime(m_timeText, sizeof(m_timeText), "%H:%M:%S %m/%d", &tstruct);
+		m_lastTime = rec.time;
+	}
+	DrawText(frame, m_timeText, Point(40, 160));
+
+	char str[32];
+	snprintf(str, 32, "FPS %.2lf", rec.fps);
+	DrawText(frame, str, Point(40, 200));
+	snprintf(str, 32, "MOG2 threshold %d", rec.mog2Threshold);
+	DrawText(frame, str, Point(40, 240));
+	snprintf(str, 32, "Exposure threshold %d", rec.exposureThreshold);
+	DrawText(frame, str, Point(40, 280));
+	snprintf(str, 32, "Dropped frames %lu", rec.droppedFrames);
+	DrawText(frame, str, Point(40, 320));
+}
@@ -0,0 +1,103 @@
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include "dragon-eye.h"
+
+#include <memory>
+#include <time.h>
+
+#define OVERLAY_FONT_FACE            	FONT_HERSHEY_DUPLEX
+#define OVERLAY_FONT_SCALE           	1
+#define OVERLAY_FONT_THICKNESS       	2
+
+/*
+* Result overlay of a frame. Tracking thread only fills a record, output thread rasterizes it onto the frame.
+* Tracks go with every output frame as stream metadata, drawing fields only if isDraw.
+*/
+
+typedef struct {
+	Scalar color;
+	size_t begin, end; /* Trajectory in OverlayRecord::trajectories, the latest is end - 1 */
+} OverlayTarget;
+
+typedef struct {
+	uint32_t id;
+	Rect rect; /* Latest */
+	bool isTrigger; /* Target has triggered */
+} OverlayTrack;
+
+class OverlayRecord
+{
+public:
+	bool isDraw; /* video.output.result */
+	uint64_t seq; /* Frame sequence of capture */
+	vector<OverlayTrack> tracks;
+
+	int centerX, horizonY;
+	vector<Rect> rois; /* Detected blobs */
+	Rect restrictionRect; /* Empty if no new target restriction */
+	Rect processRect; /* Empty if full frame */
+	vector<Rect> newTargetCells; /* New target history */
+	vector<Rect> newTargetOverflow;
+	vector<OverlayTarget> targets;
+	vector<Rect> trajectories; /* Rects of all targets */
+	bool isTrigger; /* Trigger fired on this frame */
+
+	time_t time;
+	double fps;
+	int mog2Threshold;
+	int exposureThreshold;
+	unsigned long droppedFrames;
+
+	OverlayRecord() { Clear(); }
+
+	void Clear(); /* Vectors keep their capacity */
+};
+
+typedef std::shared_ptr<OverlayRecord> OverlayPtr;
+
+/*
+* Records allocated at startup and recycled as FramePool, a record is free again once output has rendered it.
+*/
+
+class OverlayPool
+{
+private:
+	vector<OverlayPtr> m_records;
+	size_t m_next;
+
+public:
+	OverlayPool() : m_next(0) {}
+
+	void Create(int count);
+
+	/* Not thread safe, one thread acquires. Record is cleared */
+	OverlayPtr Acquire();
+};
+
+/*
+* Text is stamped from a glyph atlas rendered once, instead of putText of every glyph stroke by stroke.
+* Time of day is formatted once a second.
+*/
+
+class OverlayRenderer
+{
+private:
+	Mat m_atlas; /* CV_8UC1 mask, printable ASCII in a row */
+	int m_glyphX[96]; /* Cell of glyph in atlas */
+	int m_advance[96];
+	int m_cellWidth[96];
+	int m_ascent, m_cellHeight, m_pad;
+
+	time_t m_lastTime;
+	char m_timeText[32];
+
+	void DrawText(Mat & frame, const char *text, Point org);
+
+public:
+	OverlayRenderer();
+
+	void Render(Mat & frame, const OverlayRecord & rec);
+};
+
+#endif
@@ -0,0 +1,553 @@
+/*
+* dragon-eye-replay : Offline replay and benchmark of the detection pipeline
+*
+* Feeds recorded video files through the same path as main() of dragon-eye :
+* cvtColor -> background subtraction -> erode / dilate -> blob labeling -> Tracker::Update -> center line trigger test
+* No camera, GPIO or serial port required. Reports FPS and per stage latency.
+*/
+
+#include "dragon-eye.h"
+#include "tracker.h"
+#include "detector.h"
+#include "mog2simd.h"
+#include "framepool.h"
+#include "backend.h"
+#include "selfcheck.h"
+
+#include <unistd.h>
+#include <dirent.h>
+#include <string.h>
+
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+
+#define REPLAY_DEFAULT_DIR           	"/opt/Videos"
+#define REPLAY_WARMUP_FRAMES         	30     /* Buffers are allocated by first frames, not counted as large allocations */
+
+static AllocationCounter allocationCounter;
+
+/*
+*
+*/
+
+class StageStats
+{
+private:
+	vector< uint32_t > m_samples; /* us */
+	uint64_t m_total;
+	uint32_t m_max;
+
+public:
+	StageStats() : m_total(0), m_max(0) {}
+
+	void Add(long us) {
+		uint32_t v = (us > 0) ? static_cast<uint32_t>(us) : 0;
+		m_samples.push_back(v);
+		m_total += v;
+		if(v > m_max)
+			m_max = v;
+	}
+
+	void Add(const StageStats & s) {
+		m_samples.insert(m_samples.end(), s.m_samples.begin(), s.m_samples.end());
+		m_total += s.m_total;
+		if(s.m_max > m_max)
+			m_max = s.m_max;
+	}
+
+	inline size_t Count() const { return m_samples.size(); }
+	inline uint64_t Total() const { return m_total; }
+	inline uint32_t Max() const { return m_max; }
+
+	double Average() const {
+		return m_samples.empty() ? 0 : static_cast<double>(m_total) / m_samples.size();
+	}
+
+	uint32_t Percentile(double p) const {
+		if(m_samples.empty())
+			return 0;
+		vector< uint32_t > v(m_samples);
+		size_t n = static_cast<size_t>(p * (v.size() - 1));
+		nth_element(v.begin(), v.begin() + n, v.end());
+		return v[n];
+	}
+};
+
+typedef enum { STAGE_DECODE, STAGE_CVTCOLOR, STAGE_BGSUB, STAGE_MORPH, STAGE_LABEL, STAGE_TRACKER, STAGE_TRIGGER, STAGE_TOTAL, NUM_STAGE } Stage_t;
+
+static const char *s_stageName[NUM_STAGE] = {
+	"decode", "cvtColor", "bgsub", "morph", "label", "tracker", "trigger", "total"
+};
+
+typedef struct {
+	StageStats stage[NUM_STAGE];
+	uint64_t frames;
+	uint64_t overBudgetFrames;
+	uint64_t triggerFrames;
+	uint64_t newTriggers;
+	uint64_t largeAllocations; /* Mat allocations of LARGE_ALLOCATION_SIZE or more after warm up */
+	uint64_t mismatchPixels; /* CPU MOG2 against OpenCV MOG2 */
+	uint64_t comparedPixels;
+	double maxMismatchRatio;
+} ReplayResult;
+
+typedef struct {
+	uint8_t mog2Threshold;
+	uint16_t horizonRatio;
+	bool isFakeTargetDetection;
+	bool isBugTrigger;
+	bool isNewTargetRestriction;
+	BackendType_t backend;
+	bool isBenchmarkBackend; /* Same files on CPU then CUDA backend */
+	bool isCompareMog2;
+	Rect processRegion; /* Empty is whole frame */
+	bool isAutoProcessRegion;
+	int pyramidScale; /* 1 is full resolution */
+	int minCoarseArea;
+	long frameBudgetUs;
+	uint64_t maxFrames;
+	bool verbose;
+} ReplayConfig;
+
+static void ResetResult(ReplayResult & r)
+{
+	for(int i=0;i<NUM_STAGE;i++)
+		r.stage[i] = StageStats();
+	r.frames = 0;
+	r.overBudgetFrames = 0;
+	r.triggerFrames = 0;
+	r.newTriggers = 0;
+	r.largeAllocations = 0;
+	r.mismatchPixels = 0;
+	r.comparedPixels = 0;
+	r.maxMismatchRatio = 0;
+}
+
+static void PrintResult(const char *title, const ReplayResult & r, long frameBudgetUs)
+{
+	printf("\n=== %s\n", title);
+	printf("%-10s %10s %10s %10s %10s\n", "stage", "avg(ms)", "p50(ms)", "p99(ms)", "max(ms)");
+	for(int i=0;i<NUM_STAGE;i++) {
+		const StageStats & s = r.stage[i];
+		printf("%-10s %10.2f %10.2f %10.2f %10.2f\n", s_stageName[i], s.Average() / 1000.0,
+			s.Percentile(0.5) / 1000.0, s.Percentile(0.99) / 1000.0, s.Max() / 1000.0);
+	}
+
+	double totalSecs = r.stage[STAGE_TOTAL].Total() / 1000000.0;
+	printf("frames %llu, detection FPS %.2f, over %.1f ms budget %llu, trigger frames %llu, triggers %llu\n",
+		(unsigned long long)r.frames, totalSecs > 0 ? r.frames / totalSecs : 0, frameBudgetUs / 1000.0,
+		(unsigned long long)r.overBudgetFrames, (unsigned long long)r.triggerFrames, (unsigned long long)r.newTriggers);
+	printf("large allocations after %d frames warm up %llu\n", REPLAY_WARMUP_FRAMES, (unsigned long long)r.largeAllocations);
+	if(r.comparedPixels > 0)
+		printf("MOG2 mask mismatch against OpenCV %.4f %% (worst frame %.4f %%)\n",
+			r.mismatchPixels * 100.0 / r.comparedPixels, r.maxMismatchRatio * 100.0);
+}
+
+static bool ReplayFile(const string & fn, const ReplayConfig & cfg, ReplayResult & result)
+{
+	VideoCapture cap(fn);
+	if(!cap.isOpened()) {
+		cout << "!!! Could not open " << fn << endl;
+		return false;
+	}
+
+	Mat capFrame;
+	if(!cap.read(capFrame) || capFrame.empty()) {
+		cout << "!!! Could not read " << fn << endl;
+		return false;
+	}
+
+	int width = capFrame.cols;
+	int height = capFrame.rows;
+	int cx = (width / 2) - 1;
+
+	Tracker tracker(width, height);
+	tracker.UpdateHorizonRatio(cfg.horizonRatio);
+	if(cfg.isNewTargetRestriction)
+		tracker.NewTargetRestriction(Rect(180, height - 180, 360, 180));
+
+	Detector detector;
+	detector.Initialisize(width, height);
+	detector.HorizonHeight(tracker.HorizonHeight());
+	if(cfg.isAutoProcessRegion)
+		detector.AutoProcessRegion();
+	else
+		detector.ProcessRegion(cfg.processRegion);
+	detector.Pyramid(cfg.pyramidScale, cfg.minCoarseArea);
+	detector.CreateBackgroundModel(cfg.mog2Threshold, cfg.backend);
+
+	Ptr<BackgroundSubtractorMOG2> refModel, simdModel;
+	if(cfg.isCompareMog2) {
+		refModel = createBackgroundSubtractorMOG2(30, cfg.mog2Threshold, false);
+		simdModel = createBackgroundSubtractorMOG2Simd(30, cfg.mog2Threshold, false);
+		SetupBackgroundModel(refModel);
+		SetupBackgroundModel(simdModel);
+	}
+
+	if(cfg.verbose) {
+		Rect pr = detector.ProcessRect(capFrame.size());
+		printf("\n%s : %d x %d, compute backend %s, region (%d, %d) %d x %d\n", fn.c_str(), width, height,
+			detector.Backend().Name(), pr.x, pr.y, pr.width, pr.height);
+	}
+
+	uint64_t lastTriggerFrame = 0;
+	uint8_t doTriggerCount = 0;
+	long decodeUs = 0;
+	unsigned long allocationBase = 0;
+
+	Mat grayFrame; /* Reused by all frames as capFrame */
+	Mat refMask, simdMask, diffMask;
+
+	while(cfg.maxFrames == 0 || result.frames < cfg.maxFrames) {
+		if(result.frames == REPLAY_WARMUP_FRAMES)
+			allocationBase = allocationCounter.Count();
+
+		steady_clock::time_point t0(steady_clock::now());
+
+		detector.Backend().CvtColor(capFrame, grayFrame, COLOR_BGR2GRAY);
+
+		steady_clock::time_point t1(steady_clock::now());
+
+		list<Rect> roiRect;
+		detector.ExtractMovingObject(grayFrame, roiRect);
+
+		steady_clock::time_point t2(steady_clock::now());
+
+		tracker.Update(roiRect, cfg.isFakeTargetDetection);
+
+		steady_clock::time_point t3(steady_clock::now());
+
+		bool doTrigger = false;
+		TargetPool & targets = tracker.TargetList();
+		for(TargetPool::iterator t=targets.begin();t!=targets.end();++t) {
+			if(t->TriggerCount() > 0 && t->TriggerCount() < MAX_NUM_TRIGGER)
+				doTrigger = true;
+
+			if(t->IsCrossLine(cx)) {
+				bool tgr = t->Trigger(cfg.isBugTrigger);
+				if(doTrigger == false)
+					doTrigger = tgr;
+			}
+		}
+
+		if(doTrigger || doTriggerCount > 0) {
+			++result.triggerFrames;
+			/* Same 330 ms new trigger window as main(), counted in frames */
+			if(result.triggerFrames == 1 || (result.frames - lastTriggerFrame) * 1000 > 330 * CAMERA_FPS) {
+				++result.newTriggers;
+				doTriggerCount = MAX_NUM_TRIGGER;
+				if(cfg.verbose)
+					printf("[%llu] T R I G G E R\n", (unsigned long long)result.frames);
+			}
+			lastTriggerFrame = result.frames;
+			if(doTriggerCount > 0)
+				doTriggerCount--;
+		}
+
+		steady_clock::time_point t4(steady_clock::now());
+
+		const DetectorTiming & dt = detector.Timing();
+		long totalUs = duration_cast<microseconds>(t4 - t0).count();
+
+		result.stage[STAGE_DECODE].Add(decodeUs);
+		result.stage[STAGE_CVTCOLOR].Add(duration_cast<microseconds>(t1 - t0).count());
+		result.stage[STAGE_BGSUB].Add(dt.bgsub_us);
+		result.stage[STAGE_MORPH].Add(dt.morph_us);
+		result.stage[STAGE_LABEL].Add(dt.label_us);
+		result.stage[STAGE_TRACKER].Add(duration_cast<microseconds>(t3 - t2).count());
+		result.stage[STAGE_TRIGGER].Add(duration_cast<microseconds>(t4 - t3).count());
+		result.stage[STAGE_TOTAL].Add(totalUs);
+
+		if(totalUs > cfg.frameBudgetUs)
+			++result.overBudgetFrames;
+		++result.frames;
+
+		if(cfg.isCompareMog2) { /* Not counted in stage latency */
+			refModel->apply(grayFrame, refMask, 0.05);
+			simdModel->apply(grayFrame, simdMask, 0.05);
+			compare(refMask, simdMask, diffMask, CMP_NE);
+			int n = countNonZero(diffMask);
+			double ratio = static_cast<double>(n) / diffMask.total();
+			result.mismatchPixels += n;
+			result.comparedPixels += diffMask.total();
+			if(ratio > result.maxMismatchRatio)
+				result.maxMismatchRatio = ratio;
+		}
+
+		steady_clock::time_point t5(steady_clock::now());
+		if(!cap.read(capFrame) || capFrame.empty())
+			break;
+		decodeUs = duration_cast<microseconds>(steady_clock::now() - t5).count();
+	}
+
+	if(result.frames > REPLAY_WARMUP_FRAMES)
+		result.largeAllocations = allocationCounter.Count() - allocationBase;
+
+	cap.release();
+
+	return true;
+}
+
+static void ReplayFiles(const vector<string> & files, const ReplayConfig & cfg, ReplayResult & total)
+{
+	ResetResult(total);
+
+	for(auto & fn : files) {
+		ReplayResult r;
+		ResetResult(r);
+		if(ReplayFile(fn, cfg, r) == false)
+			continue;
+		if(cfg.verbose || files.size() == 1)
+			PrintResult(fn.c_str(), r, cfg.frameBudgetUs);
+
+		for(int i=0;i<NUM_STAGE;i++)
+			total.stage[i].Add(r.stage[i]);
+		total.frames += r.frames;
+		total.overBudgetFrames += r.overBudgetFrames;
+		total.triggerFrames += r.triggerFrames;
+		total.newTriggers += r.newTriggers;
+		total.largeAllocations += r.largeAllocations;
+		total.mismatchPixels += r.mismatchPixels;
+		total.comparedPixels += r.comparedPixels;
+		if(r.maxMismatchRatio > total.maxMismatchRatio)
+			total.maxMismatchRatio = r.maxMismatchRatio;
+	}
+}
+
+/* Kernels of compute backend, speedup is CPU / CUDA of average latency */
+static void PrintBackendComparison(const ReplayResult & cpu, const ReplayResult & gpu)
+{
+	static const Stage_t stages[] = { STAGE_CVTCOLOR, STAGE_BGSUB, STAGE_MORPH, STAGE_TOTAL };
+
+	printf("\n=== CPU against CUDA backend\n");
+	printf("%-10s %10s %10s %10s\n", "stage", "cpu(ms)", "cuda(ms)", "speedup");
+	for(size_t i=0;i<sizeof(stages) / sizeof(stages[0]);i++) {
+		double c = cpu.stage[stages[i]].Average() / 1000.0;
+		double g = gpu.stage[stages[i]].Average() / 1000.0;
+		printf("%-10s %10.2f %10.2f %10.2f\n", s_stageName[stages[i]], c, g, g > 0 ? c / g : 0);
+	}
+	printf("triggers %llu / %llu\n", (unsigned long long)cpu.newTriggers, (unsigned long long)gpu.newTriggers);
+}
+
+/*
+* Synthetic scene : numTargets objects in rows moving horizontally with different speed, tracker step only
+*/
+
+static void BenchmarkTracker(int numTargets, uint64_t frames, bool isFakeTargetDetection)
+{
+	const int width = 1920;
+	const int height = 1080;
+
+	Tracker tracker(width, height);
+	StageStats stats;
+	size_t maxTargets = 0;
+
+	if(frames == 0)
+		frames = 3000;
+
+	for(uint64_t f=0;f<frames;f++) {
+		list<Rect> roiRect;
+		for(int i=0;i<numTargets;i++) {
+			int row = i / 10;
+			int col = i % 10;
+			int v = 4 + (i % 5) * 2;
+			int x = (col * (width / 10) + f * v) % width;
+			int y = 100 + (row * 180 + (col & 1) * 40) % (height - 200);
+			roiRect.push_back(Rect(x, y, 24, 16));
+		}
+
+		steady_clock::time_point t0(steady_clock::now());
+		tracker.Update(roiRect, isFakeTargetDetection);
+		stats.Add(duration_cast<microseconds>(steady_clock::now() - t0).count());
+
+		if(tracker.TargetList().size() > maxTargets)
+			maxTargets = tracker.TargetList().size();
+	}
+
+	printf("\n=== Tracker, synthetic %d targets, %llu frames\n", numTargets, (unsigned long long)frames);
+	printf("%-10s %10s %10s %10s %10s\n", "stage", "avg(ms)", "p50(ms)", "p99(ms)", "max(ms)");
+	printf("%-10s %10.3f %10.3f %10.3f %10.3f\n", s_stageName[STAGE_TRACKER], stats.Average() / 1000.0,
+		stats.Percentile(0.5) / 1000.0, stats.Percentile(0.99) / 1000.0, stats.Max() / 1000.0);
+	printf("maximum targets %zu\n", maxTargets);
+}
+
+static bool IsVideoFile(const char *name)
+{
+	const char *ext = strrchr(name, '.');
+	if(ext == 0)
+		return false;
+	return (strcasecmp(ext, ".mp4") == 0 || strcasecmp(ext, ".mkv") == 0);
+}
+
+static void CollectVideoFiles(const char *path, vector<string> & files)
+{
+	DIR *dir = opendir(path);
+	if(dir == NULL) { /* Not a directory, take it as file */
+		files.push_back(path);
+		return;
+	}
+
+	vector<string> v;
+	struct dirent *ent;
+	while((ent = readdir(dir)) != NULL) {
+		if(IsVideoFile(ent->d_name)) {
+			string fn = path;
+			fn.append("/");
+			fn.append(ent->d_name);
+			v.push_back(fn);
+		}
+	}
+	closedir(dir);
+
+	sort(v.begin(), v.end());
+	files.insert(files.end(), v.begin(), v.end());
+}
+
+static void Usage(const char *name)
+{
+	printf("Usage : %s [options] [video file or directory ...]\n", name);
+	printf("  Default directory is %s\n", REPLAY_DEFAULT_DIR);
+	printf("  -t <0~64>    MOG2 threshold (default 32)\n");
+	printf("  -r <20|30>   Horizon ratio (default 20)\n");
+	printf("  -f <fps>     Frame budget in fps (default %d)\n", CAMERA_FPS);
+	printf("  -n <frames>  Maximum frames per file (default all)\n");
+	printf("  -x           Enable fake target detection\n");
+	printf("  -g           Enable bug trigger\n");
+	printf("  -e           Enable new target restriction\n");
+	printf("  -c           Compute backend on CPU even if CUDA is available\n");
+	printf("  -b           Benchmark CPU backend against CUDA backend\n");
+	printf("  -m           Compare CPU MOG2 masks against OpenCV MOG2\n");
+	printf("  -p <region>  Processing region, auto or x,y,width,height (default whole frame)\n");
+	printf("  -d <scale>[,area] Detection pyramid 2 or 4 with minimum coarse blob area (default 1, full resolution)\n");
+	printf("  -s <targets> Benchmark tracker with synthetic scene, no video files\n");
+	printf("  -k           Self check of detection kernels against reference implementations, no video files\n");
+	printf("  -v           Verbose, print per file result and triggers\n");
+}
+
+int main(int argc, char**argv)
+{
+	allocationCounter.Install(); /* Before any frame is allocated */
+
+	ReplayConfig cfg;
+	cfg.mog2Threshold = 32;
+	cfg.horizonRatio = 20;
+	cfg.isFakeTargetDetection = false;
+	cfg.isBugTrigger = false;
+	cfg.isNewTargetRestriction = false;
+	cfg.backend = BACKEND_AUTO;
+	cfg.isBenchmarkBackend = false;
+	cfg.isCompareMog2 = false;
+	cfg.isAutoProcessRegion = false;
+	cfg.pyramidScale = 1;
+	cfg.minCoarseArea = 0;
+	int syntheticTargets = 0;
+	bool isSelfCheck = false;
+	cfg.frameBudgetUs = 1000000 / CAMERA_FPS;
+	cfg.maxFrames = 0;
+	cfg.verbose = false;
+
+	int opt;
+	while((opt = getopt(argc, argv, "t:r:f:n:xgecbmp:d:s:kvh")) != -1) {
+		switch(opt) {
+			case 't': cfg.mog2Threshold = atoi(optarg) & 0xff;
+				break;
+			case 'r': cfg.horizonRatio = atoi(optarg);
+				break;
+			case 'f': if(atoi(optarg) > 0)
+					cfg.frameBudgetUs = 1000000 / atoi(optarg);
+				break;
+			case 'n': cfg.maxFrames = strtoull(optarg, NULL, 10);
+				break;
+			case 'x': cfg.isFakeTargetDetection = true;
+				break;
+			case 'g': cfg.isBugTrigger = true;
+				break;
+			case 'e': cfg.isNewTargetRestriction = true;
+				break;
+			case 'c': cfg.backend = BACKEND_CPU;
+				break;
+			case 'b': cfg.isBenchmarkBackend = true;
+				break;
+			case 'm': cfg.isCompareMog2 = true;
+				break;
+			case 'p': {
+					int x, y, w, h;
+					if(strcmp(optarg, "auto") == 0)
+						cfg.isAutoProcessRegion = true;
+					else if(sscanf(optarg, "%d,%d,%d,%d", &x, &y, &w, &h) == 4 && w > 0 && h > 0)
+						cfg.processRegion = Rect(x, y, w, h);
+					else {
+						Usage(argv[0]);
+						return 1;
+					}
+				}
+				break;
+			case 'd': if(sscanf(optarg, "%d,%d", &cfg.pyramidScale, &cfg.minCoarseArea) < 1 ||
+					(cfg.pyramidScale != 1 && cfg.pyramidScale != 2 && cfg.pyramidScale != 4)) {
+					Usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 's': syntheticTargets = atoi(optarg);
+				break;
+			case 'k': isSelfCheck = true;
+				break;
+			case 'v': cfg.verbose = true;
+				break;
+			default:
+				Usage(argv[0]);
+				return (opt == 'h') ? 0 : 1;
+		}
+	}
+
+	if(isSelfCheck)
+		return (SelfCheck() == 0) ? 0 : 1;
+
+	if(syntheticTargets > 0) {
+		BenchmarkTracker(syntheticTargets, cfg.maxFrames, cfg.isFakeTargetDetection);
+		return 0;
+	}
+
+	vector<string> files;
+	if(optind >= argc)
+		CollectVideoFiles(REPLAY_DEFAULT_DIR, files);
+	for(int i=optind;i<argc;i++)
+		CollectVideoFiles(argv[i], files);
+
+	if(files.empty()) {
+		cout << "!!! No video files" << endl;
+		return 1;
+	}
+
+	if(cfg.isBenchmarkBackend) {
+		ReplayResult cpu, gpu;
+		cfg.backend = BACKEND_CPU;
+		ReplayFiles(files, cfg, cpu);
+		PrintResult("Total of CPU backend", cpu, cfg.frameBudgetUs);
+
+		if(IsCudaBackendAvailable() == false) {
+			cout << "!!! No CUDA backend to benchmark against" << endl;
+			return (cpu.frames > 0) ? 0 : 1;
+		}
+
+		cfg.backend = BACKEND_CUDA;
+		ReplayFiles(files, cfg, gpu);
+		PrintResult("Total of CUDA backend", gpu, cfg.frameBudgetUs);
+		PrintBackendComparison(cpu, gpu);
+
+		return (cpu.frames > 0 && gpu.frames > 0) ? 0 : 1;
+	}
+
+	ReplayResult total;
+	ReplayFiles(files, cfg, total);
+
+	if(files.size() > 1)
+		PrintResult("Total", total, cfg.frameBudgetUs);
+
+	return (total.frames > 0) ? 0 : 1;
+}
@@ -0,0 +1,503 @@
+#include "selfcheck.h"
+#include "mog2simd.h"
+#include "bitmask.h"
+#include "labeler.h"
+#include "backend.h"
+#include "detector.h"
+#include "tracker.h"
+
+#include <algorithm>
+
+static bool Report(const char *name, bool isPass, const char *detail)
+{
+	printf("%-24s %s  %s\n", name, isPass ? "pass" : "FAIL", detail);
+	return isPass;
+}
+
+/* Pixels of a and b that differ, both CV_8UC1 of the same size */
+static uint64_t MismatchPixels(const Mat & a, const Mat & b)
+{
+	uint64_t n = 0;
+	for(int y=0;y<a.rows;y++) {
+		const uchar *pa = a.ptr<uchar>(y);
+		const uchar *pb = b.ptr<uchar>(y);
+		for(int x=0;x<a.cols;x++)
+			n += (pa[x] != pb[x]);
+	}
+	return n;
+}
+
+/*
+* CPU MOG2 against OpenCV MOG2 with the parameters of Detector, masks must be bit exact.
+* Background with noise, multi-level flicker, a moving block and bursts of noise over the whole frame.
+* Odd widths leave lanes past the width, the second size is narrower than the first on the same worker threads.
+*/
+
+static bool CheckMog2()
+{
+	const Size sizes[] = { Size(203, 120), Size(97, 64) };
+	const int frames = 200;
+	RNG rng(1);
+	uint64_t mismatch = 0, compared = 0;
+
+	for(auto & sz : sizes) {
+		Ptr<BackgroundSubtractorMOG2> refModel = createBackgroundSubtractorMOG2(30, 32, false);
+		Ptr<BackgroundSubtractorMOG2> simdModel = createBackgroundSubtractorMOG2Simd(30, 32, false);
+		SetupBackgroundModel(refModel);
+		SetupBackgroundModel(simdModel);
+
+		Mat background(sz, CV_8UC1), frame(sz, CV_8UC1), refMask, simdMask;
+		for(int y=0;y<sz.height;y++)
+			for(int x=0;x<sz.width;x++)
+				background.at<uchar>(y, x) = rng.uniform(20, 220);
+
+		for(int f=0;f<frames;f++) {
+			bool isBurst = (f % 37) == 0;
+			int bx = (f * 3) % sz.width;
+			for(int y=0;y<sz.height;y++) {
+				for(int x=0;x<sz.width;x++) {
+					int v = background.at<uchar>(y, x) + rng.uniform(-3, 4);
+					if(rng.uniform(0, 10) < 3) /* Flicker of 0 ~ 5 levels */
+						v += rng.uniform(0, 6) * 40;
+					if(isBurst)
+						v += rng.uniform(-20, 21);
+					if(y >= sz.height / 3 && y < sz.height / 3 + 20 && x >= bx && x < bx + 15)
+						v = 250;
+					frame.at<uchar>(y, x) = saturate_cast<uchar>(v);
+				}
+			}
+
+			refModel->apply(frame, refMask, 0.05);
+			simdModel->apply(frame, simdMask, 0.05);
+			mismatch += MismatchPixels(refMask, simdMask);
+			compared += sz.area();
+		}
+	}
+
+	char detail[128];
+	snprintf(detail, sizeof(detail), "%llu of %llu pixels differ from OpenCV", (unsigned long long)mismatch, (unsigned long long)compared);
+	return Report("MOG2 CPU", mismatch == 0, detail);
+}
+
+/* Foreground pixels of about percent, 0 / 255 */
+static void RandomMask(RNG & rng, Mat & mask, int rows, int cols, int percent)
+{
+	mask.create(rows, cols, CV_8UC1);
+	for(int y=0;y<rows;y++)
+		for(int x=0;x<cols;x++)
+			mask.at<uchar>(y, x) = (rng.uniform(0, 100) < percent) ? 255 : 0;
+}
+
+/*
+* Bit packed mask round trip and Open() against erode 3x3 + dilate 5x5 of OpenCV with default border.
+* Sizes cover a single row / column, widths below, at and across 64 bits words.
+*/
+
+static bool CheckBitMaskOpen()
+{
+	const int cases[][3] = { /* rows, cols, percent */
+		{ 37, 64, 50 }, { 50, 129, 70 }, { 1, 5, 90 }, { 3, 1, 90 }, { 120, 203, 85 }, { 64, 128, 95 }, { 90, 300, 60 }
+	};
+	const Mat erodeElement = getStructuringElement(MORPH_RECT, Size(3, 3));
+	const Mat dilateElement = getStructuringElement(MORPH_RECT, Size(5, 5));
+	RNG rng(2);
+	uint64_t roundTrip = 0, mismatch = 0;
+
+	for(auto & c : cases) {
+		Mat mask, unpacked, eroded, opened;
+		RandomMask(rng, mask, c[0], c[1], c[2]);
+
+		BitMask packed, packedOpened;
+		packed.Pack(mask);
+		packed.Unpack(unpacked);
+		roundTrip += MismatchPixels(mask, unpacked);
+
+		morphologyEx(mask, eroded, MORPH_ERODE, erodeElement);
+		morphologyEx(eroded, opened, MORPH_DILATE, dilateElement);
+		packed.Open(packedOpened);
+		packedOpened.Unpack(unpacked);
+		mismatch += MismatchPixels(opened, unpacked);
+	}
+
+	char detail[128];
+	snprintf(detail, sizeof(detail), "%llu pixels differ after pack / unpack, %llu after opening",
+		(unsigned long long)roundTrip, (unsigned long long)mismatch);
+	return Report("Bit mask opening", roundTrip == 0 && mismatch == 0, detail);
+}
+
+static bool BlobLess(const Blob & a, const Blob & b)
+{
+	if(a.rect.y != b.rect.y) return a.rect.y < b.rect.y;
+	if(a.rect.x != b.rect.x) return a.rect.x < b.rect.x;
+	if(a.rect.width != b.rect.width) return a.rect.width < b.rect.width;
+	if(a.rect.height != b.rect.height) return a.rect.height < b.rect.height;
+	if(a.area != b.area) return a.area < b.area;
+	if(a.minVal != b.minVal) return a.minVal < b.minVal;
+	return a.maxVal < b.maxVal;
+}
+
+/*
+* Run length labeler against connectedComponentsWithStats (8 connectivity) plus gray min / max of every label.
+* Labels of OpenCV are not in the order of blobs, both sides are sorted by bounding box and stats.
+* Frames up to 400 rows are split into stripes, blobs across seams are joined.
+*/
+
+static bool CheckLabeler()
+{
+	const int cases[][3] = { /* rows, cols, percent */
+		{ 300, 203, 50 }, { 257, 130, 40 }, { 64, 64, 60 }, { 1, 200, 50 }, { 400, 128, 45 }, { 300, 300, 90 }
+	};
+	RNG rng(3);
+	int blobs = 0, mismatch = 0;
+
+	for(auto & c : cases) {
+		Mat mask, gray(c[0], c[1], CV_8UC1), labels, stats, centroids;
+		RandomMask(rng, mask, c[0], c[1], c[2]);
+		for(int y=0;y<gray.rows;y++)
+			for(int x=0;x<gray.cols;x++)
+				gray.at<uchar>(y, x) = rng.uniform(0, 256);
+
+		int n = connectedComponentsWithStats(mask, labels, stats, centroids, 8, CV_32S);
+		vector<Blob> ref(n - 1); /* Label 0 is background */
+		for(int i=1;i<n;i++) {
+			Blob & b = ref[i - 1];
+			b.rect = Rect(stats.at<int>(i, CC_STAT_LEFT), stats.at<int>(i, CC_STAT_TOP), stats.at<int>(i, CC_STAT_WIDTH), stats.at<int>(i, CC_STAT_HEIGHT));
+			b.area = stats.at<int>(i, CC_STAT_AREA);
+			b.minVal = 255;
+			b.maxVal = 0;
+			b.centroid = Point2f(centroids.at<double>(i, 0), centroids.at<double>(i, 1));
+		}
+		for(int y=0;y<labels.rows;y++) {
+			for(int x=0;x<labels.cols;x++) {
+				int l = labels.at<int>(y, x);
+				if(l == 0)
+					continue;
+				uchar v = gray.at<uchar>(y, x);
+				ref[l - 1].minVal = min(ref[l - 1].minVal, v);
+				ref[l - 1].maxVal = max(ref[l - 1].maxVal, v);
+			}
+		}
+
+		BitMask packed;
+		BlobLabeler labeler;
+		vector<Blob> result;
+		packed.Pack(mask);
+		labeler.Label(packed, gray, result);
+
+		sort(ref.begin(), ref.end(), BlobLess);
+		sort(result.begin(), result.end(), BlobLess);
+		blobs += ref.size();
+		if(result.size() != ref.size()) {
+			mismatch += max(result.size(), ref.size());
+			continue;
+		}
+		for(size_t i=0;i<ref.size();i++) {
+			const Blob & a = ref[i];
+			const Blob & b = result[i];
+			if(a.rect != b.rect || a.area != b.area || a.minVal != b.minVal || a.maxVal != b.maxVal ||
+				fabs(a.centroid.x - b.centroid.x) > 1e-3 || fabs(a.centroid.y - b.centroid.y) > 1e-3)
+				mismatch++;
+		}
+	}
+
+	char detail[128];
+	snprintf(detail, sizeof(detail), "%d of %d blobs differ from connectedComponentsWithStats", mismatch, blobs);
+	return Report("Blob labeler", mismatch == 0, detail);
+}
+
+/*
+* Folding of blobs inside bounding box of a larger blob : a dot in the hole of a ring (external contours drop it too),
+* a dot in the open side of a C shape (external contours keep it, folded here by design) and a dot out of both stay apart.
+*/
+
+static bool CheckFoldInnerBlobs()
+{
+	Mat mask(120, 200, CV_8UC1, Scalar(0)), gray(120, 200, CV_8UC1, Scalar(100));
+	const Rect fills[] = {
+		Rect(20, 20, 60, 3), Rect(20, 77, 60, 3), Rect(20, 20, 3, 60), Rect(77, 20, 3, 60), /* Ring */
+		Rect(100, 20, 60, 3), Rect(100, 77, 60, 3), Rect(100, 20, 3, 60), /* C shape, open to right */
+		Rect(45, 45, 5, 5), Rect(140, 45, 5, 5), Rect(180, 100, 5, 5) /* Dots */
+	};
+	for(auto & r : fills)
+		mask(r).setTo(255);
+	gray(Rect(45, 45, 5, 5)).setTo(10);
+	gray(Rect(140, 45, 5, 5)).setTo(250);
+
+	BitMask packed;
+	BlobLabeler labeler;
+	Detector detector;
+	vector<Blob> blobs, outer;
+	packed.Pack(mask);
+	labeler.Label(packed, gray, blobs);
+	bool isBurst = detector.FoldInnerBlobs(blobs, outer) == false;
+
+	const int ringArea = 2 * 60 * 3 + 2 * 54 * 3, cArea = 2 * 60 * 3 + 54 * 3, dotArea = 25;
+	int failed = 0;
+	failed += isBurst || blobs.size() != 5 || outer.size() != 3;
+	if(failed == 0) {
+		sort(outer.begin(), outer.end(), [](const Blob & a, const Blob & b) { return a.rect.x < b.rect.x; }); /* Ring and C are the same size */
+		const Blob & ring = outer[0], & c = outer[1], & dot = outer[2];
+		failed += ring.rect != Rect(20, 20, 60, 60) || c.rect != Rect(100, 20, 60, 60) || dot.rect != Rect(180, 100, 5, 5);
+		failed += ring.area != ringArea + dotArea || ring.minVal != 10 || ring.maxVal != 100;
+		failed += c.area != cArea + dotArea || c.minVal != 100 || c.maxVal != 250;
+		failed += dot.area != dotArea;
+	}
+
+	char detail[128];
+	snprintf(detail, sizeof(detail), "%zu blobs folded to %zu, %d of 5 checks fail", blobs.size(), outer.size(), failed);
+	return Report("Fold inner blobs", failed == 0, detail);
+}
+
+static int Root(vector<int> & parent, int i)
+{
+	while(parent[i] != i)
+		i = parent[i];
+	return i;
+}
+
+/*
+* Grid bucketed merge of small blobs against union-find of every pair, groups must be the same whatever the grid visits.
+* Small rects below and above horizon, some too large to merge, some touching frame borders.
+*/
+
+static bool CheckMergeSmallBlobs()
+{
+	const Size frameSize(320, 240);
+	const int horizonHeight = frameSize.height * 8 / 10;
+	const int sets = 300;
+	RNG rng(5);
+	Detector detector;
+	vector<Blob> blobs, merged, ref;
+	vector<int> parent, group;
+	int groups = 0, mismatch = 0;
+
+	for(int k=0;k<sets;k++) {
+		int n = rng.uniform(1, 121);
+		blobs.resize(n);
+		for(auto & b : blobs) {
+			int w = rng.uniform(2, 31);
+			int h = rng.uniform(2, 31);
+			int y0 = rng.uniform(0, 4) ? horizonHeight - h : 0; /* Mostly around and below horizon where blobs merge */
+			b.rect = Rect(rng.uniform(0, frameSize.width - w + 1), rng.uniform(y0, frameSize.height - h + 1), w, h);
+			b.area = max(1, b.rect.area() / rng.uniform(1, 4));
+			b.minVal = rng.uniform(0, 128);
+			b.maxVal = rng.uniform(128, 256);
+			b.centroid = Point2f(b.rect.x + w * 0.5f, b.rect.y + h * 0.5f);
+		}
+
+		detector.MergeSmallBlobs(frameSize, horizonHeight, blobs, merged);
+
+		parent.resize(n);
+		for(int i=0;i<n;i++)
+			parent[i] = i;
+		for(int i=0;i<n;i++) {
+			for(int j=0;j<i;j++) {
+				const Rect & r = blobs[i].rect;
+				const Rect & o = blobs[j].rect;
+				if(r.area() >= MERGE_AREA || o.area() >= MERGE_AREA)
+					continue;
+				if(r.br().y <= horizonHeight && o.br().y <= horizonHeight)
+					continue; /* Merging starts from rect below horizon */
+				if((r & o).area() > 0 || cv::norm(Center(r) - Center(o)) < MERGE_DISTANCE) {
+					int a = Root(parent, i);
+					int b = Root(parent, j);
+					parent[max(a, b)] = min(a, b);
+				}
+			}
+		}
+
+		ref.clear();
+		group.assign(n, -1);
+		for(int i=0;i<n;i++) {
+			int root = Root(parent, i);
+			if(root == i) {
+				group[i] = ref.size();
+				ref.push_back(blobs[i]);
+				continue;
+			}
+			Blob & g = ref[group[root]];
+			const Blob & b = blobs[i];
+			g.centroid = (g.centroid * (float)g.area + b.centroid * (float)b.area) * (1.f / (g.area + b.area));
+			g.rect = MergeRect(g.rect, b.rect);
+			g.area += b.area;
+			g.minVal = min(g.minVal, b.minVal);
+			g.maxVal = max(g.maxVal, b.maxVal);
+		}
+
+		groups += ref.size();
+		if(merged.size() != ref.size()) {
+			mismatch += max(merged.size(), ref.size());
+			continue;
+		}
+		for(size_t i=0;i<ref.size();i++) {
+			const Blob & a = ref[i];
+			const Blob & b = merged[i];
+			if(a.rect != b.rect || a.area != b.area || a.minVal != b.minVal || a.maxVal != b.maxVal ||
+				fabs(a.centroid.x - b.centroid.x) > 1e-3 || fabs(a.centroid.y - b.centroid.y) > 1e-3)
+				mismatch++;
+		}
+	}
+
+	char detail[128];
+	snprintf(detail, sizeof(detail), "%d of %d groups differ from pairwise union-find", mismatch, groups);
+	return Report("Merge small blobs", mismatch == 0, detail);
+}
+
+/*
+* Two 20 x 20 objects crossing each other at 12 px / frame, each must stay with its own target through the crossing.
+* A target taking the first object that matches would steal the other one as they pass.
+*/
+
+static bool CheckTrackerCrossing()
+{
+	const int frames = 30;
+	Tracker tracker(1280, 720);
+	uint32_t idA = 0, idB = 0;
+	int swapped = 0;
+
+	for(int f=0;f<frames;f++) {
+		Rect a(300 + f * 12, 300 + f * 2, 20, 20);
+		Rect b(300 + (frames - 1 - f) * 12, 300 + (frames - 1 - f) * 2, 20, 20);
+		list<Rect> roiRect = { a, b };
+		tracker.Update(roiRect);
+
+		int found = 0;
+		TargetPool & targets = tracker.TargetList();
+		for(TargetPool::iterator t=targets.begin();t!=targets.end();++t) {
+			if(t->LastRect() == a) {
+				if(f == 0)
+					idA = t->Id();
+				found += (t->Id() == idA);
+			} else if(t->LastRect() == b) {
+				if(f == 0)
+					idB = t->Id();
+				found += (t->Id() == idB);
+			}
+		}
+		if(found != 2)
+			swapped++;
+	}
+
+	char detail[128];
+	snprintf(detail, sizeof(detail), "%d of %d frames with targets lost or swapped", swapped, frames);
+	return Report("Tracker crossing", swapped == 0, detail);
+}
+
+/*
+* Target circling for 400 frames, more than MAX_TARGET_HISTORY samples. Values kept beside the history rings must be
+* the same as computed from every sample, trajectory holds the latest MAX_TARGET_HISTORY samples in order.
+*/
+
+static bool CheckTargetHistory()
+{
+	const int frames = 400;
+	vector<Rect> rects(frames);
+	for(int f=0;f<frames;f++) {
+		double a = f * 2 * M_PI / 90;
+		rects[f] = Rect(640 + (int)round(200 * cos(a)) - 10, 360 + (int)round(200 * sin(a)) - 10, 20, 20);
+	}
+
+	Target target(rects[0], 1);
+	for(int f=1;f<frames;f++)
+		target.Update(rects[f], f + 1);
+
+	double arcLength = 0;
+	for(int f=1;f<frames;f++)
+		arcLength += norm(rects[f].tl() - rects[f - 1].tl());
+	double absLength = norm(rects[frames - 1].tl() - rects[0].tl());
+
+	OverlayRecord rec;
+	target.Draw(rec);
+	int history = min(frames, MAX_TARGET_HISTORY);
+	bool isTrajectory = (int)rec.trajectories.size() == history;
+	for(int i=0;isTrajectory && i<history;i++)
+		isTrajectory = rec.trajectories[i] == rects[frames - history + i];
+
+	int failed = 0;
+	failed += target.TrackedCount() != (size_t)frames;
+	failed += fabs(target.ArcLength() - arcLength) > 1e-6;
+	failed += fabs(target.AbsLength() - absLength) > 1e-6;
+	failed += target.BeginCenterPoint() != Center(rects[0]);
+	failed += target.PreviousCenterPoint() != Center(rects[frames - 2]);
+	failed += target.CurrentCenterPoint() != Center(rects[frames - 1]);
+	failed += isTrajectory == false;
+
+	char detail[128];
+	snprintf(detail, sizeof(detail), "%d of 7 values differ after %d samples (tracked count %zu, arc length %.1f)",
+		failed, frames, target.TrackedCount(), target.ArcLength());
+	return Report("Target history", failed == 0, detail);
+}
+
+static bool CheckNewTargetGrid()
+{
+	const int frames = 600;
+	RNG rng(0x9e3779b9);
+	NewTargetGrid *grid = new NewTargetGrid(CAMERA_WIDTH, CAMERA_HEIGHT); /* Too large for stack */
+	list< list< Rect > > history; /* Reference, list scan as tracker did before the grid */
+	uint64_t compared = 0, mismatches = 0;
+	int crowdedFrames = 0;
+
+	for(int f=0;f<frames;f++) {
+		int n = (f % 3 == 0) ? rng.uniform(17, MAX_NUM_OBJECT + 1) : rng.uniform(0, 8);
+		if(n > 16)
+			++crowdedFrames;
+		list< Rect > newTargetList;
+		for(int i=0;i<n;i++) {
+			/* Clustered in a corner, cells overflow and rects overlap a lot */
+			int w = rng.uniform(2, 64), h = rng.uniform(2, 64);
+			Rect r(rng.uniform(-32, 320), rng.uniform(-32, 240), w, h);
+
+			uint32_t count = grid->OverlapCount(r);
+			uint32_t refCount = 0;
+			for(auto & l : history) {
+				for(auto & o : l) {
+					if((o & r).area() > 0)
+						++refCount;
+				}
+			}
+			++compared;
+			mismatches += count != refCount;
+
+			if(refCount > 0) {
+				r.x -= r.width;
+				r.y -= r.height;
+				r.width = r.width << 1;
+				r.height = r.height << 1;
+			}
+			grid->Add(r);
+			newTargetList.push_back(r);
+		}
+
+		int dropped = (rng.uniform(0, 10) == 0) ? rng.uniform(1, 4) : 0;
+		grid->NextFrame(1 + dropped);
+		for(int d=0;d<=dropped;d++) {
+			history.push_back(d == 0 ? newTargetList : list< Rect >());
+			if(history.size() >= NEW_TARGET_HISTORY_FRAMES)
+				history.pop_front();
+		}
+	}
+	delete grid;
+
+	char detail[128];
+	snprintf(detail, sizeof(detail), "%llu of %llu overlap counts differ (%d frames over 16 new targets)",
+		(unsigned long long)mismatches, (unsigned long long)compared, crowdedFrames);
+	return Report("New target grid", mismatches == 0 && crowdedFrames > 0, detail);
+}
+
+int SelfCheck()
+{
+	int failed = 0;
+
+	printf("\n=== Self check\n");
+	failed += !CheckMog2();
+	failed += !CheckBitMaskOpen();
+	failed += !CheckLabeler();
+	failed += !CheckFoldInnerBlobs();
+	failed += !CheckMergeSmallBlobs();
+	failed += !CheckTrackerCrossing();
+	failed += !CheckTargetHistory();
+	failed += !CheckNewTargetGrid();
+
+	printf("%s\n", failed ? "!!! Self check failed" : "All checks pass");
+	return failed;
+}
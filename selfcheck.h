@@ -0,0 +1,14 @@
+#ifndef SELFCHECK_H
+#define SELFCHECK_H
+
+#include "dragon-eye.h"
+
+/*
+* Self check of detection kernels against reference implementations, dragon-eye-replay -k.
+* Inputs are synthetic and seeded, no video files needed. Every check prints its result.
+*/
+
+/* Number of failed checks, 0 if all pass */
+int SelfCheck();
+
+#endif
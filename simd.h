@@ -0,0 +1,161 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+/*
+* Minimal float vector wrapper for the CPU detection kernels.
+* AVX2 (8 lanes) / SSE2 (4 lanes) on x86, NEON (4 lanes) on ARM, scalar (1 lane) otherwise.
+* Masks share the vector type, all bits set in a lane means true.
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+struct VFloat {
+	enum { N = 8 };
+	__m256 v;
+
+	VFloat() {}
+	VFloat(__m256 _v) : v(_v) {}
+
+	static inline VFloat load(const float *p) { return _mm256_loadu_ps(p); }
+	static inline void store(float *p, VFloat a) { _mm256_storeu_ps(p, a.v); }
+	static inline VFloat set1(float f) { return _mm256_set1_ps(f); }
+	static inline VFloat zero() { return _mm256_setzero_ps(); }
+
+	friend inline VFloat operator+(VFloat a, VFloat b) { return _mm256_add_ps(a.v, b.v); }
+	friend inline VFloat operator-(VFloat a, VFloat b) { return _mm256_sub_ps(a.v, b.v); }
+	friend inline VFloat operator*(VFloat a, VFloat b) { return _mm256_mul_ps(a.v, b.v); }
+	friend inline VFloat operator/(VFloat a, VFloat b) { return _mm256_div_ps(a.v, b.v); }
+	friend inline VFloat operator&(VFloat a, VFloat b) { return _mm256_and_ps(a.v, b.v); }
+	friend inline VFloat operator|(VFloat a, VFloat b) { return _mm256_or_ps(a.v, b.v); }
+
+	static inline VFloat min(VFloat a, VFloat b) { return _mm256_min_ps(a.v, b.v); }
+	static inline VFloat max(VFloat a, VFloat b) { return _mm256_max_ps(a.v, b.v); }
+	static inline VFloat lt(VFloat a, VFloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+	static inline VFloat ge(VFloat a, VFloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+	static inline VFloat eq(VFloat a, VFloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ); }
+	static inline VFloat andnot(VFloat m, VFloat a) { return _mm256_andnot_ps(m.v, a.v); } /* ~m & a */
+	static inline VFloat select(VFloat m, VFloat a, VFloat b) { return _mm256_blendv_ps(b.v, a.v, m.v); } /* m ? a : b */
+	static inline bool any(VFloat m) { return _mm256_movemask_ps(m.v) != 0; }
+};
+
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+
+struct VFloat {
+	enum { N = 4 };
+	__m128 v;
+
+	VFloat() {}
+	VFloat(__m128 _v) : v(_v) {}
+
+	static inline VFloat load(const float *p) { return _mm_loadu_ps(p); }
+	static inline void store(float *p, VFloat a) { _mm_storeu_ps(p, a.v); }
+	static inline VFloat set1(float f) { return _mm_set1_ps(f); }
+	static inline VFloat zero() { return _mm_setzero_ps(); }
+
+	friend inline VFloat operator+(VFloat a, VFloat b) { return _mm_add_ps(a.v, b.v); }
+	friend inline VFloat operator-(VFloat a, VFloat b) { return _mm_sub_ps(a.v, b.v); }
+	friend inline VFloat operator*(VFloat a, VFloat b) { return _mm_mul_ps(a.v, b.v); }
+	friend inline VFloat operator/(VFloat a, VFloat b) { return _mm_div_ps(a.v, b.v); }
+	friend inline VFloat operator&(VFloat a, VFloat b) { return _mm_and_ps(a.v, b.v); }
+	friend inline VFloat operator|(VFloat a, VFloat b) { return _mm_or_ps(a.v, b.v); }
+
+	static inline VFloat min(VFloat a, VFloat b) { return _mm_min_ps(a.v, b.v); }
+	static inline VFloat max(VFloat a, VFloat b) { return _mm_max_ps(a.v, b.v); }
+	static inline VFloat lt(VFloat a, VFloat b) { return _mm_cmplt_ps(a.v, b.v); }
+	static inline VFloat ge(VFloat a, VFloat b) { return _mm_cmpge_ps(a.v, b.v); }
+	static inline VFloat eq(VFloat a, VFloat b) { return _mm_cmpeq_ps(a.v, b.v); }
+	static inline VFloat andnot(VFloat m, VFloat a) { return _mm_andnot_ps(m.v, a.v); } /* ~m & a */
+	static inline VFloat select(VFloat m, VFloat a, VFloat b) { return _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v)); } /* m ? a : b */
+	static inline bool any(VFloat m) { return _mm_movemask_ps(m.v) != 0; }
+};
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+
+struct VFloat {
+	enum { N = 4 };
+	float32x4_t v;
+
+	VFloat() {}
+	VFloat(float32x4_t _v) : v(_v) {}
+
+	static inline VFloat fromMask(uint32x4_t m) { return vreinterpretq_f32_u32(m); }
+	static inline uint32x4_t toMask(VFloat a) { return vreinterpretq_u32_f32(a.v); }
+
+	static inline VFloat load(const float *p) { return vld1q_f32(p); }
+	static inline void store(float *p, VFloat a) { vst1q_f32(p, a.v); }
+	static inline VFloat set1(float f) { return vdupq_n_f32(f); }
+	static inline VFloat zero() { return vdupq_n_f32(0); }
+
+	friend inline VFloat operator+(VFloat a, VFloat b) { return vaddq_f32(a.v, b.v); }
+	friend inline VFloat operator-(VFloat a, VFloat b) { return vsubq_f32(a.v, b.v); }
+	friend inline VFloat operator*(VFloat a, VFloat b) { return vmulq_f32(a.v, b.v); }
+#if defined(__aarch64__)
+	friend inline VFloat operator/(VFloat a, VFloat b) { return vdivq_f32(a.v, b.v); }
+#else
+	friend inline VFloat operator/(VFloat a, VFloat b) {
+		float32x4_t r = vrecpeq_f32(b.v); /* Newton-Raphson refined reciprocal */
+		r = vmulq_f32(vrecpsq_f32(b.v, r), r);
+		r = vmulq_f32(vrecpsq_f32(b.v, r), r);
+		return vmulq_f32(a.v, r);
+	}
+#endif
+	friend inline VFloat operator&(VFloat a, VFloat b) { return fromMask(vandq_u32(toMask(a), toMask(b))); }
+	friend inline VFloat operator|(VFloat a, VFloat b) { return fromMask(vorrq_u32(toMask(a), toMask(b))); }
+
+	static inline VFloat min(VFloat a, VFloat b) { return vminq_f32(a.v, b.v); }
+	static inline VFloat max(VFloat a, VFloat b) { return vmaxq_f32(a.v, b.v); }
+	static inline VFloat lt(VFloat a, VFloat b) { return fromMask(vcltq_f32(a.v, b.v)); }
+	static inline VFloat ge(VFloat a, VFloat b) { return fromMask(vcgeq_f32(a.v, b.v)); }
+	static inline VFloat eq(VFloat a, VFloat b) { return fromMask(vceqq_f32(a.v, b.v)); }
+	static inline VFloat andnot(VFloat m, VFloat a) { return fromMask(vbicq_u32(toMask(a), toMask(m))); } /* ~m & a */
+	static inline VFloat select(VFloat m, VFloat a, VFloat b) { return vbslq_f32(toMask(m), a.v, b.v); } /* m ? a : b */
+	static inline bool any(VFloat m) {
+		uint32x2_t r = vorr_u32(vget_low_u32(toMask(m)), vget_high_u32(toMask(m)));
+		return (vget_lane_u32(r, 0) | vget_lane_u32(r, 1)) != 0;
+	}
+};
+
+#else
+
+struct VFloat {
+	enum { N = 1 };
+	float v;
+
+	VFloat() {}
+	VFloat(float _v) : v(_v) {}
+
+	static inline VFloat fromBits(uint32_t u) { VFloat a; memcpy(&a.v, &u, 4); return a; }
+	static inline uint32_t toBits(VFloat a) { uint32_t u; memcpy(&u, &a.v, 4); return u; }
+	static inline VFloat fromBool(bool b) { return fromBits(b ? 0xffffffff : 0); }
+
+	static inline VFloat load(const float *p) { return *p; }
+	static inline void store(float *p, VFloat a) { *p = a.v; }
+	static inline VFloat set1(float f) { return f; }
+	static inline VFloat zero() { return 0.f; }
+
+	friend inline VFloat operator+(VFloat a, VFloat b) { return a.v + b.v; }
+	friend inline VFloat operator-(VFloat a, VFloat b) { return a.v - b.v; }
+	friend inline VFloat operator*(VFloat a, VFloat b) { return a.v * b.v; }
+	friend inline VFloat operator/(VFloat a, VFloat b) { return a.v / b.v; }
+	friend inline VFloat operator&(VFloat a, VFloat b) { return fromBits(toBits(a) & toBits(b)); }
+	friend inline VFloat operator|(VFloat a, VFloat b) { return fromBits(toBits(a) | toBits(b)); }
+
+	static inline VFloat min(VFloat a, VFloat b) { return (b.v < a.v) ? b : a; }
+	static inline VFloat max(VFloat a, VFloat b) { return (a.v < b.v) ? b : a; }
+	static inline VFloat lt(VFloat a, VFloat b) { return fromBool(a.v < b.v); }
+	static inline VFloat ge(VFloat a, VFloat b) { return fromBool(a.v >= b.v); }
+	static inline VFloat eq(VFloat a, VFloat b) { return fromBool(a.v == b.v); }
+	static inline VFloat andnot(VFloat m, VFloat a) { return fromBits(~toBits(m) & toBits(a)); } /* ~m & a */
+	static inline VFloat select(VFloat m, VFloat a, VFloat b) { return toBits(m) ? a : b; } /* m ? a : b */
+	static inline bool any(VFloat m) { return toBits(m) != 0; }
+};
+
+#endif
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+* Lock free ring of one producer thread and one consumer thread.
+* N is power of 2, the ring holds up to N items.
+* Producer only writes m_head and consumer only writes m_tail, acquire / release orders the item against the index.
+*/
+
+template<typename T, int N> class SpscRing
+{
+private:
+	static_assert((N & (N - 1)) == 0, "Size of SpscRing must be power of 2");
+
+	T m_items[N];
+	alignas(64) std::atomic<uint32_t> m_head; /* Next to push */
+	alignas(64) std::atomic<uint32_t> m_tail; /* Next to pop */
+
+public:
+	SpscRing() : m_head(0), m_tail(0) {}
+
+	/* Not thread safe, both sides must be idle */
+	inline void Clear() {
+		m_head.store(0, std::memory_order_relaxed);
+		m_tail.store(0, std::memory_order_relaxed);
+	}
+
+	/* Producer side, false if full */
+	inline bool Push(const T & item) {
+		uint32_t head = m_head.load(std::memory_order_relaxed);
+		if(head - m_tail.load(std::memory_order_acquire) >= (uint32_t)N)
+			return false;
+		m_items[head & (N - 1)] = item;
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	/* Consumer side, false if empty */
+	inline bool Pop(T & item) {
+		uint32_t tail = m_tail.load(std::memory_order_relaxed);
+		if(tail == m_head.load(std::memory_order_acquire))
+			return false;
+		item = m_items[tail & (N - 1)];
+		m_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	inline size_t Size() const {
+		return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+	}
+};
+
+#endif
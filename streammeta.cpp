@@ -0,0 +1,102 @@
+#include "streammeta.h"
+
+/* "dragon-eye-track" */
+const uint8_t STREAM_META_UUID[16] = { 'd', 'r', 'a', 'g', 'o', 'n', '-', 'e', 'y', 'e', '-', 't', 'r', 'a', 'c', 'k' };
+
+#define HEVC_NAL_PREFIX_SEI          	39
+#define SEI_USER_DATA_UNREGISTERED   	5
+
+static inline void Put8(vector<uint8_t> & v, uint8_t x) { v.push_back(x); }
+static inline void Put16(vector<uint8_t> & v, uint16_t x) { v.push_back(x >> 8); v.push_back(x & 0xff); }
+static inline void Put32(vector<uint8_t> & v, uint32_t x) { Put16(v, x >> 16); Put16(v, x & 0xffff); }
+static inline void Put64(vector<uint8_t> & v, uint64_t x) { Put32(v, x >> 32); Put32(v, x & 0xffffffff); }
+
+static inline uint16_t Clamp16(int v) { return (uint16_t)min(max(v, 0), 0xffff); }
+
+void SerializeStreamMeta(const OverlayRecord & rec, uint64_t pts, vector<uint8_t> & payload)
+{
+	size_t count = min(rec.tracks.size(), (size_t)STREAM_META_MAX_TARGETS);
+
+	payload.clear();
+	payload.reserve(sizeof(STREAM_META_UUID) + 19 + count * 13);
+	payload.insert(payload.end(), STREAM_META_UUID, STREAM_META_UUID + sizeof(STREAM_META_UUID));
+	Put8(payload, STREAM_META_VERSION);
+	Put8(payload, rec.isTrigger ? STREAM_META_FLAG_TRIGGER : 0);
+	Put64(payload, pts);
+	Put64(payload, rec.seq);
+	Put8(payload, count);
+	for(size_t i=0;i<count;i++) {
+		const OverlayTrack & t = rec.tracks[i];
+		Put32(payload, t.id);
+		Put16(payload, Clamp16(t.rect.x));
+		Put16(payload, Clamp16(t.rect.y));
+		Put16(payload, Clamp16(t.rect.width));
+		Put16(payload, Clamp16(t.rect.height));
+		Put8(payload, t.isTrigger ? STREAM_META_FLAG_TRIGGER : 0);
+	}
+}
+
+/* Start code 00 00 01 at i, returns its length (3 or 4 with leading zero) or 0 */
+static inline size_t StartCodeAt(const uint8_t *p, size_t size, size_t i)
+{
+	if(i + 3 <= size && p[i] == 0 && p[i+1] == 0 && p[i+2] == 1)
+		return 3;
+	if(i + 4 <= size && p[i] == 0 && p[i+1] == 0 && p[i+2] == 0 && p[i+3] == 1)
+		return 4;
+	return 0;
+}
+
+bool InsertSeiUserData(const uint8_t *au, size_t size, const vector<uint8_t> & payload, vector<uint8_t> & out)
+{
+	/* Start code of the first VCL NAL (type 0 ~ 31) */
+	size_t pos = size;
+	for(size_t i=0;i+3<size;) {
+		size_t n = StartCodeAt(au, size, i);
+		if(n == 0) {
+			i++;
+			continue;
+		}
+		if(i + n < size && ((au[i + n] >> 1) & 0x3f) < 32) {
+			pos = i;
+			break;
+		}
+		i += n;
+	}
+
+	out.clear();
+	if(pos == size) {
+		out.assign(au, au + size);
+		return false;
+	}
+
+	out.reserve(size + payload.size() + payload.size() / 64 + 16);
+	out.insert(out.end(), au, au + pos);
+
+	/* Start code, NAL header of layer 0 / temporal id 0 (plus 1 is 1) */
+	const uint8_t header[] = { 0, 0, 0, 1, HEVC_NAL_PREFIX_SEI << 1, 1 };
+	out.insert(out.end(), header, header + sizeof(header));
+
+	/* SEI message, then RBSP trailing bits. Emulation prevention byte after two zeros followed by 0 ~ 3 */
+	vector<uint8_t> rbsp;
+	rbsp.reserve(payload.size() + 8);
+	rbsp.push_back(SEI_USER_DATA_UNREGISTERED);
+	size_t n = payload.size();
+	for(;n>=255;n-=255)
+		rbsp.push_back(0xff);
+	rbsp.push_back(n);
+	rbsp.insert(rbsp.end(), payload.begin(), payload.end());
+	rbsp.push_back(0x80);
+
+	int zeros = 0;
+	for(auto b : rbsp) {
+		if(zeros >= 2 && b <= 3) {
+			out.push_back(3);
+			zeros = 0;
+		}
+		out.push_back(b);
+		zeros = (b == 0) ? zeros + 1 : 0;
+	}
+
+	out.insert(out.end(), au + pos, au + size);
+	return true;
+}
@@ -0,0 +1,37 @@
+#ifndef STREAMMETA_H
+#define STREAMMETA_H
+
+#include "dragon-eye.h"
+#include "overlay.h"
+
+/*
+* Tracking metadata of a frame carried in its H.265 access unit, as SEI user data unregistered (payload type 5).
+* Recorded files, clips, RTP / HLS and RTSP all get it, a player can find triggers and draw tracks without detection.
+*
+* Payload, big endian :
+*   uuid[16]        STREAM_META_UUID
+*   u8  version     STREAM_META_VERSION
+*   u8  flags       bit 0 : trigger fired on this frame
+*   u64 pts         Nanoseconds, PTS of frame at encoder (RTSP restamps its own PTS)
+*   u64 seq         Frame sequence of capture
+*   u8  count       Targets that follow
+*   count x { u32 id; u16 x, y, width, height; u8 flags (bit 0 : target has triggered) }
+*/
+
+#define STREAM_META_VERSION          	1
+#define STREAM_META_MAX_TARGETS      	32     /* Targets of a frame, the rest is left out */
+
+#define STREAM_META_FLAG_TRIGGER     	0x01
+
+extern const uint8_t STREAM_META_UUID[16];
+
+/* Payload of user data unregistered, uuid included */
+void SerializeStreamMeta(const OverlayRecord & rec, uint64_t pts, vector<uint8_t> & payload);
+
+/*
+* Access unit of byte stream with a prefix SEI NAL of payload inserted before its first slice.
+* Returns false and copies access unit as is if it has no slice.
+*/
+bool InsertSeiUserData(const uint8_t *au, size_t size, const vector<uint8_t> & payload, vector<uint8_t> & out);
+
+#endif
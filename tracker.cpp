@@ -0,0 +1,161 @@
+#include "tracker.h"
+
+uint32_t Target::s_id = 0;
+
+/*
+*
+*/
+
+void NewTargetGrid::Initialisize(int width, int height)
+{
+	/* Width and height may come in either order, rects out of the grid are clamped to border cells */
+	int size = max(width, height);
+	m_gridCols = max(1, (size + NEW_TARGET_GRID_SIZE - 1) / NEW_TARGET_GRID_SIZE);
+	m_gridRows = m_gridCols;
+	m_cells.resize(m_gridCols * m_gridRows);
+	m_overflow.reserve(NEW_TARGET_HISTORY_FRAMES * NEW_TARGET_HISTORY_PER_FRAME);
+	Clear();
+}
+
+void NewTargetGrid::Clear()
+{
+	for(auto & c : m_cells)
+		c.count = 0;
+	memset(m_counts, 0, sizeof(m_counts));
+	memset(m_isOverflow, 0, sizeof(m_isOverflow));
+	m_overflow.clear();
+	m_head = 0;
+}
+
+Rect NewTargetGrid::CellRange(const Rect & r) const
+{
+	int x0 = CellOf(r.x, m_gridCols);
+	int y0 = CellOf(r.y, m_gridRows);
+	int x1 = CellOf(r.x + r.width - 1, m_gridCols);
+	int y1 = CellOf(r.y + r.height - 1, m_gridRows);
+	return Rect(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+}
+
+void NewTargetGrid::Insert(uint16_t entry)
+{
+	Rect cr = CellRange(m_rects[entry]);
+	bool overflow = false;
+	for(int y=cr.y;y<cr.y+cr.height;y++) {
+		for(int x=cr.x;x<cr.x+cr.width;x++) {
+			Cell & c = m_cells[y * m_gridCols + x];
+			if(c.count < NEW_TARGET_GRID_SLOTS)
+				c.entry[c.count++] = entry;
+			else
+				overflow = true;
+		}
+	}
+	if(overflow) { /* Counted from overflow list only */
+		m_isOverflow[entry] = true;
+		m_overflow.push_back(entry);
+	}
+}
+
+void NewTargetGrid::Remove(uint16_t entry)
+{
+	Rect cr = CellRange(m_rects[entry]);
+	for(int y=cr.y;y<cr.y+cr.height;y++) {
+		for(int x=cr.x;x<cr.x+cr.width;x++) {
+			Cell & c = m_cells[y * m_gridCols + x];
+			for(int i=0;i<c.count;i++) {
+				if(c.entry[i] == entry) {
+					c.entry[i] = c.entry[--c.count];
+					break;
+				}
+			}
+		}
+	}
+	if(m_isOverflow[entry]) {
+		m_isOverflow[entry] = false;
+		for(size_t i=0;i<m_overflow.size();i++) {
+			if(m_overflow[i] == entry) {
+				m_overflow[i] = m_overflow.back();
+				m_overflow.pop_back();
+				break;
+			}
+		}
+	}
+}
+
+uint32_t NewTargetGrid::OverlapCount(const Rect & r) const
+{
+	if(r.width <= 0 || r.height <= 0)
+		return 0;
+
+	uint32_t count = 0;
+	Rect cr = CellRange(r);
+	for(int y=cr.y;y<cr.y+cr.height;y++) {
+		for(int x=cr.x;x<cr.x+cr.width;x++) {
+			const Cell & c = m_cells[y * m_gridCols + x];
+			for(int i=0;i<c.count;i++) {
+				if(m_isOverflow[c.entry[i]])
+					continue;
+				Rect o = m_rects[c.entry[i]] & r;
+				if(o.area() > 0 &&
+					CellOf(o.x, m_gridCols) == x && 
+					CellOf(o.y, m_gridRows) == y) /* Each overlap is counted once, in the cell of its top left */
+					++count;
+			}
+		}
+	}
+	for(auto e : m_overflow) {
+		if((m_rects[e] & r).area() > 0)
+			++count;
+	}
+	return count;
+}
+
+void NewTargetGrid::Add(const Rect & r)
+{
+	if(r.width <= 0 || r.height <= 0) /* Never overlaps */
+		return;
+	if(m_counts[m_head] >= NEW_TARGET_HISTORY_PER_FRAME) { /* Not from detector, it never reports more */
+		dprintf("[X] New target history full !!!\n");
+		return;
+	}
+	m_rects[m_head * NEW_TARGET_HISTORY_PER_FRAME + m_counts[m_head]++] = r;
+}
+
+void NewTargetGrid::NextFrame(int frames)
+{
+	/* Rects of current frame are visible from next frame */
+	for(int i=0;i<m_counts[m_head];i++)
+		Insert(m_head * NEW_TARGET_HISTORY_PER_FRAME + i);
+
+	/* Slot of the oldest frame is reused by the next frame, NEW_TARGET_HISTORY_FRAMES - 1 frames are kept */
+	frames = min(max(frames, 1), (int)NEW_TARGET_HISTORY_FRAMES);
+	for(int n=0;n<frames;n++) {
+		m_head = (m_head + 1) % NEW_TARGET_HISTORY_FRAMES;
+		for(int i=0;i<m_counts[m_head];i++)
+			Remove(m_head * NEW_TARGET_HISTORY_PER_FRAME + i);
+		m_counts[m_head] = 0;
+	}
+}
+
+void NewTargetGrid::Draw(Mat & outFrame, const Scalar & color)
+{
+	for(int y=0;y<m_gridRows;y++) {
+		for(int x=0;x<m_gridCols;x++) {
+			if(m_cells[y * m_gridCols + x].count > 0)
+				rectangle(outFrame, Rect(x * NEW_TARGET_GRID_SIZE, y * NEW_TARGET_GRID_SIZE, NEW_TARGET_GRID_SIZE, NEW_TARGET_GRID_SIZE), color, 1, 8, 0);
+		}
+	}
+	for(auto e : m_overflow)
+		rectangle(outFrame, m_rects[e].tl(), m_rects[e].br(), color, 2, 8, 0);
+}
+
+void NewTargetGrid::Draw(OverlayRecord & rec) const
+{
+	for(int y=0;y<m_gridRows;y++) {
+		for(int x=0;x<m_gridCols;x++) {
+			if(m_cells[y * m_gridCols + x].count > 0)
+				rec.newTargetCells.push_back(Rect(x * NEW_TARGET_GRID_SIZE, y * NEW_TARGET_GRID_SIZE, NEW_TARGET_GRID_SIZE, NEW_TARGET_GRID_SIZE));
+		}
+	}
+	for(auto e : m_overflow)
+		rec.newTargetOverflow.push_back(m_rects[e]);
+}
@@ -0,0 +1,890 @@
+#ifndef TRACKER_H
+#define TRACKER_H
+
+#include "dragon-eye.h"
+#include "overlay.h"
+
+/*
+* Fixed capacity ring, the oldest item is overwritten once full
+*/
+
+template<typename T, int N>
+class Ring
+{
+private:
+	T m_items[N];
+	int m_head; /* Next write */
+	int m_size;
+
+public:
+	Ring() : m_head(0), m_size(0) {}
+
+	inline void Clear() { m_head = 0; m_size = 0; }
+	inline void Push(const T & v) {
+		m_items[m_head] = v;
+		m_head = (m_head + 1) % N;
+		if(m_size < N)
+			m_size++;
+	}
+
+	inline int Size() const { return m_size; }
+	inline T & operator[](int i) { return m_items[(m_head - m_size + i + N) % N]; } /* 0 is the oldest */
+	inline T & Back(int i = 0) { return m_items[(m_head - 1 - i + N) % N]; } /* 0 is the latest */
+};
+
+class Target
+{
+protected:
+	uint32_t m_id;
+	double m_arcLength;
+	double m_absLength;
+	unsigned long m_lastFrameTick;
+	uint8_t m_triggerCount;
+	uint16_t m_bugTriggerCount;
+
+	/* History of latest MAX_TARGET_HISTORY samples, stored as separated rings */
+	Ring< unsigned long, MAX_TARGET_HISTORY > m_frameTicks;
+	Ring< Rect, MAX_TARGET_HISTORY > m_rects;
+	Ring< Point, MAX_TARGET_HISTORY > m_vectors;
+	Rect m_beginRect;
+	size_t m_trackedCount; /* Rects since begin */
+	size_t m_vectorCount; /* Vectors since created */
+	double m_maxVector, m_minVector;
+	Point m_velocity;
+	Point m_acceleration;
+	int m_averageArea;
+	double m_normVelocity;
+	double m_angleOfTurn;
+
+	static uint32_t s_id;
+
+	double CosineAngle(const Point & v1, const Point & v2) {
+		/* A.B = |A||B|cos() */
+		/* cos() = A.B / |A||B| */
+		return v1.dot(v2) / (norm(v1) * norm(v2));
+	}
+
+	double CosineAngle(const Point & p1, const Point & p2, const Point & p3) {
+		Point v1, v2;
+		v1.x = p1.x - p2.x;
+		v1.y = p1.y - p2.y;
+		v2.x = p2.x - p3.x;
+		v2.y = p2.y - p3.y;
+
+		/* A.B = |A||B|cos() */
+		/* cos() = A.B / |A||B| */
+		return v1.dot(v2) / (norm(v1) * norm(v2));
+	}
+
+public:
+	Target() : m_id(0), m_arcLength(0), m_absLength(0), m_lastFrameTick(0), m_triggerCount(0), m_bugTriggerCount(0),
+			m_trackedCount(0), m_vectorCount(0), m_maxVector(0), m_minVector(0), m_averageArea(0), m_normVelocity(0), m_angleOfTurn(0) {}
+
+	Target(Rect & roi, unsigned long frameTick) : m_arcLength(0), m_absLength(0), m_lastFrameTick(frameTick), m_triggerCount(0), m_bugTriggerCount(0), 
+			m_trackedCount(0), m_vectorCount(0), m_maxVector(0), m_minVector(0), m_averageArea(0), m_normVelocity(0), m_angleOfTurn(0) {
+		m_id = s_id++;
+		m_rects.Push(roi);
+		m_beginRect = roi;
+		m_trackedCount = 1;
+		m_lastFrameTick = frameTick;
+		m_frameTicks.Push(frameTick);
+		m_averageArea = roi.area();
+	}
+
+	void Reset() {
+		Rect r = m_rects.Back();
+		m_rects.Clear();
+		m_rects.Push(r);
+		m_beginRect = r;
+		m_trackedCount = 1;
+		m_frameTicks.Clear();
+		m_frameTicks.Push(m_lastFrameTick);
+		m_triggerCount = 0;
+		m_bugTriggerCount = 0;
+		m_maxVector = 0;
+		m_minVector = 0;
+		m_averageArea = 0;
+		m_normVelocity = 0;
+		m_angleOfTurn = 0;
+		//m_arcLength = 0; /* TODO : Do clear this ? */
+	}
+
+	void Update(Rect & roi, unsigned long frameTick) {
+		if(frameTick <= m_lastFrameTick) /* Reverse tick ??? Illegal !!! */
+			return;
+
+		int itick = frameTick - m_lastFrameTick;
+
+		if(m_trackedCount > 0) { /* We have 1 point now and will have 2 */
+			Point p = (roi.tl() - m_rects.Back().tl()) / itick;
+			double v = norm(p) / itick;
+
+			m_arcLength += v;
+			m_vectors.Push(p);
+			m_vectorCount++;
+
+			m_absLength = norm(roi.tl() - m_beginRect.tl());
+
+			if(m_trackedCount == 1) {
+				m_maxVector = v;
+				m_minVector = v;
+			} else if(v > m_maxVector)
+				m_maxVector = v;
+			else if(v < m_minVector)
+				m_minVector = v;
+
+			m_averageArea = (m_averageArea + roi.area()) / 2;
+		} else {
+			m_averageArea = roi.area();
+		}
+
+		if(m_trackedCount == 1) { /* We have 2 point now */
+			m_velocity.x = (roi.tl().x - m_rects.Back().tl().x) / itick;
+			m_velocity.y = (roi.tl().y - m_rects.Back().tl().y) / itick;
+		} else if(m_trackedCount > 1) { /* We have at latest 3 point now */
+			m_velocity.x = (m_velocity.x + (roi.tl().x - m_rects.Back().tl().x) / itick) / 2;
+			m_velocity.y = (m_velocity.y + (roi.tl().y - m_rects.Back().tl().y) / itick) / 2;
+
+			Point & vn = m_vectors.Back(0);
+			Point & vn_1 = m_vectors.Back(1);
+
+			m_acceleration.x = (m_acceleration.x + (vn.x - vn_1.x)) / 2;
+			m_acceleration.y = (m_acceleration.y + (vn.y - vn_1.y)) / 2;
+
+			double v = CosineAngle(vn, vn_1);
+			double radian;
+			if(v <= -1.0f)
+				radian = M_PI;
+			else if(v >= 1.0f)
+				radian = 0;
+			else
+				radian = acos(v);
+
+			/* 
+			* r = (v1.x * v2.y) - (v2.x * v1.y) 
+			* If r > 0 v2 is located on the left side of v1. 
+			* if r == 0 v2 and v1 on the same line.
+			* If r < 0 v2 is located on the right side of v2.
+			*/ 
+			v = (vn.x * vn_1.y) - (vn_1.x * vn.y);
+			if(v < 0)
+				radian *= -1.0;
+
+			m_angleOfTurn += (radian * 180 / M_PI);
+		}
+
+		m_normVelocity = norm(m_velocity);
+
+		m_rects.Push(roi);
+		m_trackedCount++;
+		m_lastFrameTick = frameTick;
+		m_frameTicks.Push(frameTick);
+#if 1
+		if(m_triggerCount >= MAX_NUM_TRIGGER)
+			Reset();
+#endif
+	}
+
+	void Update(Target & t) {
+		for(int i=0;i<t.m_rects.Size();i++) {
+			Update(t.m_rects[i], t.m_frameTicks[i]);
+		}
+	}
+
+	int DotProduct(const Point & p) {
+		int i = m_rects.Size();
+		if(i < 2)
+			return 0;
+		i--;
+		Point v[2];
+		v[0].x = p.x - m_rects[i].tl().x;
+		v[0].y = p.y - m_rects[i].tl().y;
+		v[1].x = m_rects[i].tl().x - m_rects[i-1].tl().x;
+		v[1].y = m_rects[i].tl().y - m_rects[i-1].tl().y;
+		int dp = v[0].x * v[1].x + v[0].y * v[1].y;
+		return dp;
+	}
+
+    double CosineAngleTl(const Point & p) {
+        int i = m_rects.Size();
+        if(i < 2)
+            return 0;
+        --i;
+        Point v1, v2;
+        v1.x = p.x - m_rects[i].tl().x;
+        v1.y = p.y - m_rects[i].tl().y;
+        v2.x = m_rects[i].tl().x - m_rects[i-1].tl().x;
+        v2.y = m_rects[i].tl().y - m_rects[i-1].tl().y;
+
+        /* A.B = |A||B|cos() */
+        /* cos() = A.B / |A||B| */
+        return v1.dot(v2) / (norm(v1) * norm(v2));
+    }
+
+    double CosineAngleBr(const Point & p) {
+        int i = m_rects.Size();
+        if(i < 2)
+            return 0;
+        --i;
+        Point v1, v2;
+        v1.x = p.x - m_rects[i].br().x;
+        v1.y = p.y - m_rects[i].br().y;
+        v2.x = m_rects[i].br().x - m_rects[i-1].br().x;
+        v2.y = m_rects[i].br().y - m_rects[i-1].br().y;
+
+        /* A.B = |A||B|cos() */
+        /* cos() = A.B / |A||B| */
+        return v1.dot(v2) / (norm(v1) * norm(v2));
+    }
+
+    double CosineAngleCt(const Point & p) {
+        int i = m_rects.Size();
+        if(i < 2)
+            return 0;
+        --i;
+        Point v1, v2;
+        Point ct0 = Center(m_rects[i]);
+        Point ct1 = Center(m_rects[i-1]);
+        v1.x = p.x - ct0.x;
+        v1.y = p.y - ct0.y;
+        v2.x = ct0.x - ct1.x;
+        v2.y = ct0.y - ct1.y;
+
+        /* A.B = |A||B|cos() */
+        /* cos() = A.B / |A||B| */
+        return v1.dot(v2) / (norm(v1) * norm(v2));
+    }
+
+	void Draw(Mat & outFrame, bool drawAll = false) {
+		RNG rng(m_beginRect.area());
+		Scalar color = Scalar( rng.uniform(0, 255), rng.uniform(0,255), rng.uniform(0,255) );
+		Rect r = m_rects.Back();
+		//rectangle( outFrame, r.tl(), r.br(), Scalar( 255, 0, 0 ), 2, 8, 0 );
+		rectangle( outFrame, r.tl(), r.br(), color, 1, 8, 0 );
+
+		if(m_rects.Size() > 1) { /* Minimum 2 points ... */
+			for(int i=0;i<m_rects.Size()-1;i++) {
+				//line(outFrame, p0, p1, Scalar(0, 0, 255), 1);
+				line(outFrame, Center(m_rects[i]), Center(m_rects[i+1]), color, 1);
+				if(drawAll)
+					//rectangle( outFrame, m_rects[i].tl(), m_rects[i].br(), Scalar( 196, 0, 0 ), 2, 8, 0 );
+					//rectangle( outFrame, m_rects[i].tl(), m_rects[i].br(), Scalar( (m_rects[0].x + m_rects[0].y) % 255, 0, 0 ), 1, 8, 0 );
+					rectangle( outFrame, m_rects[i].tl(), m_rects[i].br(), color, 1, 8, 0 );
+			}
+		}        
+	}
+
+	/* Same as Draw(outFrame, true), rasterized later by output thread */
+	void Draw(OverlayRecord & rec) {
+		RNG rng(m_beginRect.area());
+		OverlayTarget t;
+		t.color = Scalar( rng.uniform(0, 255), rng.uniform(0,255), rng.uniform(0,255) );
+		t.begin = rec.trajectories.size();
+		for(int i=0;i<m_rects.Size();i++)
+			rec.trajectories.push_back(m_rects[i]);
+		t.end = rec.trajectories.size();
+		rec.targets.push_back(t);
+	}
+
+	void Info() {
+#ifdef DEBUG
+		printf("\033[0;31m"); /* Red */
+		printf("\n= = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = =\n");
+		printf("[%u] Target :\n\tsamples = %lu, area = %d, arc length = %.1f, abs length = %.1f, velocity = %.1f\n", 
+			m_id, m_trackedCount, m_averageArea, m_arcLength, m_absLength, m_normVelocity);
+		printf("\nVectors : length\n");      
+		for(int i=0;i<m_vectors.Size();i++) {
+			printf("%.1f\t", norm(m_vectors[i]));
+		}
+		printf("\n");
+		printf("maximum = %.1f, minimum = %.1f\n", m_maxVector, m_minVector);      
+		printf("\nTrajectory : [ Tick ] (x, y) area\n");
+		/*
+		for(auto p : m_rects) {
+			printf("(%4d,%4d)<%5d>\t", p.tl().x, p.tl().y, p.area());
+		}
+		*/
+		for(int i=0;i<m_rects.Size();i++) {
+			printf("[%lu](%4d,%4d) %d\t", m_frameTicks[i] - m_frameTicks[0], m_rects[i].tl().x, m_rects[i].tl().y, m_rects[i].area());
+		}
+
+		printf("\nAngle of turn :\n"); 
+		if(m_vectors.Size() > 1)
+		for(int i=0;i<m_vectors.Size()-1;i++) {
+			double v = CosineAngle(m_vectors[i], m_vectors[i+1]);
+			double radian;
+			if(v <= -1.0f)
+				radian = M_PI;
+			else if(v >= 1.0f)
+				radian = 0;
+			else
+				radian = acos(v);
+
+			/* 
+			* r = (v1.x * v2.y) - (v2.x * v1.y) 
+			* If r > 0 v2 is located on the left side of v1. 
+			* if r == 0 v2 and v1 on the same line.
+			* If r < 0 v2 is located on the right side of v2.
+			*/ 
+			v = (m_vectors[i+1].x * m_vectors[1].y) - (m_vectors[1].x * m_vectors[i+1].y);
+			if(v < 0)
+				radian *= -1.0;
+
+			printf("<%f ", (radian * 180 / M_PI));
+		}
+		printf("\n= = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = = =\n");
+		printf("\033[0m"); /* Default color */
+#endif
+	}
+
+	inline double VectorDistortion() {
+		return m_minVector > 0 ? (m_maxVector / m_minVector) : 0;
+	}
+
+	inline double ArcLength() { return m_arcLength; }
+	inline double AbsLength() { return m_absLength; }
+
+	inline unsigned long FrameTick() { return m_lastFrameTick; }
+	inline const Rect & LastRect() { return m_rects.Back(); }
+
+	inline const Point BeginCenterPoint() { return Center(m_beginRect); }
+	inline const Point EndCenterPoint() { return Center(m_rects.Back()); }
+
+	inline const Point CurrentCenterPoint() { return Center(m_rects.Back()); }
+	const Point PreviousCenterPoint() {
+		if(m_rects.Size() < 2)
+			return std::move(Point(0, 0));
+
+		return Center(m_rects.Back(1));
+	}
+
+	/* Target with long enough course across vertical line x = cx */
+	bool IsCrossLine(int cx) {
+		if(ArcLength() <= MIN_COURSE_LENGTH ||
+			AbsLength() <= MIN_COURSE_LENGTH ||
+			TrackedCount() <= MIN_TARGET_TRACKED_COUNT)
+			return false;
+
+		return (BeginCenterPoint().x > cx && EndCenterPoint().x <= cx) ||
+			(BeginCenterPoint().x < cx && EndCenterPoint().x >= cx) ||
+			(PreviousCenterPoint().x > cx && CurrentCenterPoint().x <= cx) ||
+			(PreviousCenterPoint().x < cx && CurrentCenterPoint().x >= cx);
+	}
+
+	bool Trigger(bool enableBugTrigger = false) {
+		bool r = false;
+		if(m_vectorCount <= 8 &&
+			VectorDistortion() >= 40) { /* 最大位移向量值與最小位移向量值的比例 */
+			dprintf("\033[0;31m"); /* Red */
+			dprintf("Velocity distortion %f !!!\n", VectorDistortion());
+			dprintf("\033[0m"); /* Default color */
+		} else if(enableBugTrigger) { 
+			if((m_averageArea < 144 && m_normVelocity > 30) || /* 12 x 12 */
+					(m_averageArea < 256 && m_normVelocity > 40) || /* 16 x 16 */
+					(m_averageArea < 324 && m_normVelocity > 50) || /* 18 x 18 */
+					(m_averageArea < 400 && m_normVelocity > 75) || /* 20 x 20 */
+					(m_averageArea < 576 && m_normVelocity > 100) || /* 24 x 24 */
+					(m_averageArea < 900 && m_normVelocity > 125) /* 30 x 30 */
+				) {
+				dprintf("\033[0;31m"); /* Red */
+				dprintf("Bug detected !!! average area = %d, velocity = %f\n", m_averageArea, m_normVelocity);
+				dprintf("\033[0m"); /* Default color */
+				m_bugTriggerCount++;
+			} else {
+				if(m_bugTriggerCount > 0) {
+					dprintf("\033[0;31m"); /* Red */
+					dprintf("False trigger due to bug trigger count is %u\n", m_bugTriggerCount);
+					dprintf("\033[0m"); /* Default color */
+					if(m_bugTriggerCount <= 3) /* To avoid false bug detection */
+						m_bugTriggerCount--;
+				} else {
+					m_triggerCount++;
+					r = true;
+				}
+			}
+		} else {
+			m_triggerCount++;
+			r = true;
+		}
+		if(r) {
+			dprintf("\033[0;31m"); /* Red */
+			dprintf("[%u] T R I G G E R (%d)\n", m_id, m_triggerCount);
+			dprintf("\033[0m"); /* Default color */
+		}
+
+		Info();
+
+		return r;
+	}
+
+	inline uint8_t TriggerCount() { return m_triggerCount; }
+	inline uint32_t Id() const { return m_id; }
+
+	inline int AverageArea() { return m_averageArea; }
+	inline size_t TrackedCount() { return m_trackedCount; }
+
+	friend class Tracker;
+};
+
+
+static inline bool TargetSortByArea(Target & a, Target & b)
+{
+	return a.LastRect().area() > b.LastRect().area();
+}
+
+static inline bool TargetSortByTrackedCount(Target & a, Target & b)
+{
+    return a.TrackedCount() > b.TrackedCount();
+}
+
+/*
+* Targets in a preallocated pool, slots never move so Target pointers are stable during tracking.
+* Active slots are kept in tracking order, add / erase / sort only touch the index array.
+*/
+
+class TargetPool
+{
+private:
+	vector< Target > m_slots;
+	vector< uint16_t > m_active; /* Slot index of active targets in order */
+	vector< uint16_t > m_free;
+
+public:
+	class iterator
+	{
+	private:
+		Target *m_slots;
+		vector< uint16_t >::iterator m_it;
+
+		friend class TargetPool;
+
+	public:
+		iterator(Target *slots, vector< uint16_t >::iterator it) : m_slots(slots), m_it(it) {}
+
+		inline Target & operator*() const { return m_slots[*m_it]; }
+		inline Target * operator->() const { return &m_slots[*m_it]; }
+		inline iterator & operator++() { ++m_it; return *this; }
+		inline bool operator==(const iterator & it) const { return m_it == it.m_it; }
+		inline bool operator!=(const iterator & it) const { return m_it != it.m_it; }
+	};
+
+	TargetPool() : m_slots(MAX_TARGET_POOL) {
+		m_active.reserve(MAX_TARGET_POOL);
+		m_free.reserve(MAX_TARGET_POOL);
+		for(int i=MAX_TARGET_POOL-1;i>=0;i--)
+			m_free.push_back(i);
+	}
+
+	inline iterator begin() { return iterator(m_slots.data(), m_active.begin()); }
+	inline iterator end() { return iterator(m_slots.data(), m_active.end()); }
+	inline size_t size() const { return m_active.size(); }
+	inline bool empty() const { return m_active.empty(); }
+	inline Target & back() { return m_slots[m_active.back()]; }
+
+	/* NULL if pool is full */
+	Target * Add(Rect & roi, unsigned long frameTick) {
+		if(m_free.empty())
+			return NULL;
+		uint16_t i = m_free.back();
+		m_free.pop_back();
+		m_slots[i] = Target(roi, frameTick);
+		m_active.push_back(i);
+		return &m_slots[i];
+	}
+
+	iterator Erase(iterator it) {
+		m_free.push_back(*it.m_it);
+		return iterator(m_slots.data(), m_active.erase(it.m_it));
+	}
+
+	/* Stable insertion sort, order hardly changes between frames */
+	template<typename Compare>
+	void Sort(Compare comp) {
+		for(size_t i=1;i<m_active.size();i++) {
+			uint16_t k = m_active[i];
+			size_t j = i;
+			while(j > 0 && comp(m_slots[k], m_slots[m_active[j - 1]])) {
+				m_active[j] = m_active[j - 1];
+				j--;
+			}
+			m_active[j] = k;
+		}
+	}
+};
+
+/*
+* New targets of latest NEW_TARGET_HISTORY_FRAMES frames, bucketed in a grid of NEW_TARGET_GRID_SIZE cells.
+* A cell references the recorded rects covering it, references of the oldest frame are removed as frames go by.
+* Overlap count only visits cells under the rect, a recorded rect is counted in the cell holding the top left of the overlap.
+*/
+
+class NewTargetGrid
+{
+private:
+	typedef struct {
+		uint16_t count;
+		uint16_t entry[NEW_TARGET_GRID_SLOTS];
+	} Cell;
+
+	int m_gridCols, m_gridRows;
+	vector< Cell > m_cells;
+	Rect m_rects[NEW_TARGET_HISTORY_FRAMES * NEW_TARGET_HISTORY_PER_FRAME]; /* Entry is frame slot * NEW_TARGET_HISTORY_PER_FRAME + index */
+	uint8_t m_counts[NEW_TARGET_HISTORY_FRAMES];
+	bool m_isOverflow[NEW_TARGET_HISTORY_FRAMES * NEW_TARGET_HISTORY_PER_FRAME];
+	vector< uint16_t > m_overflow; /* Entries which did not fit in a full cell */
+	int m_head; /* Frame slot of current frame */
+
+	Rect CellRange(const Rect & r) const;
+	inline int CellOf(int v, int cells) const {
+		int c = v / NEW_TARGET_GRID_SIZE;
+		return c < 0 ? 0 : (c >= cells ? cells - 1 : c);
+	}
+	void Insert(uint16_t entry);
+	void Remove(uint16_t entry);
+
+public:
+	NewTargetGrid(int width = CAMERA_WIDTH, int height = CAMERA_HEIGHT) { Initialisize(width, height); }
+
+	void Initialisize(int width, int height);
+	void Clear();
+
+	uint32_t OverlapCount(const Rect & r) const; /* Recorded rects overlap r */
+	void Add(const Rect & r); /* Record to current frame */
+	void NextFrame(int frames = 1); /* Current frame goes to history, frames more than 1 are empty (dropped) frames */
+
+	void Draw(Mat & outFrame, const Scalar & color);
+	void Draw(OverlayRecord & rec) const; /* Cells and overflow rects */
+};
+
+/*
+*
+*/
+
+class Tracker
+{
+private:
+	int m_width, m_height;
+	unsigned long m_lastFrameTick;
+	TargetPool m_targets;
+	Rect m_newTargetRestrictionRect;
+	NewTargetGrid m_newTargetsHistory;
+	int m_horizonHeight;
+
+    size_t MaxTrackedCountOfTargets() {
+        size_t maxCount = 0;
+        for(TargetPool::iterator t=m_targets.begin();t!=m_targets.end();++t) {
+            if(t->TrackedCount() > maxCount)
+                maxCount = t->TrackedCount();
+        }
+        return maxCount;
+    }
+
+	typedef struct {
+		int tier; /* 0 : tracked, 1 : missing target search */
+		double cost; /* Distance between object and predicted target */
+		Target *target;
+		int roi;
+	} Assignment;
+
+	vector< Rect > m_rois;
+	vector< Target * > m_roiTarget;
+	vector< int > m_cellHead, m_cellNext; /* Spatial hash of objects */
+	vector< Assignment > m_assignments;
+
+	inline int CellOf(int v, int cells) const {
+		int c = v / MAX_TARGET_TRACKING_DISTANCE;
+		return c < 0 ? 0 : (c >= cells ? cells - 1 : c);
+	}
+
+	/* Same chain of heuristics as tracking one target at a time, tier of the match or -1 */
+	int MatchTier(Target & t, const Rect & r1, const Rect & r2, int f, double n0, const Rect & rr) {
+		if(r1.area() > (rr.area() * 32) ||
+			rr.area() > (r1.area() * 32)) /* Object and target area difference */
+			return -1;
+
+		Point rrct = Center(rr);
+		double n1 = cv::norm(rrct - Center(r1)); /* Distance between object and target */
+
+		if(n1 > MAX_TARGET_TRACKING_DISTANCE)
+			return -1; /* Too far */
+
+		if((r1 & rr).area() > 0) /* Target tracked ... */
+			return 0;
+
+		if(t.m_vectorCount > 0) {
+			Rect r = r1;
+			Point v = t.m_vectors.Back();
+			for(int i=0;i<f;i++) {
+				r.x += v.x;
+				r.y += v.y;
+				if((r & rr).area() > 0) /* Target tracked with velocity ... */
+					return 0;
+			}
+		}
+
+		if(t.m_vectorCount > 0) {
+			Rect r = r1;
+			Point v = t.m_vectors.Back();
+			for(int i=0;i<f;i++) {
+				v.x += t.m_acceleration.x;
+				v.y += t.m_acceleration.y;
+				r.x += v.x;
+				r.y += v.y;
+				if((r & rr).area() > 0) /* Target tracked with velocity ... */
+					return 0;
+			}
+		}
+
+		if(t.m_vectorCount == 0) { /* new target with zero velocity, no missing target search (tier 1) without velocity */
+			if(rr.y >= m_horizonHeight) {
+				if(n1 < (rr.width + rr.height)) /* Target tracked with Euclidean distance ... */
+					return 0;
+			} else {
+				if(n1 < (rr.width + rr.height) * 2) /* Target tracked with Euclidean distance ... */
+					return 0;
+			}
+			return -1;
+		} else if(n1 < (n0 * 3) / 2) { /* Target tracked with velocity and Euclidean distance ... */
+			if(rr.y >= m_horizonHeight) {
+				double a = t.CosineAngleCt(rrct);
+				if(a > 0.9659) /* cos(PI/12) */
+					return 0;
+			}
+		}
+
+		/* Target missing ... */
+		if(n1 > (MAX_TARGET_TRACKING_DISTANCE/ 2))
+			return -1; /* Too far */
+
+		double a = t.CosineAngleCt(rrct);
+		double n2 = cv::norm(rrct - Center(r2));
+
+		if(a > 0.5 && /* cos(PI/3) */
+			n2 < (n0 * 3) / 2)
+			return 1;
+
+		if(a > 0.8587 && /* cos(PI/6) */
+			n1 < (t.m_normVelocity * f * 2))
+			return 1;
+
+		return -1;
+	}
+
+public:
+	Tracker() : m_width(CAMERA_WIDTH), m_height(CAMERA_HEIGHT), m_lastFrameTick(0), m_horizonHeight(CAMERA_HEIGHT * HORIZON_RATIO) {}
+	Tracker(int width, int height) : Tracker() {
+		m_width = width;
+		m_height = height;
+		m_horizonHeight = height * HORIZON_RATIO;
+		m_newTargetsHistory.Initialisize(width, height);
+	}
+
+	void UpdateHorizonRatio(uint16_t horizonRatio) {
+		switch(horizonRatio) {
+			case 20: m_horizonHeight = m_height * 8 / 10;
+				break;
+			case 30: m_horizonHeight = m_height * 7 / 10;
+				break;
+		}
+	}
+
+	void Initialisize(int width, int height) {
+		m_width = width;
+		m_height = height;
+		m_newTargetsHistory.Initialisize(width, height);
+	}
+
+	int HorizonHeight() const { return m_horizonHeight; }
+
+	void NewTargetRestriction(const Rect & r) {
+		m_newTargetRestrictionRect = r;
+	}
+
+	Rect NewTargetRestrictionRect() const {   return m_newTargetRestrictionRect; }
+
+	/*
+	* Objects are assigned to targets globally : every (target, object) pair passing the heuristics is a candidate,
+	* candidates are taken greedily by tier then by distance to predicted target, so a contested object goes to the closest target.
+	* Objects are bucketed in a spatial hash with cell size of MAX_TARGET_TRACKING_DISTANCE, a target only checks the 3 x 3 cells around it.
+	*/
+	void Update(list< Rect > & roiRect, bool enableFakeTargetDetection = false) {
+		Update(roiRect, m_lastFrameTick + 1, enableFakeTargetDetection);
+	}
+
+	/*
+	* frameTick counts frame periods from capture time stamp, a gap of dropped frames is more than 1 tick.
+	* Velocity, prediction and lost target window of targets are all in frame periods.
+	*/
+	void Update(list< Rect > & roiRect, unsigned long frameTick, bool enableFakeTargetDetection) {
+		if(frameTick <= m_lastFrameTick) /* Reverse tick, treat as next frame */
+			frameTick = m_lastFrameTick + 1;
+		int frames = frameTick - m_lastFrameTick;
+		m_lastFrameTick = frameTick;
+
+		m_rois.assign(roiRect.begin(), roiRect.end());
+		m_roiTarget.assign(m_rois.size(), NULL);
+		m_assignments.clear();
+
+		int cells = (max(m_width, m_height) + MAX_TARGET_TRACKING_DISTANCE - 1) / MAX_TARGET_TRACKING_DISTANCE;
+		if(cells < 1)
+			cells = 1;
+		m_cellHead.assign(cells * cells, -1);
+		m_cellNext.resize(m_rois.size());
+		for(int i=m_rois.size()-1;i>=0;i--) { /* Cell list in object order */
+			Point ct = Center(m_rois[i]);
+			int cell = CellOf(ct.y, cells) * cells + CellOf(ct.x, cells);
+			m_cellNext[i] = m_cellHead[cell];
+			m_cellHead[cell] = i;
+		}
+
+		for(TargetPool::iterator t=m_targets.begin();t!=m_targets.end();) { /* Candidates of every target */
+			Rect r1 = t->m_rects.Back();
+			Rect r2 = r1;
+			int f = m_lastFrameTick - t->FrameTick();
+			if(t->m_vectorCount > 0) {
+				Point v = t->m_vectors.Back();
+				for(int i=0;i<f;i++) {
+					v.x += t->m_acceleration.x;
+					v.y += t->m_acceleration.y;
+					r2.x += v.x;
+					r2.y += v.y;
+				}
+			}
+
+			if(t->m_triggerCount > 0 &&
+					(r2.x < 0 || r2.x > m_width)) {
+				dprintf("\033[0;35m"); /* Puple */
+				dprintf("<%u> Out of range target : (%d, %d), samples : %lu\n", t->m_id, t->m_rects.Back().tl().x, t->m_rects.Back().tl().y, t->m_trackedCount);
+				dprintf("\033[0m"); /* Default color */
+				t = m_targets.Erase(t); /* Remove tracing target */
+				continue;
+			}
+
+			double n0 = 0;
+			if(t->m_vectorCount > 0) {
+				n0 = cv::norm(Center(r2) - Center(r1)); /* Moving distance of predict target */
+			}
+
+			Point ct1 = Center(r1);
+			Point ct2 = Center(r2);
+			int cx = CellOf(ct1.x, cells);
+			int cy = CellOf(ct1.y, cells);
+			for(int y=max(0, cy-1);y<=min(cells-1, cy+1);y++) {
+				for(int x=max(0, cx-1);x<=min(cells-1, cx+1);x++) {
+					for(int i=m_cellHead[y * cells + x];i>=0;i=m_cellNext[i]) {
+						int tier = MatchTier(*t, r1, r2, f, n0, m_rois[i]);
+						if(tier < 0)
+							continue;
+						Assignment a;
+						a.tier = tier;
+						a.cost = cv::norm(Center(m_rois[i]) - ct2);
+						a.target = &(*t);
+						a.roi = i;
+						m_assignments.push_back(a);
+					}
+				}
+			}
+			++t;
+		}
+
+		stable_sort(m_assignments.begin(), m_assignments.end(), [](const Assignment & a, const Assignment & b) {
+				return (a.tier < b.tier) || (a.tier == b.tier && a.cost < b.cost);
+			});
+
+		for(auto & a : m_assignments) { /* Greedy, best pair first */
+			if(m_roiTarget[a.roi] != NULL || a.target->m_lastFrameTick == m_lastFrameTick)
+				continue;
+			Rect & rr = m_rois[a.roi];
+			Target * t = a.target;
+			dprintf("\033[0;32m"); /* Green */
+			dprintf("<%u> Target tracked : [%lu](%d, %d) -> (%d, %d)[%d, %d]\n", t->m_id, m_lastFrameTick, t->m_rects.Back().x, t->m_rects.Back().y, 
+				rr.x, rr.y, rr.x - t->m_rects.Back().x, rr.y - t->m_rects.Back().y);
+			dprintf("\033[0m"); /* Default color */
+			t->Update(rr, m_lastFrameTick);
+			m_roiTarget[a.roi] = t;
+		}
+
+		for(TargetPool::iterator t=m_targets.begin();t!=m_targets.end();) {
+			if(t->m_lastFrameTick == m_lastFrameTick) { /* Target tracked ... */
+				++t;
+				continue;
+			}
+			/* Target missing ... */
+			int f = m_lastFrameTick - t->FrameTick();
+			bool isTargetLost = false;
+			if(t->m_vectorCount > 1) {
+				uint32_t compensation = (t->TrackedCount() / 6); /* Tracking more frames with more sample */
+				if(compensation > 5)
+					compensation = 5;
+				if(f > (MAX_NUM_FRAME_MISSING_TARGET + compensation)) /* Target still missing for over X frames */
+					isTargetLost = true;
+			} else { /* new target with zero velocity */
+				if(f > MAX_NUM_FRAME_MISSING_TARGET) 
+					isTargetLost = true;
+			}
+			if(isTargetLost) {
+				dprintf("\033[0;35m"); /* Puple */
+				dprintf("<%u> Lost target : (%d, %d), samples : %lu\n", t->m_id, t->m_rects.Back().tl().x, t->m_rects.Back().tl().y, t->m_trackedCount);
+				dprintf("\033[0m"); /* Default color */
+				t = m_targets.Erase(t); /* Remove tracing target */
+				continue;
+			}
+			++t;
+		}
+
+		size_t i = 0; /* Objects left are new targets */
+		for(list<Rect>::iterator rr=roiRect.begin();rr!=roiRect.end();i++) {
+			if(m_roiTarget[i] != NULL)
+				rr = roiRect.erase(rr);
+			else
+				++rr;
+		}
+
+		for(list<Rect>::iterator rr=roiRect.begin();rr!=roiRect.end();++rr) { /* New targets registration */
+			if(!m_newTargetRestrictionRect.empty()) {
+				if((m_newTargetRestrictionRect & *rr).area() > 0)
+					continue;
+			}
+
+			uint32_t overlap_count = 0;
+			if(rr->y >= m_horizonHeight) {
+				overlap_count = m_newTargetsHistory.OverlapCount(*rr); /* new target overlap previous new targets */
+				if(overlap_count > 0) {
+					rr->x -= rr->width;
+					rr->y -= rr->height;
+					rr->width = rr->width << 1;
+					rr->height = rr->height << 1;
+				}
+				m_newTargetsHistory.Add(*rr);
+			}
+
+			if(enableFakeTargetDetection && 
+				overlap_count >= 2) {
+				dprintf("[X] Fake target : (%u)\n", overlap_count);
+			} else {
+				Target *t = m_targets.Add(*rr, m_lastFrameTick);
+				if(t == NULL) {
+					dprintf("[X] Target pool full !!!\n");
+					continue;
+				}
+				dprintf("\033[0;32m"); /* Green */
+				dprintf("<%u> New target : [%lu](%d, %d)\n", t->m_id, m_lastFrameTick, rr->tl().x, rr->tl().y);
+				dprintf("\033[0m"); /* Default color */
+			}
+		}
+
+		m_newTargetsHistory.NextFrame(frames);
+
+		if(m_targets.size() > 1) {
+			if(MaxTrackedCountOfTargets() > 6)
+				m_targets.Sort(TargetSortByTrackedCount);
+			else
+				m_targets.Sort(TargetSortByArea);
+		}
+	}
+
+	inline TargetPool & TargetList() { return m_targets; }
+	inline NewTargetGrid & NewTargetHistory() { return m_newTargetsHistory; }
+};
+
+#endif
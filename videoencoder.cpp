@@ -0,0 +1,311 @@
+#include "videoencoder.h"
+#include "streammeta.h"
+
+#include <iostream>
+
+static const char *s_outputName[NUM_VIDEO_OUTPUT] = { "record", "display", "RTP", "HLS", "RTSP", "clip" };
+
+#ifdef VIDEO_OMXH265ENC
+static const char *s_hardwareEncoder = "omxh265enc";
+#else
+static const char *s_hardwareEncoder = "nvv4l2h265enc";
+#endif
+
+bool VideoEncoder::IsHardwareEncoder()
+{
+	GstElementFactory *factory = gst_element_factory_find(s_hardwareEncoder);
+	if(factory == 0)
+		return false;
+	gst_object_unref(factory);
+	return true;
+}
+
+const char *VideoEncoder::OutputName(VideoOutput_t output)
+{
+	return (output >= 0 && output < NUM_VIDEO_OUTPUT) ? s_outputName[output] : "unknown";
+}
+
+GstFlowReturn VideoEncoder::NewSample(GstAppSink *sink, gpointer user)
+{
+	VideoEncoder *encoder = (VideoEncoder *)user;
+	GstSample *sample = gst_app_sink_pull_sample(sink);
+	if(sample == 0)
+		return GST_FLOW_EOS;
+
+	GstBuffer *buffer = gst_sample_get_buffer(sample);
+	if(buffer && encoder->m_encodedCallback)
+		encoder->m_encodedCallback(buffer, encoder->m_encodedUser);
+
+	gst_sample_unref(sample);
+	return GST_FLOW_OK;
+}
+
+/* Called on streaming thread by splitmuxsink before each segment */
+gchar *VideoEncoder::FormatLocation(GstElement *splitmux, guint fragmentId, gpointer user)
+{
+	VideoEncoder *encoder = (VideoEncoder *)user;
+	char location[256];
+	snprintf(location, sizeof(location), encoder->m_fileFormat.c_str(), (encoder->m_fileIndex + fragmentId) % encoder->m_maxFiles);
+
+	cout << endl;
+	cout << "*** Record video " << location << " ***" << endl;
+
+	return g_strdup(location);
+}
+
+/* Access units from parser, SEI of the same PTS goes in before the first slice */
+GstPadProbeReturn VideoEncoder::MetaProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user)
+{
+	VideoEncoder *encoder = (VideoEncoder *)user;
+	GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+	GstClockTime pts = GST_BUFFER_PTS(buffer);
+	vector<uint8_t> payload;
+
+	{
+		std::unique_lock<std::mutex> lock(encoder->m_metaMutex);
+		deque< pair< GstClockTime, vector<uint8_t> > > & metas = encoder->m_metas;
+		while(!metas.empty() && metas.front().first < pts) /* Frame dropped by encoder */
+			metas.pop_front();
+		if(metas.empty() || metas.front().first != pts)
+			return GST_PAD_PROBE_OK;
+		payload.swap(metas.front().second);
+		metas.pop_front();
+	}
+
+	GstMapInfo map;
+	if(gst_buffer_map(buffer, &map, GST_MAP_READ) == false)
+		return GST_PAD_PROBE_OK;
+	vector<uint8_t> au;
+	bool isInserted = InsertSeiUserData(map.data, map.size, payload, au);
+	gst_buffer_unmap(buffer, &map);
+	if(isInserted == false)
+		return GST_PAD_PROBE_OK;
+
+	GstBuffer *out = gst_buffer_new_allocate(NULL, au.size(), NULL);
+	gst_buffer_fill(out, 0, au.data(), au.size());
+	gst_buffer_copy_into(out, buffer, GST_BUFFER_COPY_METADATA, 0, -1); /* PTS / DTS / flags */
+	gst_buffer_unref(buffer);
+	GST_PAD_PROBE_INFO_DATA(info) = out;
+
+	return GST_PAD_PROBE_OK;
+}
+
+void VideoEncoder::PollBus()
+{
+	GstMessage *msg;
+	while((msg = gst_bus_pop_filtered(m_bus, (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS))) != 0) {
+		if(GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR) {
+			GError *err = 0;
+			gchar *debug = 0;
+			gst_message_parse_error(msg, &err, &debug);
+			printf("Video encoder - %s\n", err ? err->message : "unknown error");
+			if(debug)
+				dprintf("%s\n", debug);
+			g_clear_error(&err);
+			g_free(debug);
+		}
+		gst_message_unref(msg);
+	}
+}
+
+static void ReleaseFrame(gpointer data)
+{
+	delete (Mat *)data;
+}
+
+/*
+* Every branch of a tee needs its own queue, otherwise a muxer waiting for preroll blocks the other branches.
+* Sinks of network branches are async=false so the live pipeline goes to PLAYING without them.
+*/
+
+bool VideoEncoder::Open(const VideoEncoderConfig & cfg)
+{
+	Close();
+
+	const bool *isOutput = cfg.isOutput;
+	bool isEncode = isOutput[VIDEO_OUTPUT_FILE] || isOutput[VIDEO_OUTPUT_RTP] || isOutput[VIDEO_OUTPUT_HLS] || isOutput[VIDEO_OUTPUT_RTSP] ||
+		isOutput[VIDEO_OUTPUT_CLIP];
+	bool isHardware = IsHardwareEncoder();
+	string keyInterval = to_string(VIDEO_ENCODER_KEY_INTERVAL);
+
+	if(isOutput[VIDEO_OUTPUT_RTP] && cfg.rtpHost.empty()) {
+		printf("Video encoder - No RTP remote host\n");
+		return false;
+	}
+
+	string s = "appsrc name=src is-live=true format=time caps=video/x-raw,format=BGR,width=" + to_string(cfg.width) +
+		",height=" + to_string(cfg.height) + ",framerate=" + to_string(cfg.fps) + "/1 ! ";
+#ifndef VIDEO_OMXH265ENC
+	if(isHardware)
+		s += "videoconvert ! video/x-raw,format=BGRx ! nvvidconv ! video/x-raw(memory:NVMM),format=I420 ! ";
+	else
+#endif
+		s += "videoconvert ! video/x-raw,format=I420 ! ";
+	s += "tee name=raw ";
+
+	if(isOutput[VIDEO_OUTPUT_SCREEN]) {
+		if(isHardware) /* Countclockwise rote 90 degree - nvvidconv flip-method=1 */
+			s += "raw. ! queue leaky=downstream max-size-buffers=2 ! nvvidconv flip-method=3 ! video/x-raw(memory:NVMM) ! nvoverlaysink sync=false ";
+		else
+			s += "raw. ! queue leaky=downstream max-size-buffers=2 ! videoconvert ! autovideosink sync=false ";
+	}
+
+	if(isEncode) {
+		s += "raw. ! queue max-size-buffers=2 ! ";
+		if(isHardware)
+#ifdef VIDEO_OMXH265ENC
+			s += "omxh265enc control-rate=2 bitrate=" + to_string(VIDEO_ENCODER_BITRATE) + " insert-sps-pps=1 iframeinterval=" + keyInterval + " ! ";
+#else
+			s += "nvv4l2h265enc bitrate=" + to_string(VIDEO_ENCODER_BITRATE) + " maxperf-enable=1 insert-sps-pps=1 iframeinterval=" + keyInterval +
+				" idrinterval=" + keyInterval + " ! ";
+#endif
+		else
+			s += "x265enc speed-preset=ultrafast tune=zerolatency key-int-max=" + keyInterval + " bitrate=" + to_string(VIDEO_ENCODER_BITRATE / 1000) + " ! ";
+		s += "h265parse name=parse config-interval=-1 ! video/x-h265,stream-format=byte-stream,alignment=au ! tee name=t ";
+
+		if(isOutput[VIDEO_OUTPUT_FILE]) /* Not leaky, recorded file keeps every encoded frame. Key frame is requested at segment boundary */
+			s += "t. ! queue ! h265parse ! splitmuxsink name=rec send-keyframe-requests=true max-size-bytes=0 max-size-time=" +
+				to_string((uint64_t)cfg.segmentSeconds * GST_SECOND) + " ";
+		if(isOutput[VIDEO_OUTPUT_RTP])
+			s += "t. ! queue leaky=downstream ! rtph265pay mtu=1400 config-interval=10 pt=96 ! udpsink host=" + cfg.rtpHost +
+				" port=" + to_string(cfg.rtpPort) + " sync=false async=false ";
+		if(isOutput[VIDEO_OUTPUT_HLS])
+			s += "t. ! queue leaky=downstream ! mpegtsmux ! hlssink playlist-location=/tmp/playlist.m3u8 location=/tmp/segment%05d.ts target-duration=1 max-files=10 ";
+		if(isOutput[VIDEO_OUTPUT_RTSP] || isOutput[VIDEO_OUTPUT_CLIP])
+			s += "t. ! queue leaky=downstream ! appsink name=encoded sync=false async=false max-buffers=30 drop=true ";
+	}
+
+	cout << endl;
+	cout << s << endl;
+	cout << endl;
+
+	GError *err = 0;
+	m_pipeline = gst_parse_launch(s.c_str(), &err);
+	if(m_pipeline == 0 || err) {
+		printf("Video encoder - %s\n", err ? err->message : "parse error");
+		g_clear_error(&err);
+		if(m_pipeline) {
+			gst_object_unref(m_pipeline);
+			m_pipeline = 0;
+		}
+		return false;
+	}
+
+	m_appSrc = gst_bin_get_by_name(GST_BIN(m_pipeline), "src");
+	m_bus = gst_element_get_bus(m_pipeline);
+
+	if(isEncode) {
+		GstElement *parse = gst_bin_get_by_name(GST_BIN(m_pipeline), "parse");
+		GstPad *pad = gst_element_get_static_pad(parse, "src");
+		gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, &VideoEncoder::MetaProbe, this, 0);
+		gst_object_unref(pad);
+		gst_object_unref(parse);
+	}
+
+	if(isEncode && isOutput[VIDEO_OUTPUT_FILE]) {
+		m_fileFormat = cfg.fileFormat;
+		m_fileIndex = cfg.fileIndex;
+		m_maxFiles = max(1, cfg.maxFiles);
+		GstElement *rec = gst_bin_get_by_name(GST_BIN(m_pipeline), "rec");
+		g_signal_connect(rec, "format-location", (GCallback)&VideoEncoder::FormatLocation, this);
+		gst_object_unref(rec);
+	}
+
+	if(isOutput[VIDEO_OUTPUT_RTSP] || isOutput[VIDEO_OUTPUT_CLIP]) {
+		m_appSink = gst_bin_get_by_name(GST_BIN(m_pipeline), "encoded");
+		GstAppSinkCallbacks callbacks = { 0, 0, &VideoEncoder::NewSample };
+		gst_app_sink_set_callbacks(GST_APP_SINK(m_appSink), &callbacks, this, 0);
+	}
+
+	if(gst_element_set_state(m_pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+		printf("Video encoder - Fail to start pipeline\n");
+		PollBus();
+		Close();
+		return false;
+	}
+
+	m_frames = 0;
+	m_drops = 0;
+	m_metas.clear();
+	m_fps = cfg.fps;
+	m_frameSize = cfg.width * cfg.height * 3;
+
+	for(int i=0;i<NUM_VIDEO_OUTPUT;i++) {
+		if(isOutput[i])
+			cout << "*** Start " << s_outputName[i] << " video" << (isHardware ? "" : " (software encoder)") << " ***" << endl;
+	}
+
+	return true;
+}
+
+void VideoEncoder::Close()
+{
+	if(m_pipeline == 0)
+		return;
+
+	if(m_appSrc) {
+		gst_app_src_end_of_stream(GST_APP_SRC(m_appSrc));
+		/* Wait muxers to write their trailers, the last segment is finished here */
+		GstMessage *msg = gst_bus_timed_pop_filtered(m_bus, 3 * GST_SECOND, (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+		if(msg)
+			gst_message_unref(msg);
+		else
+			printf("Video encoder - Timeout of end of stream\n");
+	}
+
+	gst_element_set_state(m_pipeline, GST_STATE_NULL);
+
+	if(m_drops > 0)
+		printf("Video encoder - %lu frames, %lu dropped\n", (unsigned long)m_frames, (unsigned long)m_drops);
+
+	if(m_appSink) {
+		gst_object_unref(m_appSink);
+		m_appSink = 0;
+	}
+	if(m_appSrc) {
+		gst_object_unref(m_appSrc);
+		m_appSrc = 0;
+	}
+	if(m_bus) {
+		gst_object_unref(m_bus);
+		m_bus = 0;
+	}
+	gst_object_unref(m_pipeline);
+	m_pipeline = 0;
+}
+
+bool VideoEncoder::Write(const Mat & frame, const OverlayRecord *record)
+{
+	if(m_pipeline == 0)
+		return false;
+
+	PollBus();
+
+	/* Encoder behind, drop here instead of queueing frames of pool */
+	if(gst_app_src_get_current_level_bytes(GST_APP_SRC(m_appSrc)) >= m_frameSize * VIDEO_ENCODER_QUEUE_FRAMES) {
+		m_drops++;
+		return false;
+	}
+
+	/* Holds a reference of frame until converter is done with it */
+	Mat *ref = new Mat(frame.isContinuous() ? frame : frame.clone());
+	size_t size = ref->total() * ref->elemSize();
+	GstBuffer *buffer = gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY, ref->data, size, 0, size, ref, ReleaseFrame);
+
+	GST_BUFFER_DURATION(buffer) = gst_util_uint64_scale_int(1, GST_SECOND, m_fps);
+	GST_BUFFER_PTS(buffer) = m_frames * GST_BUFFER_DURATION(buffer);
+
+	if(record) {
+		std::unique_lock<std::mutex> lock(m_metaMutex);
+		if(m_metas.size() >= VIDEO_ENCODER_QUEUE_FRAMES * 16) /* Encoder gives no output */
+			m_metas.pop_front();
+		m_metas.push_back(make_pair(GST_BUFFER_PTS(buffer), vector<uint8_t>()));
+		SerializeStreamMeta(*record, GST_BUFFER_PTS(buffer), m_metas.back().second);
+	}
+
+	if(gst_app_src_push_buffer(GST_APP_SRC(m_appSrc), buffer) != GST_FLOW_OK) /* Takes buffer */
+		return false;
+
+	m_frames++;
+	return true;
+}
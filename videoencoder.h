@@ -0,0 +1,94 @@
+#ifndef VIDEOENCODER_H
+#define VIDEOENCODER_H
+
+#include "dragon-eye.h"
+#include "overlay.h"
+
+#include "gstreamer-1.0/gst/gst.h"
+#include <gstreamer-1.0/gst/app/app.h>
+
+#include <deque>
+#include <mutex>
+
+/*
+* Result frames are converted and H.265 encoded once, the encoded stream is teed to every output :
+*
+*   appsrc (BGR) -> convert -> tee -> screen
+*                                  -> encoder -> parser -> tee -> file (splitmuxsink, mp4mux)
+*                                                              -> RTP (rtph265pay)
+*                                                              -> HLS (mpegtsmux)
+*                                                              -> RTSP / clip (appsink, access units to RTSP media and event recorder)
+*
+* Tracks of each frame are inserted into its access unit as SEI user data after the parser, every branch carries them.
+* Branches have their own queue, network branches are leaky so a stalled client never blocks recording.
+* Recording is one long-lived branch, splitmuxsink starts a new file at a key frame so nothing is lost between segments.
+* nvv4l2h265enc if there is one, x265enc otherwise so that the same pipeline runs on a desktop for testing.
+*/
+
+typedef enum { VIDEO_OUTPUT_FILE, VIDEO_OUTPUT_SCREEN, VIDEO_OUTPUT_RTP, VIDEO_OUTPUT_HLS, VIDEO_OUTPUT_RTSP, VIDEO_OUTPUT_CLIP, NUM_VIDEO_OUTPUT } VideoOutput_t;
+
+typedef struct {
+	bool isOutput[NUM_VIDEO_OUTPUT];
+	int width, height, fps;
+	string fileFormat; /* Path of recorded segments, %03d is replaced by index */
+	int fileIndex; /* Index of first segment */
+	int maxFiles; /* Index loops back to 0 */
+	int segmentSeconds; /* Segments are split at the first key frame after */
+	int clipPreSeconds, clipPostSeconds; /* Event clip around triggers */
+	string rtpHost;
+	uint16_t rtpPort;
+} VideoEncoderConfig;
+
+/* Encoded access unit of H.265 byte stream, called on streaming thread of encoder, buffer is not owned */
+typedef void (*EncodedCallback)(GstBuffer *buffer, void *user);
+
+class VideoEncoder
+{
+private:
+	GstElement *m_pipeline;
+	GstElement *m_appSrc;
+	GstElement *m_appSink; /* RTSP / clip branch */
+	GstBus *m_bus;
+	uint64_t m_frames;
+	uint64_t m_drops; /* Encoder behind, dropped before appsrc */
+	int m_fps;
+	size_t m_frameSize;
+	EncodedCallback m_encodedCallback;
+	void *m_encodedUser;
+	string m_fileFormat;
+	int m_fileIndex;
+	int m_maxFiles;
+	std::mutex m_metaMutex;
+	deque< pair< GstClockTime, vector<uint8_t> > > m_metas; /* SEI payloads of frames in encoder, by PTS */
+
+	VideoEncoder(const VideoEncoder &) = delete;
+	VideoEncoder & operator=(const VideoEncoder &) = delete;
+
+	static GstFlowReturn NewSample(GstAppSink *sink, gpointer user);
+	static gchar *FormatLocation(GstElement *splitmux, guint fragmentId, gpointer user);
+	static GstPadProbeReturn MetaProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user);
+	void PollBus();
+
+public:
+	VideoEncoder() : m_pipeline(0), m_appSrc(0), m_appSink(0), m_bus(0), m_frames(0), m_drops(0), m_fps(CAMERA_FPS), m_frameSize(0),
+		m_encodedCallback(0), m_encodedUser(0), m_fileIndex(0), m_maxFiles(1) {}
+	~VideoEncoder() { Close(); }
+
+	static bool IsHardwareEncoder();
+	static const char *OutputName(VideoOutput_t output);
+
+	/* RTSP / clip branch, set before Open() */
+	void EncodedSink(EncodedCallback callback, void *user) { m_encodedCallback = callback; m_encodedUser = user; }
+
+	bool Open(const VideoEncoderConfig & cfg);
+	void Close(); /* End of stream first, muxers finish their files */
+
+	/* BGR of configured size, buffer refers to frame without copy until converter is done with it. Tracks of record go to stream */
+	bool Write(const Mat & frame, const OverlayRecord *record = 0);
+
+	inline bool IsOpened() const { return m_pipeline != 0; }
+	inline uint64_t Frames() const { return m_frames; }
+	inline uint64_t Drops() const { return m_drops; }
+};
+
+#endif